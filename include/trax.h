@@ -41,6 +41,7 @@
 
 #define TRAX_VERSION 4
 
+#define TRAX_PENDING -2
 #define TRAX_ERROR -1
 #define TRAX_OK 0
 #define TRAX_HELLO 1
@@ -54,6 +55,8 @@
 #define TRAX_IMAGE_URL 2
 #define TRAX_IMAGE_MEMORY 4
 #define TRAX_IMAGE_BUFFER 8
+// Memory images passed through shared memory, received as read-only TRAX_IMAGE_MEMORY images
+#define TRAX_IMAGE_SHM 16
 
 #define TRAX_IMAGE_ANY (TRAX_IMAGE_PATH | TRAX_IMAGE_URL | TRAX_IMAGE_MEMORY | TRAX_IMAGE_BUFFER)
 
@@ -65,6 +68,16 @@
 #define TRAX_IMAGE_MEMORY_GRAY8 1
 #define TRAX_IMAGE_MEMORY_GRAY16 2
 #define TRAX_IMAGE_MEMORY_RGB 3
+#define TRAX_IMAGE_MEMORY_BGR 4
+#define TRAX_IMAGE_MEMORY_RGBA 5
+#define TRAX_IMAGE_MEMORY_BGRA 6
+// Full resolution luma plane followed by a plane of interleaved chroma samples at half resolution
+#define TRAX_IMAGE_MEMORY_NV12 7
+
+// Memory formats are negotiated as a bit-set, the first three are supported by every tracker
+#define TRAX_IMAGE_MEMORY_FLAG(F) (1 << (F))
+#define TRAX_IMAGE_MEMORY_DEFAULT (TRAX_IMAGE_MEMORY_FLAG(TRAX_IMAGE_MEMORY_GRAY8) | \
+    TRAX_IMAGE_MEMORY_FLAG(TRAX_IMAGE_MEMORY_GRAY16) | TRAX_IMAGE_MEMORY_FLAG(TRAX_IMAGE_MEMORY_RGB))
 
 #define TRAX_REGION_EMPTY 0
 #define TRAX_REGION_SPECIAL 1
@@ -78,12 +91,22 @@
 #define TRAX_FLAG_SERVER 2
 #define TRAX_FLAG_TERMINATED 4
 
+#define TRAX_LOG_TRUNCATE 1
+
 #define TRAX_PARAMETER_VERSION 0
 #define TRAX_PARAMETER_CLIENT 1
 #define TRAX_PARAMETER_SOCKET 2
 #define TRAX_PARAMETER_REGION 3
 #define TRAX_PARAMETER_IMAGE 4
 #define TRAX_PARAMETER_MULTIOBJECT 5
+#define TRAX_PARAMETER_DESCRIPTOR 6
+#define TRAX_PARAMETER_PIPELINE 7
+#define TRAX_PARAMETER_CAPACITY 8
+#define TRAX_PARAMETER_POOL 9
+#define TRAX_PARAMETER_POOL_REUSED 10
+#define TRAX_PARAMETER_POOL_ALLOCATED 11
+#define TRAX_PARAMETER_ROI 12
+#define TRAX_PARAMETER_DELTA 13
 
 #define TRAX_CHANNELS 3
 #define TRAX_CHANNEL_COLOR 1
@@ -104,6 +127,8 @@
 
 // Metadata flags
 #define TRAX_METADATA_MULTI_OBJECT 1
+#define TRAX_METADATA_ROI 2
+#define TRAX_METADATA_DELTA 4
 
 #ifdef TRAX_LEGACY_SINGLE
 #define trax_server_wait trax_server_wait_sot
@@ -132,6 +157,9 @@ typedef struct trax_image {
     int height;
     int format;
     char* data;
+    void (*release)(struct trax_image* image);
+    void* owner;
+    int stride;
 } trax_image;
 
 /**
@@ -190,6 +218,7 @@ typedef struct trax_metadata {
     char* tracker_description;
     char* tracker_family;
     trax_properties* custom;
+    int format_memory; // Bit-set of supported memory formats, see TRAX_IMAGE_MEMORY_FLAG
 } trax_metadata;
 
 typedef trax_metadata trax_configuration;
@@ -205,6 +234,14 @@ typedef struct trax_handle {
     trax_metadata* metadata;
     char* error;
     int objects;
+    void* shared;
+    void* pending;
+    int sequence;
+    int inflight;
+    int pipeline;
+    void* pool;
+    void* roi;
+    void* delta;
 } trax_handle;
 
 /**
@@ -235,7 +272,8 @@ __TRAX_EXPORT trax_metadata* trax_metadata_create(int region_formats, int image_
 __TRAX_EXPORT void trax_metadata_release(trax_metadata** metadata);
 
 /**
- * A handy function to initialize a logging configuration structure.
+ * A handy function to initialize a logging configuration structure. The logger receives protocol data in spans,
+ * with TRAX_LOG_TRUNCATE in flags long payloads (e.g. encoded images) are shortened to their beginning.
 **/
 __TRAX_EXPORT trax_logging trax_logger_setup(trax_logger callback, void* data, int flags);
 
@@ -269,6 +307,18 @@ __TRAX_EXPORT int trax_client_initialize(trax_handle* client, trax_image_list* i
 **/
 __TRAX_EXPORT int trax_client_frame(trax_handle* client, trax_image_list* images, trax_object_list* objects, trax_properties* properties);
 
+/**
+ * Sends a frame message and prepares the handle for receiving the reply with trax_client_wait_try.
+ * Fails if the reply to the previous frame was not received yet.
+**/
+__TRAX_EXPORT int trax_client_frame_begin(trax_handle* client, trax_image_list* images, trax_object_list* objects, trax_properties* properties);
+
+/**
+ * Reads the reply of the server without blocking. Returns TRAX_PENDING if the reply is not complete
+ * yet, the descriptor (TRAX_PARAMETER_DESCRIPTOR) can then be polled for more data.
+**/
+__TRAX_EXPORT int trax_client_wait_try(trax_handle* client, trax_object_list** objects, trax_properties* properties);
+
 /**
  * Setups the protocol for the server side and returns a handle object.
 **/
@@ -299,6 +349,19 @@ __TRAX_EXPORT int trax_server_wait_mot(trax_handle* server, trax_image_list** im
 **/
 __TRAX_EXPORT int trax_server_reply_mot(trax_handle* server, trax_object_list* objects);
 
+/**
+ * Requests that the client only sends a part of the next frame. The part is given in the coordinates of the
+ * full image and is downscaled by a factor in range (0, 1]. The request is sent with the next reply and is
+ * only available if the tracker has the TRAX_METADATA_ROI flag set.
+**/
+__TRAX_EXPORT int trax_server_request_roi(trax_handle* server, int x, int y, int width, int height, float scale);
+
+/**
+ * Returns the part of the full image that the images of the last received frame cover. Returns zero if the
+ * images are not cropped. The scale of the images can be computed from their size.
+**/
+__TRAX_EXPORT int trax_server_get_roi(trax_handle* server, int* x, int* y, int* width, int* height);
+
 /**
  * Used in client and server. Closes communication, sends quit message if needed.
 **/
@@ -351,11 +414,37 @@ __TRAX_EXPORT trax_image* trax_image_create_url(const char* url);
 **/
 __TRAX_EXPORT trax_image* trax_image_create_memory(int width, int height, int format);
 
+/**
+ * Creates a raw buffer image description that uses the given memory instead of allocating it. Rows
+ * are stride bytes apart, zero means that they are packed. The release callback is called (with the
+ * image, so that it can access the data and owner fields) when the image is released, if it is NULL
+ * the memory is not freed by the library.
+**/
+__TRAX_EXPORT trax_image* trax_image_create_memory_wrap(int width, int height, int format, int stride, char* data, void (*release)(trax_image* image), void* owner);
+
 /**
  * Creates a file buffer image description.
 **/
 __TRAX_EXPORT trax_image* trax_image_create_buffer(int length, const char* data);
 
+/**
+ * Creates a raw buffer image description backed by a file descriptor (e.g. a memfd), the data is
+ * mapped read-only. Over a Unix domain socket the descriptor itself is passed to the tracker.
+**/
+__TRAX_EXPORT trax_image* trax_image_create_memory_descriptor(int descriptor, int width, int height, int format);
+
+/**
+ * Creates a file buffer image description backed by a file descriptor (e.g. an open JPEG file), the
+ * data is mapped read-only. Over a Unix domain socket the descriptor itself is passed to the tracker.
+**/
+__TRAX_EXPORT trax_image* trax_image_create_buffer_descriptor(int descriptor);
+
+/**
+ * Creates a file buffer image description from an encoded image file (JPEG or PNG) without reading
+ * it, the file is mapped read-only and the mapping is released together with the image.
+**/
+__TRAX_EXPORT trax_image* trax_image_create_buffer_file(const char* path);
+
 /**
  * Returns a type of the image handle.
 **/
@@ -378,6 +467,11 @@ __TRAX_EXPORT const char* trax_image_get_url(const trax_image* image);
 **/
 __TRAX_EXPORT void trax_image_get_memory_header(const trax_image* image, int* width, int* height, int* format);
 
+/**
+ * Returns the number of bytes between the starts of two rows of a memory image.
+**/
+__TRAX_EXPORT int trax_image_get_memory_stride(const trax_image* image);
+
 /**
  * Returns a pointer for a writeable row in a data array of an image.
 **/
@@ -750,6 +844,10 @@ public:
 
     int image_formats() const;
 
+    int memory_formats() const;
+
+    void set_memory_formats(int formats);
+
     int region_formats() const;
 
     int channels() const;
@@ -877,6 +975,26 @@ public:
     **/
     int frame(const ImageList& image, const ObjectList& objects, const Properties& properties);
 
+    /**
+    * Sends a frame message, the reply is received with wait_try.
+    **/
+    int frame_begin(const ImageList& image, const Properties& properties);
+
+    /**
+    * Sends a frame message that adds new objects (in multi-object mode), the reply is received with wait_try.
+    **/
+    int frame_begin(const ImageList& image, const ObjectList& objects, const Properties& properties);
+
+    /**
+    * Reads the reply of the server without blocking, returns TRAX_PENDING if it is not complete yet.
+    **/
+    int wait_try(ObjectList& objects, Properties& properties);
+
+    /**
+    * Returns the descriptor that can be polled for incoming data.
+    **/
+    int descriptor();
+
 protected:
 
     using Handle::cleanup;
@@ -917,6 +1035,16 @@ public:
     **/
     int reply(const ObjectList& objects);
 
+    /**
+     * Requests that the client only sends a part of the next frame.
+    **/
+    int request_roi(int x, int y, int width, int height, float scale = 1);
+
+    /**
+     * Returns the part of the full image that the last frame covers, returns false if the frame is whole.
+    **/
+    bool get_roi(int* x, int* y, int* width, int* height);
+
 private:
     ServerMOT& operator=(ServerMOT p) throw();
 
@@ -942,6 +1070,16 @@ public:
     **/
     int reply(const Region& region, const Properties& properties);
 
+    /**
+     * Requests that the client only sends a part of the next frame.
+    **/
+    int request_roi(int x, int y, int width, int height, float scale = 1);
+
+    /**
+     * Returns the part of the full image that the last frame covers, returns false if the frame is whole.
+    **/
+    bool get_roi(int* x, int* y, int* width, int* height);
+
 private:
     ServerSOT& operator=(ServerSOT p) throw();
 
@@ -976,11 +1114,31 @@ public:
     **/
     static Image create_memory(int width, int height, int format);
 
+    /**
+     * Creates a raw buffer image description that uses caller-owned memory.
+    **/
+    static Image create_memory_wrap(int width, int height, int format, int stride, char* data, void (*release)(trax_image* image) = NULL, void* owner = NULL);
+
     /**
      * Creates a file buffer image description.
     **/
     static Image create_buffer(int length, const char* data);
 
+    /**
+     * Creates a raw buffer image description backed by a file descriptor.
+    **/
+    static Image create_memory_descriptor(int descriptor, int width, int height, int format);
+
+    /**
+     * Creates a file buffer image description backed by a file descriptor.
+    **/
+    static Image create_buffer_descriptor(int descriptor);
+
+    /**
+     * Creates a file buffer image description by mapping an encoded image file.
+    **/
+    static Image create_buffer_file(const std::string& path);
+
     /**
      * Releases image structure, frees allocated memory.
     **/
@@ -1013,6 +1171,11 @@ public:
     **/
     void get_memory_header(int* width, int* height, int* format) const;
 
+    /**
+     * Returns the number of bytes between the starts of two rows of a memory image.
+    **/
+    int get_memory_stride() const;
+
     /**
      * Returns a pointer for a writeable row in a data array of an image.
     **/
@@ -65,6 +65,27 @@
 #include <string.h>
 #include "base64.h"
 
+/* The bulk of the data is encoded and decoded with vector kernels where the
+ * processor supports them, the scalar code below handles the remainder and
+ * any data the kernels refuse. x86 kernels are selected at runtime, NEON is
+ * always available on 64-bit ARM.
+ */
+#if !defined(BASE64_DISABLE_SIMD)
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define BASE64_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define BASE64_TARGET(T)
+#else
+#define BASE64_TARGET(T) __attribute__((target(T)))
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define BASE64_NEON
+#include <arm_neon.h>
+#endif
+#endif
+
 static const unsigned char pr2six[256] =
 {
     64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
@@ -85,34 +106,362 @@ static const unsigned char pr2six[256] =
     64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64
 };
 
-int base64decodelen(const char *bufcoded) {
+static const char basis_64[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
-    size_t len = strlen(bufcoded),
-        padding = 0;
+/* A kernel encodes whole blocks of the input and returns the number of input
+ * bytes it has consumed, the output position follows from it.
+ */
+typedef int (*encode_kernel)(char *encoded, const unsigned char *string, int len);
+
+/* A decode kernel returns the number of characters it has consumed, it stops
+ * at the first block that contains a character outside of the alphabet. The
+ * length excludes the padding and the output has room for all of it.
+ */
+typedef int (*decode_kernel)(unsigned char *bufplain, const char *bufcoded, int len);
 
-    if (bufcoded[len-1] == '=' && bufcoded[len-2] == '=') //last two chars are =
-        padding = 2;
-    else if (bufcoded[len-1] == '=') //last char is =
-        padding = 1;
+#ifdef BASE64_X86
+
+/* Vector kernels follow the approach of W. Mula and D. Lemire, "Faster Base64
+ * Encoding and Decoding Using AVX2 Instructions". Each 32-bit lane holds three
+ * input bytes (or four characters) that are split (or merged) with shuffles and
+ * multiplications, characters are translated with nibble lookup tables.
+ */
+
+BASE64_TARGET("ssse3")
+static __m128i encode_lookup_ssse3(const __m128i indices) {
+
+    const __m128i shift = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+
+    __m128i result = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    const __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+    result = _mm_or_si128(result, _mm_and_si128(less, _mm_set1_epi8(13)));
+
+    return _mm_add_epi8(_mm_shuffle_epi8(shift, result), indices);
 
-    return ((len*3)/4 - padding) + 1;
 }
 
-int base64decode(unsigned char *bufplain, const char *bufcoded) {
-    int nbytesdecoded;
+BASE64_TARGET("ssse3")
+static int encode_ssse3(char *encoded, const unsigned char *string, int len) {
+
+    int i = 0;
+
+    // Loads are 16 bytes wide, only 12 of them are used
+    for (; len - i >= 16; i += 12) {
+
+        __m128i in = _mm_loadu_si128((const __m128i *) (string + i));
+
+        in = _mm_shuffle_epi8(in, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+        in = _mm_or_si128(
+            _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040)),
+            _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010)));
+
+        _mm_storeu_si128((__m128i *) (encoded + (i / 3) * 4), encode_lookup_ssse3(in));
+
+    }
+
+    return i;
+
+}
+
+BASE64_TARGET("ssse3")
+static int decode_ssse3(unsigned char *bufplain, const char *bufcoded, int len) {
+
+    int i = 0;
+
+    const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+        0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+        0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+
+    // Stores are 16 bytes wide, only 12 of them are used, so there has to be some input left
+    for (; len - i >= 24; i += 16) {
+
+        __m128i in = _mm_loadu_si128((const __m128i *) (bufcoded + i));
+        const __m128i hi = _mm_and_si128(_mm_srli_epi32(in, 4), _mm_set1_epi8(0x0f));
+        const __m128i lo = _mm_and_si128(in, _mm_set1_epi8(0x0f));
+        const __m128i invalid = _mm_and_si128(_mm_shuffle_epi8(lut_lo, lo), _mm_shuffle_epi8(lut_hi, hi));
+
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(invalid, _mm_setzero_si128())) != 0xFFFF) break;
+
+        in = _mm_add_epi8(in, _mm_shuffle_epi8(lut_roll, _mm_add_epi8(_mm_cmpeq_epi8(in, _mm_set1_epi8('/')), hi)));
+        in = _mm_madd_epi16(_mm_maddubs_epi16(in, _mm_set1_epi32(0x01400140)), _mm_set1_epi32(0x00011000));
+        in = _mm_shuffle_epi8(in, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+
+        _mm_storeu_si128((__m128i *) (bufplain + (i / 4) * 3), in);
+
+    }
+
+    return i;
+
+}
+
+BASE64_TARGET("avx2")
+static int encode_avx2(char *encoded, const unsigned char *string, int len) {
+
+    int i = 0;
+
+    const __m256i shift = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+
+    // Each lane takes 12 bytes, the upper one is loaded from an overlapping position
+    for (; len - i >= 28; i += 24) {
+
+        __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(
+            _mm_loadu_si128((const __m128i *) (string + i))),
+            _mm_loadu_si128((const __m128i *) (string + i + 12)), 1);
+        __m256i result;
+
+        in = _mm256_shuffle_epi8(in, _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+            1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+        in = _mm256_or_si256(
+            _mm256_mulhi_epu16(_mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040)),
+            _mm256_mullo_epi16(_mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010)));
+
+        result = _mm256_subs_epu8(in, _mm256_set1_epi8(51));
+        result = _mm256_or_si256(result, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), in), _mm256_set1_epi8(13)));
+        result = _mm256_add_epi8(_mm256_shuffle_epi8(shift, result), in);
+
+        _mm256_storeu_si256((__m256i *) (encoded + (i / 3) * 4), result);
+
+    }
+
+    return i + encode_ssse3(encoded + (i / 3) * 4, string + i, len - i);
+
+}
+
+BASE64_TARGET("avx2")
+static int decode_avx2(unsigned char *bufplain, const char *bufcoded, int len) {
+
+    int i = 0;
+
+    const __m256i lut_lo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+        0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+        0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m256i lut_hi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+        0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+        0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i lut_roll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+
+    // Stores are 32 bytes wide, only 24 of them are used, so there has to be some input left
+    for (; len - i >= 48; i += 32) {
+
+        __m256i in = _mm256_loadu_si256((const __m256i *) (bufcoded + i));
+        const __m256i hi = _mm256_and_si256(_mm256_srli_epi32(in, 4), _mm256_set1_epi8(0x0f));
+        const __m256i lo = _mm256_and_si256(in, _mm256_set1_epi8(0x0f));
+        const __m256i invalid = _mm256_and_si256(_mm256_shuffle_epi8(lut_lo, lo), _mm256_shuffle_epi8(lut_hi, hi));
+
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(invalid, _mm256_setzero_si256())) != -1) break;
+
+        in = _mm256_add_epi8(in, _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(_mm256_cmpeq_epi8(in, _mm256_set1_epi8('/')), hi)));
+        in = _mm256_madd_epi16(_mm256_maddubs_epi16(in, _mm256_set1_epi32(0x01400140)), _mm256_set1_epi32(0x00011000));
+        in = _mm256_shuffle_epi8(in, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+            2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+        // Both lanes hold 12 bytes, they are moved together
+        in = _mm256_permutevar8x32_epi32(in, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+
+        _mm256_storeu_si256((__m256i *) (bufplain + (i / 4) * 3), in);
+
+    }
+
+    return i + decode_ssse3(bufplain + (i / 4) * 3, bufcoded + i, len - i);
+
+}
+
+static void cpu_features(int *ssse3, int *avx2) {
+
+#ifdef _MSC_VER
+    int info[4];
+
+    __cpuid(info, 0);
+
+    *ssse3 = 0;
+    *avx2 = 0;
+
+    if (info[0] < 1) return;
+
+    __cpuid(info, 1);
+    *ssse3 = (info[2] & (1 << 9)) != 0;
+
+    // AVX registers have to be enabled by the operating system
+    if (!(info[2] & (1 << 27)) || (_xgetbv(0) & 6) != 6) return;
+
+    __cpuid(info, 0);
+    if (info[0] < 7) return;
+
+    __cpuidex(info, 7, 0);
+    *avx2 = (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    *ssse3 = __builtin_cpu_supports("ssse3");
+    *avx2 = __builtin_cpu_supports("avx2");
+#endif
+
+}
+
+#endif
+
+#ifdef BASE64_NEON
+
+static int encode_neon(char *encoded, const unsigned char *string, int len) {
+
+    int i = 0;
+    uint8x16x4_t lut;
+
+    lut.val[0] = vld1q_u8((const uint8_t *) basis_64);
+    lut.val[1] = vld1q_u8((const uint8_t *) basis_64 + 16);
+    lut.val[2] = vld1q_u8((const uint8_t *) basis_64 + 32);
+    lut.val[3] = vld1q_u8((const uint8_t *) basis_64 + 48);
+
+    // Loads deinterleave the bytes of 16 groups at once, stores interleave the characters
+    for (; len - i >= 48; i += 48) {
+
+        const uint8x16x3_t in = vld3q_u8(string + i);
+        const uint8x16_t mask = vdupq_n_u8(0x3F);
+        uint8x16x4_t out;
+
+        out.val[0] = vshrq_n_u8(in.val[0], 2);
+        out.val[1] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[0], 4), vshrq_n_u8(in.val[1], 4)), mask);
+        out.val[2] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[1], 2), vshrq_n_u8(in.val[2], 6)), mask);
+        out.val[3] = vandq_u8(in.val[2], mask);
+
+        out.val[0] = vqtbl4q_u8(lut, out.val[0]);
+        out.val[1] = vqtbl4q_u8(lut, out.val[1]);
+        out.val[2] = vqtbl4q_u8(lut, out.val[2]);
+        out.val[3] = vqtbl4q_u8(lut, out.val[3]);
+
+        vst4q_u8((uint8_t *) encoded + (i / 3) * 4, out);
+
+    }
+
+    return i;
+
+}
+
+// Translates characters to their values, characters outside of the alphabet are marked in the invalid mask
+static uint8x16_t decode_lookup_neon(uint8x16_t in, uint8x16_t *invalid) {
+
+    const uint8x16_t upper = vcltq_u8(vsubq_u8(in, vdupq_n_u8('A')), vdupq_n_u8(26));
+    const uint8x16_t lower = vcltq_u8(vsubq_u8(in, vdupq_n_u8('a')), vdupq_n_u8(26));
+    const uint8x16_t digit = vcltq_u8(vsubq_u8(in, vdupq_n_u8('0')), vdupq_n_u8(10));
+    const uint8x16_t plus = vceqq_u8(in, vdupq_n_u8('+'));
+    const uint8x16_t slash = vceqq_u8(in, vdupq_n_u8('/'));
+
+    uint8x16_t result = vandq_u8(upper, vsubq_u8(in, vdupq_n_u8('A')));
+    result = vorrq_u8(result, vandq_u8(lower, vsubq_u8(in, vdupq_n_u8('a' - 26))));
+    result = vorrq_u8(result, vandq_u8(digit, vaddq_u8(in, vdupq_n_u8(52 - '0'))));
+    result = vorrq_u8(result, vandq_u8(plus, vdupq_n_u8(62)));
+    result = vorrq_u8(result, vandq_u8(slash, vdupq_n_u8(63)));
+
+    *invalid = vorrq_u8(*invalid, vmvnq_u8(vorrq_u8(vorrq_u8(upper, lower), vorrq_u8(digit, vorrq_u8(plus, slash)))));
+
+    return result;
+
+}
+
+static int decode_neon(unsigned char *bufplain, const char *bufcoded, int len) {
+
+    int i = 0;
+
+    for (; len - i >= 64; i += 64) {
+
+        uint8x16x4_t in = vld4q_u8((const uint8_t *) bufcoded + i);
+        uint8x16_t invalid = vdupq_n_u8(0);
+        uint8x16x3_t out;
+
+        in.val[0] = decode_lookup_neon(in.val[0], &invalid);
+        in.val[1] = decode_lookup_neon(in.val[1], &invalid);
+        in.val[2] = decode_lookup_neon(in.val[2], &invalid);
+        in.val[3] = decode_lookup_neon(in.val[3], &invalid);
+
+        if (vmaxvq_u8(invalid)) break;
+
+        out.val[0] = vorrq_u8(vshlq_n_u8(in.val[0], 2), vshrq_n_u8(in.val[1], 4));
+        out.val[1] = vorrq_u8(vshlq_n_u8(in.val[1], 4), vshrq_n_u8(in.val[2], 2));
+        out.val[2] = vorrq_u8(vshlq_n_u8(in.val[2], 6), in.val[3]);
+
+        vst3q_u8(bufplain + (i / 4) * 3, out);
+
+    }
+
+    return i;
+
+}
+
+#endif
+
+static encode_kernel encode_simd = NULL;
+static decode_kernel decode_simd = NULL;
+static int kernels_selected = 0;
+
+// Kernels are chosen once, concurrent first calls make the same choice
+static void select_kernels() {
+
+#ifdef BASE64_X86
+    int ssse3, avx2;
+
+    cpu_features(&ssse3, &avx2);
+
+    if (avx2) {
+        encode_simd = encode_avx2;
+        decode_simd = decode_avx2;
+    } else if (ssse3) {
+        encode_simd = encode_ssse3;
+        decode_simd = decode_ssse3;
+    }
+#endif
+
+#ifdef BASE64_NEON
+    encode_simd = encode_neon;
+    decode_simd = decode_neon;
+#endif
+
+    kernels_selected = 1;
+
+}
+
+int base64decodelen_n(const char *bufcoded, int len) {
+
+    // Padding is not required, an incomplete group still carries data
+    if (len > 0 && bufcoded[len - 1] == '=') len--;
+    if (len > 0 && bufcoded[len - 1] == '=') len--;
+
+    return (len * 3) / 4;
+}
+
+int base64decodelen(const char *bufcoded) {
+
+    return base64decodelen_n(bufcoded, strlen(bufcoded)) + 1;
+}
+
+int base64decode_n(unsigned char *bufplain, const char *bufcoded, int len) {
     register const unsigned char *bufin;
     register unsigned char *bufout;
     register int nprbytes;
+    int i = 0;
+
+    if (len > 0 && bufcoded[len - 1] == '=') len--;
+    if (len > 0 && bufcoded[len - 1] == '=') len--;
+
+    if (!kernels_selected) select_kernels();
 
-    bufin = (const unsigned char *) bufcoded;
-    while (pr2six[*(bufin++)] <= 63);
-    nprbytes = (bufin - (const unsigned char *) bufcoded) - 1;
-    nbytesdecoded = ((nprbytes + 3) / 4) * 3;
+    if (decode_simd) i = decode_simd(bufplain, bufcoded, len);
 
-    bufout = (unsigned char *) bufplain;
-    bufin = (const unsigned char *) bufcoded;
+    bufout = bufplain + (i / 4) * 3;
+    bufin = (const unsigned char *) bufcoded + i;
+    nprbytes = len - i;
 
-    while (nprbytes > 4) {
+    /* Decoding stops at the first character that is not in the alphabet */
+    while (nprbytes >= 4) {
+	if ((pr2six[bufin[0]] | pr2six[bufin[1]] | pr2six[bufin[2]] | pr2six[bufin[3]]) > 63)
+	    break;
 	*(bufout++) =
 	    (unsigned char) (pr2six[*bufin] << 2 | pr2six[bufin[1]] >> 4);
 	*(bufout++) =
@@ -123,6 +472,12 @@ int base64decode(unsigned char *bufplain, const char *bufcoded) {
 	nprbytes -= 4;
     }
 
+    if (nprbytes > 3) nprbytes = 3;
+    for (i = 0; i < nprbytes; i++) {
+	if (pr2six[bufin[i]] > 63) break;
+    }
+    nprbytes = i;
+
     /* Note: (nprbytes == 1) would be an error, so just ingore that case */
     if (nprbytes > 1) {
 	*(bufout++) =
@@ -132,29 +487,31 @@ int base64decode(unsigned char *bufplain, const char *bufcoded) {
 	*(bufout++) =
 	    (unsigned char) (pr2six[bufin[1]] << 4 | pr2six[bufin[2]] >> 2);
     }
-    if (nprbytes > 3) {
-	*(bufout++) =
-	    (unsigned char) (pr2six[bufin[2]] << 6 | pr2six[bufin[3]]);
-    }
 
-    *(bufout++) = '\0';
-    nbytesdecoded -= (4 - nprbytes) & 3;
-    return nbytesdecoded;
+    return bufout - bufplain;
 }
 
-static const char basis_64[] =
-    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+int base64decode(unsigned char *bufplain, const char *bufcoded) {
+    int nbytesdecoded = base64decode_n(bufplain, bufcoded, strlen(bufcoded));
+
+    bufplain[nbytesdecoded] = '\0';
+    return nbytesdecoded;
+}
 
 int base64encodelen(int len) {
     return ((len + 2) / 3 * 4) + 1;
 }
 
 int base64encode(char *encoded, const unsigned char *string, int len) {
-    int i;
+    int i = 0;
     char *p;
 
-    p = encoded;
-    for (i = 0; i < len - 2; i += 3) {
+    if (!kernels_selected) select_kernels();
+
+    if (encode_simd) i = encode_simd(encoded, string, len);
+
+    p = encoded + (i / 3) * 4;
+    for (; i < len - 2; i += 3) {
 	*p++ = basis_64[(string[i] >> 2) & 0x3F];
 	*p++ = basis_64[((string[i] & 0x3) << 4) |
 	                ((int) (string[i + 1] & 0xF0) >> 4)];
@@ -179,4 +536,3 @@ int base64encode(char *encoded, const unsigned char *string, int len) {
     *p++ = '\0';
     return p - encoded;
 }
-
@@ -7,6 +7,17 @@ int base64decodelen(const char *bufcoded);
 
 int base64decode(unsigned char *bufplain, const char *bufcoded);
 
+/**
+ * Returns the number of bytes encoded in the first len characters, the result does not include a terminator.
+**/
+int base64decodelen_n(const char *bufcoded, int len);
+
+/**
+ * Decodes the first len characters without scanning for the end of the string, returns the number of
+ * decoded bytes. Unlike base64decode it does not terminate the output.
+**/
+int base64decode_n(unsigned char *bufplain, const char *bufcoded, int len);
+
 int base64encodelen(int len);
 
 int base64encode(char *encoded, const unsigned char *string, int len);
@@ -23,8 +23,12 @@ typedef struct string_buffer {
 
 typedef struct string_list {
 	char** buffer;
+	int* lengths;
 	int position;
 	int size;
+	char* arena;
+	int arena_position;
+	int arena_size;
 } string_list;
 
 #define BUFFER_INCREMENT_STEP 4096
@@ -72,6 +76,19 @@ static __INLINE void buffer_push(string_buffer* B, char C) {
 	B->position += required;
 }
 
+// Appends a run of characters at once, growing the buffer geometrically for large payloads
+static __INLINE void buffer_push_n(string_buffer* B, const char* S, int N) {
+	if (N < 1) return;
+	if (N > B->size - B->position) {
+		int size = B->size + (B->size >> 1) + BUFFER_INCREMENT_STEP;
+		if (size < B->position + N) size = B->position + N + BUFFER_INCREMENT_STEP;
+		B->size = size;
+		B->buffer = (char*) realloc(B->buffer, sizeof(char) * B->size);
+	}
+	memcpy(&(B->buffer[B->position]), S, N);
+	B->position += N;
+}
+
 static __INLINE void buffer_append(string_buffer* B, const char *format, ...) {
 
 	int required;
@@ -111,13 +128,31 @@ static __INLINE string_list* list_create(int L) {
 	string_list* B = (string_list*) malloc(sizeof(string_list));
 	B->size = L;
 	B->buffer = (char**) malloc(sizeof(char*) * B->size);
+	B->lengths = (int*) malloc(sizeof(int) * B->size);
 	memset(B->buffer, 0, sizeof(char*) * B->size);
 	B->position = 0;
+	B->arena = NULL;
+	B->arena_position = 0;
+	B->arena_size = 0;
+	return B;
+}
+
+// Creates a list that keeps all elements in a single block of memory, the block is reused when
+// the list is reset so that a list that is filled repeatedly stops allocating memory
+static __INLINE string_list* list_create_arena(int L, int N) {
+	string_list* B = list_create(L);
+	B->arena_size = N > 0 ? N : BUFFER_INCREMENT_STEP;
+	B->arena = (char*) malloc(sizeof(char) * B->arena_size);
 	return B;
 }
 
 static __INLINE void list_reset(string_list* B) {
 	int i;
+	if (B->arena) {
+		B->position = 0;
+		B->arena_position = 0;
+		return;
+	}
 	for (i = 0; i < B->position; i++) {
 		if (B->buffer[i]) free(B->buffer[i]);
 		B->buffer[i] = NULL;
@@ -130,14 +165,22 @@ static __INLINE void list_destroy(string_list **B) {
 
 	if (!(*B)) return;
 
-	for (i = 0; i < (*B)->position; i++) {
-		if ((*B)->buffer[i]) free((*B)->buffer[i]); (*B)->buffer[i] = NULL;
+	if ((*B)->arena) {
+		free((*B)->arena); (*B)->arena = NULL;
+	} else {
+		for (i = 0; i < (*B)->position; i++) {
+			if ((*B)->buffer[i]) free((*B)->buffer[i]); (*B)->buffer[i] = NULL;
+		}
 	}
 
 	if ((*B)->buffer) {
 		free((*B)->buffer); (*B)->buffer = NULL;
 	}
 
+	if ((*B)->lengths) {
+		free((*B)->lengths); (*B)->lengths = NULL;
+	}
+
 	free((*B));
 	(*B) = NULL;
 }
@@ -150,7 +193,7 @@ static __INLINE char* list_get(const string_list *B, int I) {
 			return NULL;
 		} else {
 			char *S;
-			int length = strlen(B->buffer[I]);
+			int length = B->lengths[I];
 			S = (char*) malloc(sizeof(char) * (length + 1));
 			memcpy(S, B->buffer[I], length + 1);
 			return S;
@@ -162,28 +205,92 @@ static __INLINE int list_size(const string_list *B) {
 	return B->position;
 }
 
-static __INLINE void list_append(string_list *B, char* S) {
-	int required = 1;
-	int length = strlen(S);
-	if (required > B->size - B->position) {
-		B->size = B->position + 16;
-		B->buffer = (char**) realloc(B->buffer, sizeof(char*) * B->size);
+// Returns the length of an element, which may also contain binary data with zero bytes
+static __INLINE int list_length(const string_list *B, int I) {
+	if (I < 0 || I >= B->position) return 0;
+	return B->lengths[I];
+}
+
+static __INLINE void list_grow(string_list *B) {
+	if (B->position < B->size) return;
+	B->size = B->position + 16;
+	B->buffer = (char**) realloc(B->buffer, sizeof(char*) * B->size);
+	B->lengths = (int*) realloc(B->lengths, sizeof(int) * B->size);
+}
+
+// Makes room for N more bytes at the end of the arena
+static __INLINE void list_arena_reserve(string_list *B, int N) {
+	if (N > B->arena_size - B->arena_position) {
+		// Elements are stored one after another, their pointers have to be moved with the block
+		int i, offset = 0;
+		int size = B->arena_size + (B->arena_size >> 1) + BUFFER_INCREMENT_STEP;
+		if (size < B->arena_position + N) size = B->arena_position + N + BUFFER_INCREMENT_STEP;
+		B->arena_size = size;
+		B->arena = (char*) realloc(B->arena, sizeof(char) * B->arena_size);
+		for (i = 0; i < B->position; i++) {
+			B->buffer[i] = &(B->arena[offset]);
+			offset += B->lengths[i] + 1;
+		}
 	}
-	B->buffer[B->position] = (char*) malloc(sizeof(char) * (length + 1));
-	memcpy(B->buffer[B->position], S, length + 1);
-	B->position += required;
+}
+
+// Appends an element of N bytes (and a terminating zero byte) without filling it, the content is
+// written by the caller through the returned pointer
+static __INLINE char* list_append_space(string_list *B, int N) {
+	list_grow(B);
+	if (B->arena) {
+		list_arena_reserve(B, N + 1);
+		B->buffer[B->position] = &(B->arena[B->arena_position]);
+		B->arena_position += N + 1;
+	} else {
+		B->buffer[B->position] = (char*) malloc(sizeof(char) * (N + 1));
+	}
+	B->buffer[B->position][N] = '\0';
+	B->lengths[B->position] = N;
+	B->position++;
+	return B->buffer[B->position - 1];
+}
+
+// Resizes the last element of the list to N bytes (and a terminating zero byte), its content is kept
+// up to the new length
+static __INLINE char* list_resize_last(string_list *B, int N) {
+	int last = B->position - 1;
+	if (B->arena) {
+		list_arena_reserve(B, N - B->lengths[last]);
+		B->arena_position += N - B->lengths[last];
+	} else {
+		B->buffer[last] = (char*) realloc(B->buffer[last], sizeof(char) * (N + 1));
+	}
+	B->buffer[last][N] = '\0';
+	B->lengths[last] = N;
+	return B->buffer[last];
+}
+
+// This version of the append copies exactly N bytes and terminates them with a zero byte
+static __INLINE void list_append_n(string_list *B, const char* S, int N) {
+	char* D = list_append_space(B, N);
+	memcpy(D, S, N);
+}
+
+static __INLINE void list_append(string_list *B, const char* S) {
+	list_append_n(B, S, strlen(S));
 }
 
 // This version of the append does not copy the string but simply takes the control of its allocation
-static __INLINE void list_append_direct(string_list *B, char* S) {
-	int required = 1;
-	int length = strlen(S);
-	if (required > B->size - B->position) {
-		B->size = B->position + 16;
-		B->buffer = (char**) realloc(B->buffer, sizeof(char*) * B->size);
+static __INLINE void list_append_direct_n(string_list *B, char* S, int N) {
+	if (B->arena) {
+		list_append_n(B, S, N);
+		free(S);
+		return;
 	}
+	list_grow(B);
 	B->buffer[B->position] = S;
-	B->position += required;
+	B->lengths[B->position] = N;
+	B->position++;
+}
+
+static __INLINE void list_append_direct(string_list *B, char* S) {
+	list_append_direct_n(B, S, strlen(S));
 }
 
 
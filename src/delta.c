@@ -0,0 +1,197 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4; tab-width: 4 -*- */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "delta.h"
+
+#ifndef MIN
+#define MIN(a,b) (((a) < (b)) ? (a) : (b))
+#endif
+
+#define TILE_BIT(B, I) (((B)[(I) >> 3] >> ((I) & 7)) & 1)
+
+delta_context* delta_context_create() {
+
+    delta_context* context = (delta_context*) malloc(sizeof(delta_context));
+
+    memset(context, 0, sizeof(delta_context));
+
+    return context;
+
+}
+
+void delta_context_destroy(delta_context** context) {
+
+    int i;
+
+    if (!*context) return;
+
+    for (i = 0; i < TRAX_CHANNELS; i++) {
+        if ((*context)->frames[i].data) free((*context)->frames[i].data);
+    }
+
+    free(*context);
+    *context = NULL;
+
+}
+
+static int frame_matches(const delta_frame* frame, int width, int height, int format) {
+
+    return frame->data && frame->width == width && frame->height == height && frame->format == format;
+
+}
+
+// Replaces the last frame of a channel, the buffer is kept if the geometry is the same
+static void frame_reset(delta_frame* frame, int width, int height, int format, int rows, int row, int pixel) {
+
+    if (!frame_matches(frame, width, height, format)) {
+        if (frame->data) free(frame->data);
+        frame->data = (char*) malloc(sizeof(char) * rows * row);
+    }
+
+    frame->width = width;
+    frame->height = height;
+    frame->format = format;
+    frame->rows = rows;
+    frame->row = row;
+    frame->pixel = pixel;
+
+}
+
+char* delta_encode(delta_context* context, int channel, const char* data, int stride, int width, int height, int format,
+                   int rows, int row, int pixel, int reserved, int* length) {
+
+    int i, j, tx, ty, tiles_x, tiles_y, bitmap, changed = 0;
+    int span = DELTA_TILE * pixel;
+    delta_frame* frame;
+    unsigned char* marks;
+    char *result, *position;
+
+    assert(channel >= 0 && channel < TRAX_CHANNELS);
+
+    frame = &(context->frames[channel]);
+
+    if (!frame_matches(frame, width, height, format)) {
+        frame_reset(frame, width, height, format, rows, row, pixel);
+        for (j = 0; j < rows; j++)
+            memcpy(frame->data + j * row, data + (size_t) j * stride, row);
+        return NULL;
+    }
+
+    tiles_x = (row + span - 1) / span;
+    tiles_y = (rows + DELTA_TILE - 1) / DELTA_TILE;
+    bitmap = (tiles_x * tiles_y + 7) / 8;
+
+    marks = (unsigned char*) malloc(sizeof(unsigned char) * bitmap);
+    memset(marks, 0, bitmap);
+
+    // Tiles are compared row by row, the comparison of a tile stops at its first difference
+    for (ty = 0; ty < tiles_y; ty++) {
+        int top = ty * DELTA_TILE, bottom = MIN(rows, top + DELTA_TILE);
+        for (tx = 0; tx < tiles_x; tx++) {
+            int left = tx * span, extent = MIN(row, left + span) - left;
+            for (j = top; j < bottom; j++) {
+                if (memcmp(frame->data + j * row + left, data + (size_t) j * stride + left, extent) != 0) {
+                    marks[(ty * tiles_x + tx) >> 3] |= 1 << ((ty * tiles_x + tx) & 7);
+                    changed += extent * (bottom - top);
+                    break;
+                }
+            }
+        }
+    }
+
+    // Tiles are not worth the bookkeeping if most of the frame has changed
+    if (changed > rows * row / 2) {
+        free(marks);
+        for (j = 0; j < rows; j++)
+            memcpy(frame->data + j * row, data + (size_t) j * stride, row);
+        return NULL;
+    }
+
+    result = (char*) malloc(sizeof(char) * (reserved + bitmap + changed + 1));
+    memcpy(result + reserved, marks, bitmap);
+    position = result + reserved + bitmap;
+
+    for (i = 0; i < tiles_x * tiles_y; i++) {
+        int top, bottom, left, extent;
+        if (!TILE_BIT(marks, i)) continue;
+        top = (i / tiles_x) * DELTA_TILE;
+        bottom = MIN(rows, top + DELTA_TILE);
+        left = (i % tiles_x) * span;
+        extent = MIN(row, left + span) - left;
+        for (j = top; j < bottom; j++, position += extent) {
+            memcpy(position, data + (size_t) j * stride + left, extent);
+            memcpy(frame->data + j * row + left, position, extent);
+        }
+    }
+
+    free(marks);
+
+    *length = bitmap + changed;
+
+    return result;
+
+}
+
+const char* delta_apply(delta_context* context, int channel, int width, int height, int format,
+                        int rows, int row, int pixel, int tile, const char* data, int length) {
+
+    int i, j, tiles_x, tiles_y, bitmap, span;
+    long long size;
+    delta_frame* frame;
+    const unsigned char* marks = (const unsigned char*) data;
+    const char* position;
+
+    assert(channel >= 0 && channel < TRAX_CHANNELS);
+
+    frame = &(context->frames[channel]);
+
+    if (tile == 0) {
+        if (length != rows * row) return NULL;
+        frame_reset(frame, width, height, format, rows, row, pixel);
+        memcpy(frame->data, data, length);
+        return frame->data;
+    }
+
+    if (tile < 1 || tile > DELTA_TILE_MAX || !frame_matches(frame, width, height, format)) return NULL;
+
+    span = tile * pixel;
+    tiles_x = (row + span - 1) / span;
+    tiles_y = (rows + tile - 1) / tile;
+    bitmap = (tiles_x * tiles_y + 7) / 8;
+
+    if (length < bitmap) return NULL;
+
+    // The payload is checked as a whole first, an invalid payload must not change the last frame
+    // since the client would not know about it and all further tiles would be applied to a wrong frame
+    size = bitmap;
+
+    for (i = 0; i < tiles_x * tiles_y; i++) {
+        int top, left;
+        if (!TILE_BIT(marks, i)) continue;
+        top = (i / tiles_x) * tile;
+        left = (i % tiles_x) * span;
+        size += (long long) (MIN(row, left + span) - left) * (MIN(rows, top + tile) - top);
+        if (size > length) return NULL;
+    }
+
+    if (size != length) return NULL;
+
+    position = data + bitmap;
+
+    for (i = 0; i < tiles_x * tiles_y; i++) {
+        int top, bottom, left, extent;
+        if (!TILE_BIT(marks, i)) continue;
+        top = (i / tiles_x) * tile;
+        bottom = MIN(rows, top + tile);
+        left = (i % tiles_x) * span;
+        extent = MIN(row, left + span) - left;
+        for (j = top; j < bottom; j++, position += extent)
+            memcpy(frame->data + j * row + left, position, extent);
+    }
+
+    return frame->data;
+
+}
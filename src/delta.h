@@ -0,0 +1,52 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4; tab-width: 4 -*- */
+
+#ifndef _DELTA_H_
+#define _DELTA_H_
+
+#include "trax.h"
+
+// Edge of a square tile in pixels and the largest edge that is accepted from the other side
+#define DELTA_TILE 32
+#define DELTA_TILE_MAX 4096
+
+/**
+ * Last frame of a channel that both sides keep. The data is a matrix of packed rows, a pixel
+ * takes a fixed number of bytes in a row so tiles can be addressed without knowing the format.
+**/
+typedef struct delta_frame {
+    char* data;
+    int width;
+    int height;
+    int format;
+    int rows;
+    int row;
+    int pixel;
+} delta_frame;
+
+typedef struct delta_context {
+    delta_frame frames[TRAX_CHANNELS];
+} delta_context;
+
+delta_context* delta_context_create();
+
+void delta_context_destroy(delta_context** context);
+
+/**
+ * Compares a frame with the last frame of a channel and returns the changed tiles, preceded by
+ * the given number of reserved bytes. The payload starts with a bit for every tile in row-major
+ * order, followed by the rows of the changed tiles. Returns NULL if the geometry has changed or
+ * if a whole frame is smaller, the frame then has to be sent whole. Either way the frame becomes
+ * the last frame of the channel.
+**/
+char* delta_encode(delta_context* context, int channel, const char* data, int stride, int width, int height, int format,
+                   int rows, int row, int pixel, int reserved, int* length);
+
+/**
+ * Applies changed tiles to the last frame of a channel and returns the reconstructed frame, a tile
+ * size of zero denotes a whole frame. Returns NULL if the payload does not match the last frame, the
+ * last frame is then left unchanged.
+**/
+const char* delta_apply(delta_context* context, int channel, int width, int height, int format,
+                        int rows, int row, int pixel, int tile, const char* data, int length);
+
+#endif
@@ -1,6 +1,7 @@
 /* -*- Mode: C++; indent-tabs-mode: nil; c-basic-offset: 4; tab-width: 4 -*- */
 #include "message.h"
 #include "debug.h"
+#include "base64.h"
 
 #define PARSE_STATE_TYPE 0
 #define PARSE_STATE_SPACE_EXPECT 1
@@ -13,7 +14,9 @@
 #define PARSE_STATE_QUOTED_VALUE 8
 #define PARSE_STATE_QUOTED_ESCAPE_KEY 9
 #define PARSE_STATE_QUOTED_ESCAPE_VALUE 10
+#define PARSE_STATE_QUOTED_PAYLOAD 11
 #define PARSE_STATE_PASS 100
+#define PARSE_STATE_BINARY 101
 
 #ifndef TRUE
 #define TRUE 1
@@ -24,6 +27,7 @@
 #endif
 
 #include <ctype.h>
+#include <limits.h>
 
 #if defined(__OS2__) || defined(__WINDOWS__) || defined(WIN32) || defined(WIN64) || defined(_MSC_VER) 
 #include <winsock2.h>
@@ -36,6 +40,8 @@
 
 #define strcmpi _strcmpi
 
+#define SOCKET_UNIX_DISABLED
+
 static int initialized = 0;
 static void initialize_sockets(void) {
     WSADATA data;
@@ -50,12 +56,22 @@ static void initialize_sockets(void) {
 #else
 
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <errno.h>
 #include <unistd.h>
 #include <sys/select.h>
+#include <poll.h>
 #include <arpa/inet.h>
 #include <netinet/tcp.h>
+#include <fcntl.h>
 #define closesocket close
 
+// Pipe capacity can be changed on Linux, the constants are hidden behind _GNU_SOURCE
+#if defined(__linux__) && !defined(F_SETPIPE_SZ)
+#define F_SETPIPE_SZ 1031
+#define F_GETPIPE_SZ 1032
+#endif
+
 #define strcmpi strcasecmp
 
 static void initialize_sockets(void) {}
@@ -68,6 +84,84 @@ static void initialize_sockets(void) {}
 
 const int prefix_length = sizeof(TRAX_PREFIX) - 1;
 
+#define SCAN_QUOTE 1
+#define SCAN_ESCAPE 2
+#define SCAN_EQUALS 4
+#define SCAN_SPACE 8
+#define SCAN_NEWLINE 16
+#define SCAN_SEMICOLON 32
+
+// Headers of image arguments with encoded content are short, longer tokens are not inspected
+#define PAYLOAD_HEADER_MAX 64
+#define PAYLOAD_INITIAL_SIZE 65536
+
+// Delimiter classes of characters that can end a run of plain token data
+static const unsigned char scan_classes[256] = {
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0,16, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     8, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,32, 0, 4, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+// Returns the length of the leading run of characters that the state machine
+// would simply append to the current token (or skip, when passing a line).
+static __INLINE int scan_run(message_stream* stream, string_buffer** target) {
+
+    const unsigned char* start = (const unsigned char*) &(stream->buffer[stream->buffer_position]);
+    const unsigned char* end = (const unsigned char*) &(stream->buffer[stream->buffer_length]);
+    const unsigned char* current = start;
+    int mask;
+
+    switch (stream->input.state) {
+        case PARSE_STATE_QUOTED_KEY:
+            mask = SCAN_QUOTE | SCAN_ESCAPE | SCAN_EQUALS;
+            // The separators of a possible image header are handled by the state machine
+            if (buffer_size(stream->input.key_buffer) < PAYLOAD_HEADER_MAX) mask |= SCAN_SEMICOLON;
+            *target = stream->input.key_buffer;
+            break;
+        case PARSE_STATE_QUOTED_PAYLOAD:
+            mask = SCAN_QUOTE | SCAN_ESCAPE | SCAN_EQUALS;
+            *target = NULL;
+            break;
+        case PARSE_STATE_QUOTED_VALUE:
+            mask = SCAN_QUOTE | SCAN_ESCAPE;
+            *target = stream->input.value_buffer;
+            break;
+        case PARSE_STATE_UNQUOTED_KEY:
+            mask = SCAN_ESCAPE | SCAN_EQUALS | SCAN_SPACE | SCAN_NEWLINE;
+            *target = stream->input.key_buffer;
+            break;
+        case PARSE_STATE_UNQUOTED_VALUE:
+            mask = SCAN_ESCAPE | SCAN_SPACE | SCAN_NEWLINE;
+            *target = stream->input.value_buffer;
+            break;
+        case PARSE_STATE_PASS: {
+            const void* newline = memchr(start, '\n', end - start);
+            *target = NULL;
+            return (int) (newline ? (const unsigned char*) newline - start : end - start);
+        }
+        default:
+            return 0;
+    }
+
+    while (current < end && !(scan_classes[*current] & mask)) current++;
+
+    return (int) (current - start);
+
+}
+
 int __is_valid_key(char* c, int len) {
     int i;
 
@@ -92,223 +186,1143 @@ int __parse_message_type(const char *str) {
     return -1;
 }
 
+static void payload_release(payload_cache* payload, char* data, int size, int pooled) {
+
+    if (pooled)
+        image_pool_recycle(payload->pool, data, size);
+    else
+        free(data);
+
+}
+
+// Releases the payloads of the last message that were not taken and the one that is being decoded
+static void payload_clear(payload_cache* payload) {
+
+    int i;
+
+    for (i = 0; i < payload->count; i++) {
+        if (payload->blocks[i]) payload_release(payload, payload->blocks[i], payload->lengths[i], payload->origins[i]);
+    }
+
+    if (payload->data) payload_release(payload, payload->data, payload->size, payload->pooled);
+
+    payload->data = NULL;
+    payload->count = 0;
+
+}
+
 void initialize_cache(message_stream* stream) {
 
     stream->input.message_type = -1;
     stream->input.complete = FALSE;
     stream->input.state = -prefix_length;
+    stream->input.started = FALSE;
+    stream->input.binary = FALSE;
+    stream->input.log_position = 0;
+    stream->input.log_token = 0;
+
+    stream->buffer_size = TRAX_BUFFER_SIZE;
+    stream->buffer = (char*) malloc(sizeof(char) * stream->buffer_size);
+
+    stream->input.key_buffer = buffer_create(BUFFER_INCREMENT_STEP);
+    stream->input.value_buffer = buffer_create(BUFFER_INCREMENT_STEP);
+
+    stream->input.arguments = list_create_arena(8, BUFFER_INCREMENT_STEP);
+    stream->input.properties = list_create_arena(16, BUFFER_INCREMENT_STEP);
+
+    stream->output.buffer = buffer_create(BUFFER_INCREMENT_STEP);
+
+    stream->input.descriptors_count = 0;
+    stream->output.descriptors_count = 0;
+
+    memset(&(stream->input.payload), 0, sizeof(payload_cache));
+
+}
+
+void destroy_cache(message_stream* stream) {
+
+    int i;
+
+    free(stream->buffer);
+    stream->buffer = NULL;
+
+    buffer_destroy(&(stream->input.key_buffer));
+    buffer_destroy(&(stream->input.value_buffer));
+    list_destroy(&(stream->input.arguments));
+    list_destroy(&(stream->input.properties));
+    buffer_destroy(&(stream->output.buffer));
+
+    payload_clear(&(stream->input.payload));
+    free(stream->input.payload.blocks);
+    free(stream->input.payload.lengths);
+    free(stream->input.payload.indices);
+    free(stream->input.payload.origins);
+
+    // Descriptors that were received but never claimed are owned by the stream
+    for (i = 0; i < stream->input.descriptors_count; i++)
+        close(stream->input.descriptors[i]);
+
+    stream->input.descriptors_count = 0;
+
+}
+
+
+message_stream* create_message_stream_file(int input, int output) {
+    message_stream* stream = (message_stream*) malloc(sizeof(message_stream));
+
+    stream->flags = TRAX_STREAM_FILES;
+    stream->files.input = input;
+    stream->files.output = output;
+    stream->buffer_position = 0;
+    stream->buffer_length = 0;
+
+    initialize_cache(stream);
+
+    return stream;
+}
+
+// Polls a connection with exponential backoff so that a tracker started before the client does not stall for a second
+#define CONNECT_BACKOFF_MIN 5
+#define CONNECT_BACKOFF_MAX 500
+
+static void connect_backoff(int* delay) {
+#if defined(__OS2__) || defined(__WINDOWS__) || defined(WIN32) || defined(WIN64) || defined(_MSC_VER) 
+    Sleep(*delay);
+#else
+    usleep((*delay) * 1000);
+#endif
+    *delay = (*delay * 2 > CONNECT_BACKOFF_MAX) ? CONNECT_BACKOFF_MAX : *delay * 2;
+}
+
+message_stream* create_message_stream_socket(int socket) {
+
+    message_stream* stream = (message_stream*) malloc(sizeof(message_stream));
+
+    stream->flags = TRAX_STREAM_SOCKET;
+    stream->socket.server = -1;
+    stream->socket.socket = socket;
+
+#ifndef SOCKET_UNIX_DISABLED
+    {
+        // File descriptors can only be passed over Unix domain sockets
+        struct sockaddr_storage local;
+        socklen_t locallen = sizeof(struct sockaddr_storage);
+        if (getsockname(socket, (struct sockaddr *)&local, &locallen) == 0 && local.ss_family == AF_UNIX)
+            stream->flags |= TRAX_STREAM_DESCRIPTORS;
+    }
+#endif
+
+    stream->buffer_position = 0;
+    stream->buffer_length = 0;
+
+    initialize_cache(stream);
+
+    return stream;
+
+}
+
+message_stream* create_message_stream_socket_connect(int port) {
+
+	int sid;
+    int one = 1;
+    int delay = CONNECT_BACKOFF_MIN;
+	struct sockaddr_in pin;
+
+    initialize_sockets();
+
+	memset(&pin, 0, sizeof(pin));
+	pin.sin_family = AF_INET;
+	pin.sin_port = htons(port);
+	pin.sin_addr.s_addr = inet_addr(TRAX_LOCALHOST);
+
+    if((sid = (int)socket(AF_INET, SOCK_STREAM, 0)) == -1) {
+	    return NULL;
+    }
+	
+	if (setsockopt(sid, IPPROTO_TCP , TCP_NODELAY,
+						 (const char *)&one, sizeof(int)) == -1) {
+        perror("nodelay");
+        closesocket(sid);
+    }
+
+	while (connect(sid, (const struct sockaddr *)&pin, sizeof(pin))) {
+        connect_backoff(&delay); // Wait a bit for connection ...
+    }
+
+    return create_message_stream_socket(sid);
+
+}
+
+message_stream* create_message_stream_socket_connect_unix(const char* path) {
+
+#ifdef SOCKET_UNIX_DISABLED
+    return NULL;
+#else
+	int sid;
+    int delay = CONNECT_BACKOFF_MIN;
+	struct sockaddr_un pin;
+
+    if (strlen(path) >= sizeof(pin.sun_path)) return NULL;
+
+	memset(&pin, 0, sizeof(pin));
+	pin.sun_family = AF_UNIX;
+    strcpy(pin.sun_path, path);
+
+    if((sid = (int)socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+	    return NULL;
+    }
+
+	while (connect(sid, (const struct sockaddr *)&pin, sizeof(pin))) {
+        // Only wait if the client has not created the socket yet or is not listening
+        if (errno != ENOENT && errno != ECONNREFUSED) {
+            perror("connect");
+            closesocket(sid);
+            return NULL;
+        }
+        connect_backoff(&delay);
+    }
+
+    return create_message_stream_socket(sid);
+#endif
+
+}
+
+message_stream* create_message_stream_socket_accept(int server, int timeout) {
+
+	fd_set readfds,writefds,exceptfds;
+	int asock=-1;
+    int one = 1;
+    message_stream* stream = NULL;
+    struct timeval tv;
+    tv.tv_sec = timeout;
+    tv.tv_usec = 0;
+
+	initialize_sockets();
+
+    {
+        // A socket that is already connected, e.g. one end of a socket pair, is used directly
+        struct sockaddr_storage peer;
+#if defined(__OS2__) || defined(__WINDOWS__) || defined(WIN32) || defined(WIN64) || defined(_MSC_VER) 
+        int peerlen = sizeof(struct sockaddr_storage);
+#else
+        socklen_t peerlen = sizeof(struct sockaddr_storage);
+#endif
+        if (getpeername(server, (struct sockaddr *)&peer, &peerlen) == 0)
+            return create_message_stream_socket(server);
+    }
+ 
+	if(listen(server, 1)== -1) {
+		perror("listen");
+		return NULL;
+	}
+
+	FD_ZERO(&readfds);
+	FD_ZERO(&writefds);
+	FD_ZERO(&exceptfds);
+	FD_SET(server,&readfds);
+	FD_SET(server,&exceptfds);
+
+    select(server+1,&readfds,&writefds,&exceptfds,&tv);
+	
+	if(FD_ISSET(server,&readfds)) {
+		struct sockaddr_storage pin;
+		int addrlen = sizeof(struct sockaddr_storage);
+#if defined(__OS2__) || defined(__WINDOWS__) || defined(WIN32) || defined(WIN64) || defined(_MSC_VER) 
+		asock = (int) accept(server,(struct sockaddr *)&pin,
+											 (int *)&addrlen);
+#else
+		asock = (int) accept(server,(struct sockaddr *)&pin,
+												 (socklen_t *)&addrlen);
+#endif
+		// Delay is only an issue for TCP, local sockets do not support the option
+		if (asock != -1 && pin.ss_family == AF_INET) {
+			if (setsockopt(asock, IPPROTO_TCP , TCP_NODELAY,
+								 (const char *)&one, sizeof(int)) == -1) {
+				perror("nodelay");
+				return NULL;
+			}
+		}
+	} else {
+        return NULL;
+    }
+
+    if (asock == -1) {
+        perror("accept");
+        return NULL;
+    }
+
+    stream = create_message_stream_socket(asock);
+
+    stream->flags |= TRAX_STREAM_SOCKET_LISTEN;
+    stream->socket.server = server;
+
+    return stream;
+}
+
+void destroy_message_stream(message_stream** stream) {
+
+    VALIDATE_MESSAGE_STREAM((*stream));
+
+    if ((*stream)->flags & TRAX_STREAM_SOCKET) {
+
+#if defined(__OS2__) || defined(__WINDOWS__) || defined(WIN32) || defined(WIN64) || defined(_MSC_VER) 
+	    shutdown((*stream)->socket.socket, SD_BOTH);
+#else
+	    shutdown((*stream)->socket.socket, SHUT_RDWR);
+#endif
+        closesocket((*stream)->socket.socket);
+
+    }
+    (*stream)->flags = 0;
+    
+    destroy_cache(*stream);
+
+    free(*stream);
+    *stream = 0;
+
+}
+
+#ifdef SOCKET_UNIX_DISABLED
+
+static int receive_descriptors(message_stream* stream, char* target, int length) {
+    return -1;
+}
+
+static int send_descriptors(message_stream* stream, const char* buf, int len) {
+    return -1;
+}
+
+#else
+
+// Reads data from a Unix domain socket, queueing any file descriptors that were passed along
+static int receive_descriptors(message_stream* stream, char* target, int size) {
+
+    int length, count, i;
+    struct msghdr message;
+    struct iovec vector;
+    struct cmsghdr* header;
+    union {
+        char buffer[CMSG_SPACE(sizeof(int) * TRAX_DESCRIPTORS_MAX)];
+        struct cmsghdr align;
+    } control;
+
+    memset(&message, 0, sizeof(message));
+    vector.iov_base = target;
+    vector.iov_len = size;
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+
+#ifdef MSG_CMSG_CLOEXEC
+    length = recvmsg(stream->socket.socket, &message, MSG_CMSG_CLOEXEC);
+#else
+    length = recvmsg(stream->socket.socket, &message, 0);
+#endif
+
+    if (length < 0) return length;
+
+    for (header = CMSG_FIRSTHDR(&message); header; header = CMSG_NXTHDR(&message, header)) {
+
+        if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS) continue;
+
+        count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+
+        for (i = 0; i < count; i++) {
+            int descriptor;
+            memcpy(&descriptor, CMSG_DATA(header) + i * sizeof(int), sizeof(int));
+            if (stream->input.descriptors_count < TRAX_DESCRIPTORS_MAX)
+                stream->input.descriptors[stream->input.descriptors_count++] = descriptor;
+            else
+                close(descriptor);
+        }
+
+    }
+
+    return length;
+
+}
+
+// Sends the first part of a message together with all attached file descriptors, returns the number of written bytes
+static int send_descriptors(message_stream* stream, const char* buf, int len) {
+
+    struct msghdr message;
+    struct iovec vector;
+    struct cmsghdr* header;
+    int size = sizeof(int) * stream->output.descriptors_count;
+    union {
+        char buffer[CMSG_SPACE(sizeof(int) * TRAX_DESCRIPTORS_MAX)];
+        struct cmsghdr align;
+    } control;
+
+    memset(&message, 0, sizeof(message));
+    memset(&control, 0, sizeof(control));
+    vector.iov_base = (void*) buf;
+    vector.iov_len = len;
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = CMSG_SPACE(size);
+
+    header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(size);
+    memcpy(CMSG_DATA(header), stream->output.descriptors, size);
+
+#ifdef MSG_NOSIGNAL
+    return sendmsg(stream->socket.socket, &message, MSG_NOSIGNAL);
+#else
+    return sendmsg(stream->socket.socket, &message, 0);
+#endif
+
+}
+
+#endif
+
+int message_attach_descriptor(message_stream* stream, int descriptor) {
+
+    if (!(stream->flags & TRAX_STREAM_DESCRIPTORS)) return FALSE;
+
+    if (stream->output.descriptors_count >= TRAX_DESCRIPTORS_MAX) return FALSE;
+
+    stream->output.descriptors[stream->output.descriptors_count++] = descriptor;
+
+    return TRUE;
+
+}
+
+int message_take_descriptor(message_stream* stream) {
+
+    int descriptor;
+
+    if (stream->input.descriptors_count < 1) return -1;
+
+    descriptor = stream->input.descriptors[0];
+    stream->input.descriptors_count--;
+    memmove(stream->input.descriptors, stream->input.descriptors + 1, sizeof(int) * stream->input.descriptors_count);
+
+    return descriptor;
+
+}
+
+// Checks if there is data (or an end of stream) waiting on the input descriptor
+static int stream_ready(message_stream* stream) {
+
+#if defined(__OS2__) || defined(__WINDOWS__) || defined(WIN32) || defined(WIN64) || defined(_MSC_VER) 
+    if (stream->flags & TRAX_STREAM_SOCKET) {
+        fd_set readfds;
+        struct timeval tv = {0, 0};
+        FD_ZERO(&readfds);
+        FD_SET(stream->socket.socket, &readfds);
+        return select(stream->socket.socket + 1, &readfds, NULL, NULL, &tv) != 0;
+    } else {
+        DWORD available = 0;
+        // Errors are reported by the subsequent read
+        if (!PeekNamedPipe((HANDLE) _get_osfhandle(stream->files.input), NULL, 0, NULL, &available, NULL)) return 1;
+        return available > 0;
+    }
+#else
+    struct pollfd descriptor;
+    descriptor.fd = message_stream_descriptor(stream);
+    descriptor.events = POLLIN;
+    descriptor.revents = 0;
+    return poll(&descriptor, 1, 0) != 0;
+#endif
+
+}
+
+int message_stream_descriptor(message_stream* stream) {
+
+    VALIDATE_MESSAGE_STREAM(stream);
+
+    return (stream->flags & TRAX_STREAM_SOCKET) ? stream->socket.socket : stream->files.input;
+
+}
+
+// Resizes the kernel buffers of the socket or pipe, returns TRUE on success
+int message_stream_set_capacity(message_stream* stream, int size) {
+
+    VALIDATE_MESSAGE_STREAM(stream);
+
+    if (size < 1) return FALSE;
+
+    if (stream->flags & TRAX_STREAM_SOCKET) {
+
+        int received = setsockopt(stream->socket.socket, SOL_SOCKET, SO_RCVBUF, (const char*) &size, sizeof(int));
+        int sent = setsockopt(stream->socket.socket, SOL_SOCKET, SO_SNDBUF, (const char*) &size, sizeof(int));
+
+        return received == 0 && sent == 0;
+
+    }
+
+#ifdef F_SETPIPE_SZ
+    {
+        // A pipe has a single buffer, resizing it from either end is enough. Regular files fail.
+        int input = fcntl(stream->files.input, F_SETPIPE_SZ, size);
+        int output = fcntl(stream->files.output, F_SETPIPE_SZ, size);
+
+        return input >= 0 || output >= 0;
+    }
+#else
+    return FALSE;
+#endif
+
+}
+
+int message_stream_get_capacity(message_stream* stream) {
+
+    VALIDATE_MESSAGE_STREAM(stream);
+
+    if (stream->flags & TRAX_STREAM_SOCKET) {
+
+        int size = 0;
+        socklen_t length = sizeof(int);
+
+        if (getsockopt(stream->socket.socket, SOL_SOCKET, SO_RCVBUF, (char*) &size, &length) != 0)
+            return -1;
+
+        return size;
+
+    }
+
+#ifdef F_GETPIPE_SZ
+    return fcntl(stream->files.input, F_GETPIPE_SZ);
+#else
+    return -1;
+#endif
+
+}
+
+// Reads at most the given number of bytes from the connection
+static __INLINE int stream_receive(message_stream* stream, char* target, int length) {
+
+    if (stream->flags & TRAX_STREAM_DESCRIPTORS) {
+
+        return receive_descriptors(stream, target, length);
+
+    } else if (stream->flags & TRAX_STREAM_SOCKET) {
+
+        return recv(stream->socket.socket, target, length, 0);
+
+    } else {
+
+        return read(stream->files.input, target, length);
+
+    }
+
+}
+
+static void log_elided(trax_logging* log, int length) {
+
+    char marker[32];
+
+    sprintf(marker, "...(%d bytes)", length);
+    log->callback(marker, strlen(marker), log->data);
+
+}
+
+// Passes a span of protocol data to the logger. When payloads are truncated, only the beginning of
+// long tokens is logged and the rest is replaced by a marker. The length of the current token is kept
+// in the counter, so a token can be split between several spans.
+static void log_span(trax_logging* log, const char* data, int length, int* token) {
+
+    int i, start = 0;
+
+    if (!log || !log->callback || length < 1) return;
+
+    if (!(log->flags & TRAX_LOG_TRUNCATE)) {
+        log->callback(data, length, log->data);
+        return;
+    }
+
+    for (i = 0; i < length; i++) {
+
+        char chr = data[i];
+
+        if (chr == ' ' || chr == '"' || chr == '=' || chr == '\n') {
+            if (*token > TRAX_LOG_PAYLOAD) {
+                log_elided(log, *token - TRAX_LOG_PAYLOAD);
+                start = i;
+            }
+            *token = 0;
+            continue;
+        }
+
+        (*token)++;
+
+        if (*token == TRAX_LOG_PAYLOAD + 1 && i > start)
+            log->callback(data + start, i - start, log->data);
+
+    }
+
+    if (*token <= TRAX_LOG_PAYLOAD && length > start)
+        log->callback(data + start, length - start, log->data);
+
+}
+
+// Logs a field of a binary frame (and its key) as a quoted token if it is text, otherwise only its length is logged
+static void log_binary_field(trax_logging* log, const char* key, const char* data, int length) {
+
+    int i, shown = length;
+    char marker[32];
+
+    for (i = 0; i < length; i++) {
+        if (!isprint((unsigned char) data[i])) {
+            if (key) {
+                log->callback(key, strlen(key), log->data);
+                log->callback("=", 1, log->data);
+            }
+            sprintf(marker, "[%d bytes] ", length);
+            log->callback(marker, strlen(marker), log->data);
+            return;
+        }
+    }
+
+    if ((log->flags & TRAX_LOG_TRUNCATE) && length > TRAX_LOG_PAYLOAD) shown = TRAX_LOG_PAYLOAD;
+
+    log->callback("\"", 1, log->data);
+    if (key) {
+        log->callback(key, strlen(key), log->data);
+        log->callback("=", 1, log->data);
+    }
+    log->callback(data, shown, log->data);
+    if (shown < length) log_elided(log, length - shown);
+    log->callback("\" ", 2, log->data);
+
+}
+
+// Logs a binary frame in the same form as a text message, the prefix is logged by the caller
+static void log_binary_message(trax_logging* log, int type, const string_list* arguments, const string_list* properties) {
+
+    int i;
+    const char* names[] = {"hello", "initialize", "frame", "quit", "state"};
+
+    if (!log || !log->callback) return;
+
+    if (type >= TRAX_HELLO && type <= TRAX_STATE) {
+        log->callback(names[type - TRAX_HELLO], strlen(names[type - TRAX_HELLO]), log->data);
+        log->callback(" ", 1, log->data);
+    }
+
+    for (i = 0; arguments && i < list_size(arguments); i++)
+        log_binary_field(log, NULL, arguments->buffer[i], list_length(arguments, i));
+
+    for (i = 0; properties && i + 1 < list_size(properties); i += 2)
+        log_binary_field(log, properties->buffer[i], properties->buffer[i + 1], list_length(properties, i + 1));
+
+    log->callback("\n", 1, log->data);
+
+}
+
+// Logs the part of the receive window that was consumed since the last call, so that the
+// logger receives contiguous spans instead of individual characters
+static __INLINE void log_consumed(message_stream* stream, trax_logging* log) {
+
+    // Binary frames are logged in a readable form once they are complete
+    if (stream->buffer_position > stream->input.log_position && stream->input.state != PARSE_STATE_BINARY)
+        log_span(log, &(stream->buffer[stream->input.log_position]),
+            stream->buffer_position - stream->input.log_position, &(stream->input.log_token));
+
+    stream->input.log_position = stream->buffer_position;
+
+}
+
+// Returns 1 if there is data in the receive window, 0 if no data is available in asynchronous mode and -1 on error
+static __INLINE int fill_buffer(message_stream* stream, trax_logging* log) {
+
+    if (stream->buffer_position < stream->buffer_length) return 1;
+
+    log_consumed(stream, log);
+
+    if ((stream->flags & TRAX_STREAM_ASYNC) && !stream_ready(stream)) return 0;
+
+    // The last read filled the whole window so more data is probably on its way, a larger
+    // window saves system calls for big messages. The window is empty, nothing has to be kept.
+    if (stream->buffer_length == stream->buffer_size && stream->buffer_size < TRAX_BUFFER_MAX) {
+        free(stream->buffer);
+        stream->buffer_size *= 2;
+        stream->buffer = (char*) malloc(sizeof(char) * stream->buffer_size);
+    }
+
+    stream->buffer_length = stream_receive(stream, stream->buffer, stream->buffer_size);
+
+    if (stream->buffer_length < 0) {
+        return -1; // An error has occured
+    }
+
+    if (stream->buffer_length == 0) {
+        return -1; // The stream was closed
+    }
+
+    stream->buffer_position = 0;
+    stream->input.log_position = 0;
+
+    return 1;
+
+}
+
+#define READ_PENDING -2
+
+static __INLINE int read_character(message_stream* stream, trax_logging* log) {
+    char chr;
+    int status = fill_buffer(stream, log);
+
+    if (status < 0) return -1;
+    if (status == 0) return READ_PENDING;
+
+    chr = stream->buffer[stream->buffer_position];
+
+    stream->buffer_position++;
+
+    return chr;
+
+}
+
+#define BINARY_MAX_FIELDS 65536
+#define BINARY_MAX_LENGTH 0x40000000
+// Arguments are not allocated beyond the data that has arrived by more than this
+#define BINARY_CHUNK 0x10000
+
+#define BINARY_STAGE_HEADER 0
+#define BINARY_STAGE_ARGUMENT_LENGTH 1
+#define BINARY_STAGE_ARGUMENT 2
+#define BINARY_STAGE_KEY_LENGTH 3
+#define BINARY_STAGE_KEY 4
+#define BINARY_STAGE_VALUE_LENGTH 5
+#define BINARY_STAGE_VALUE 6
+#define BINARY_STAGE_TERMINATOR 7
+
+void message_encode_length(char* destination, int length) {
+    destination[0] = (char) ((length >> 24) & 0xFF);
+    destination[1] = (char) ((length >> 16) & 0xFF);
+    destination[2] = (char) ((length >> 8) & 0xFF);
+    destination[3] = (char) (length & 0xFF);
+}
+
+static __INLINE int decode_length(const char* source) {
+    const unsigned char* bytes = (const unsigned char*) source;
+    return (int) (((unsigned int) bytes[0] << 24) | ((unsigned int) bytes[1] << 16) |
+        ((unsigned int) bytes[2] << 8) | (unsigned int) bytes[3]);
+}
+
+// Appends bytes from the stream to the buffer until it holds the given number of bytes,
+// returns 0 if the stream has no more data at the moment and the read has to be resumed later
+static int read_block(message_stream* stream, trax_logging* log, string_buffer* target, int length) {
+
+    while (buffer_size(target) < length) {
+        const char* start;
+        int available, status;
+
+        status = fill_buffer(stream, log);
+        if (status <= 0) return status;
+
+        start = &(stream->buffer[stream->buffer_position]);
+        available = stream->buffer_length - stream->buffer_position;
+        if (available > length - buffer_size(target)) available = length - buffer_size(target);
+
+        buffer_push_n(target, start, available);
+
+        stream->buffer_position += available;
+    }
+
+    return 1;
+
+}
+
+// Checks if the token that was just terminated by a separator is a complete header of an
+// image argument with encoded content, i.e. image:<width>;<height>;<format>; or data:<type>;
+// or delta:<width>;<height>;<format>;<tile>;
+static int payload_header(const string_buffer* token) {
+
+    int i, separators = 0, required;
+
+    if (buffer_size(token) > 6 && memcmp(token->buffer, "image:", 6) == 0)
+        required = 3;
+    else if (buffer_size(token) > 6 && memcmp(token->buffer, "delta:", 6) == 0)
+        required = 4;
+    else if (buffer_size(token) > 5 && memcmp(token->buffer, "data:", 5) == 0)
+        required = 1;
+    else return FALSE;
+
+    for (i = 0; i < buffer_size(token); i++) {
+        if (token->buffer[i] == ';') separators++;
+    }
+
+    return separators == required;
+
+}
+
+// Returns the size of the raw image described by a complete image header or -1 for other content
+static int payload_image_size(const string_buffer* token) {
+
+    char header[PAYLOAD_HEADER_MAX + 1], format[PAYLOAD_HEADER_MAX + 1];
+    int width, height, depth, rows;
+
+    if (buffer_size(token) > PAYLOAD_HEADER_MAX || memcmp(token->buffer, "image:", 6) != 0) return -1;
+
+    memcpy(header, token->buffer, buffer_size(token));
+    header[buffer_size(token)] = 0;
+
+    if (sscanf(header, "image:%d;%d;%[^;];", &width, &height, format) != 3) return -1;
+
+    depth = (strcmp(format, "rgb") == 0 || strcmp(format, "bgr") == 0) ? 3 :
+            ((strcmp(format, "rgba") == 0 || strcmp(format, "bgra") == 0) ? 4 :
+             ((strcmp(format, "gray8") == 0 || strcmp(format, "nv12") == 0) ? 1 :
+              (strcmp(format, "gray16") == 0 ? 2 : 0)));
+
+    // The chroma plane of NV12 has half the rows of the luma plane
+    rows = strcmp(format, "nv12") == 0 ? height + height / 2 : height;
+
+    if (width < 1 || height < 1 || depth < 1 || width > INT_MAX / rows / depth) return -1;
+
+    return width * rows * depth;
+
+}
+
+// The size of a raw image is known from its header, so its content can be decoded to a pooled buffer
+static void payload_begin(payload_cache* payload, const string_buffer* token) {
+
+    int size = payload->pool ? payload_image_size(token) : -1;
+
+    payload->pooled = size > 0;
+
+    if (payload->pooled) {
+        payload->size = size;
+        payload->data = image_pool_acquire(payload->pool, size);
+    } else {
+        payload->size = PAYLOAD_INITIAL_SIZE;
+        payload->data = (char*) malloc(sizeof(char) * payload->size);
+    }
+    payload->length = 0;
+    payload->valid = TRUE;
+    payload->group_length = 0;
+
+}
+
+static void payload_decode(payload_cache* payload, const char* data, int length) {
+
+    int decoded, expected = base64decodelen_n(data, length);
+
+    if (payload->length + expected > payload->size) {
+        // Pooled buffers have the size of the image, more content means that the argument is not valid
+        if (payload->pooled) {
+            payload->valid = FALSE;
+            return;
+        }
+        payload->size = payload->size * 2;
+        if (payload->size < payload->length + expected) payload->size = payload->length + expected;
+        payload->data = (char*) realloc(payload->data, sizeof(char) * payload->size);
+    }
+
+    decoded = base64decode_n((unsigned char*) payload->data + payload->length, data, length);
+
+    // Decoding stops at the first character outside of the alphabet
+    if (decoded != expected) payload->valid = FALSE;
+
+    payload->length += decoded;
+
+}
+
+// Decodes a run of received characters directly to the payload, only whole groups of four
+// characters can be decoded, the rest is kept until more data arrives
+static void payload_push(payload_cache* payload, const char* data, int length) {
+
+    int whole;
+
+    if (!payload->valid) return;
+
+    if (payload->group_length > 0) {
+        while (payload->group_length < 4 && length > 0) {
+            payload->group[payload->group_length++] = *(data++);
+            length--;
+        }
+        if (payload->group_length < 4) return;
+        payload_decode(payload, payload->group, 4);
+        payload->group_length = 0;
+    }
+
+    whole = length & ~3;
+
+    if (whole > 0) payload_decode(payload, data, whole);
+
+    memcpy(payload->group, data + whole, length - whole);
+    payload->group_length = length - whole;
+
+}
+
+// Completes the payload of the argument with the given index, an invalid payload is dropped
+static void payload_finish(payload_cache* payload, int index) {
+
+    if (payload->group_length == 1) payload->valid = FALSE;
+
+    if (payload->valid && payload->group_length > 0)
+        payload_decode(payload, payload->group, payload->group_length);
+
+    if (payload->pooled && payload->length != payload->size) payload->valid = FALSE;
+
+    if (!payload->valid) {
+        payload_release(payload, payload->data, payload->size, payload->pooled);
+        payload->data = NULL;
+        return;
+    }
 
-    stream->input.key_buffer = buffer_create(BUFFER_INCREMENT_STEP);
-    stream->input.value_buffer = buffer_create(BUFFER_INCREMENT_STEP);
+    if (payload->count == payload->capacity) {
+        payload->capacity += 4;
+        payload->blocks = (char**) realloc(payload->blocks, sizeof(char*) * payload->capacity);
+        payload->lengths = (int*) realloc(payload->lengths, sizeof(int) * payload->capacity);
+        payload->indices = (int*) realloc(payload->indices, sizeof(int) * payload->capacity);
+        payload->origins = (int*) realloc(payload->origins, sizeof(int) * payload->capacity);
+    }
 
-}
+    if (!payload->pooled && payload->length > 0 && payload->length < payload->size)
+        payload->data = (char*) realloc(payload->data, sizeof(char) * payload->length);
 
-void destroy_cache(message_stream* stream) {
+    payload->blocks[payload->count] = payload->data;
+    payload->lengths[payload->count] = payload->length;
+    payload->indices[payload->count] = index;
+    payload->origins[payload->count] = payload->pooled;
+    payload->count++;
 
-    buffer_destroy(&(stream->input.key_buffer));
-    buffer_destroy(&(stream->input.value_buffer));
+    payload->data = NULL;
 
 }
 
+// Tokens are copied from the parser buffers to the arenas of the message
 
-message_stream* create_message_stream_file(int input, int output) {
-    message_stream* stream = (message_stream*) malloc(sizeof(message_stream));
+static __INLINE void push_argument(message_stream* stream) {
+    list_append_n(stream->input.arguments, stream->input.key_buffer->buffer, buffer_size(stream->input.key_buffer));
+}
 
-    stream->flags = TRAX_STREAM_FILES;
-    stream->files.input = input;
-    stream->files.output = output;
-    stream->buffer_position = 0;
-    stream->buffer_length = 0;
+static __INLINE void push_property(message_stream* stream) {
+    list_append_n(stream->input.properties, stream->input.key_buffer->buffer, buffer_size(stream->input.key_buffer));
+    list_append_n(stream->input.properties, stream->input.value_buffer->buffer, buffer_size(stream->input.value_buffer));
+}
 
-    initialize_cache(stream);
+// Copies bytes from the stream directly to their destination, the number of bytes that were already
+// copied is kept in the offset so that the read can be resumed. The bytes are logged with the frame.
+static int read_direct(message_stream* stream, trax_logging* log, char* target, int length, int* offset) {
 
-    return stream;
-}
+    while (*offset < length) {
+        const char* start;
+        int available, status;
 
-message_stream* create_message_stream_socket_connect(int port) {
+        // Once the window is drained, large remainders are received without passing through it
+        if (stream->buffer_position >= stream->buffer_length && length - *offset >= stream->buffer_size) {
 
-    message_stream* stream = NULL;
+            log_consumed(stream, log);
 
-	int sid;
-    int one = 1;
-	struct sockaddr_in pin;
+            if ((stream->flags & TRAX_STREAM_ASYNC) && !stream_ready(stream)) return 0;
 
-    initialize_sockets();
+            available = stream_receive(stream, target + *offset, length - *offset);
+            if (available <= 0) return -1;
 
-	memset(&pin, 0, sizeof(pin));
-	pin.sin_family = AF_INET;
-	pin.sin_port = htons(port);
-	pin.sin_addr.s_addr = inet_addr(TRAX_LOCALHOST);
+            *offset += available;
+            continue;
+        }
 
-    if((sid = (int)socket(AF_INET, SOCK_STREAM, 0)) == -1) {
-	    return NULL;
-    }
-	
-	if (setsockopt(sid, IPPROTO_TCP , TCP_NODELAY,
-						 (const char *)&one, sizeof(int)) == -1) {
-        perror("nodelay");
-        closesocket(sid);
-    }
+        status = fill_buffer(stream, log);
+        if (status <= 0) return status;
 
-	while (1) {
+        start = &(stream->buffer[stream->buffer_position]);
+        available = stream->buffer_length - stream->buffer_position;
+        if (available > length - *offset) available = length - *offset;
 
-	    if (connect(sid, (const struct sockaddr *)&pin, sizeof(pin))) {
-            perror("connect"); // Wait a bit for connection ...
-#if defined(__OS2__) || defined(__WINDOWS__) || defined(WIN32) || defined(WIN64) || defined(_MSC_VER) 
-            Sleep(1000);
-#else
-            sleep(1);
-#endif
-		    continue;
-	    }
+        memcpy(target + *offset, start, available);
 
-        break;
+        *offset += available;
+        stream->buffer_position += available;
+        stream->input.log_position = stream->buffer_position;
     }
 
-    stream = (message_stream*) malloc(sizeof(message_stream));
+    return 1;
 
-    stream->flags = TRAX_STREAM_SOCKET;
-    stream->socket.server = -1;
-    stream->socket.socket = sid;
+}
 
-    stream->buffer_position = 0;
-    stream->buffer_length = 0;
+// Moves the binary reader to the next field of the frame
+static void binary_next_field(input_cache* input) {
 
-    initialize_cache(stream);
+    if (input->binary_state.index < input->binary_state.arguments) {
+        input->binary_state.stage = BINARY_STAGE_ARGUMENT_LENGTH;
+    } else if (input->binary_state.index < input->binary_state.arguments + input->binary_state.properties) {
+        input->binary_state.stage = BINARY_STAGE_KEY_LENGTH;
+    } else {
+        input->binary_state.stage = BINARY_STAGE_TERMINATOR;
+    }
 
-    return stream;
+    buffer_reset(input->key_buffer);
+    buffer_reset(input->value_buffer);
 
 }
 
-message_stream* create_message_stream_socket_accept(int server, int timeout) {
+// Reads the remainder of a binary framed message, the prefix has already been consumed.
+// The frame consists of a message type byte, the number of arguments and properties and
+// the length-prefixed raw content of each argument, key and value, terminated by a new line.
+// The reader keeps its position in the input cache, so it can be resumed if the data is not
+// available yet, in that case TRAX_PENDING is returned.
+static int read_binary_message(message_stream* stream, trax_logging* log) {
 
-	fd_set readfds,writefds,exceptfds;
-	int asock=-1;
-    int one = 1;
-    message_stream* stream = NULL;
-    struct timeval tv;
-    tv.tv_sec = timeout;
-    tv.tv_usec = 0;
+    binary_cache* state = &(stream->input.binary_state);
+    string_list* arguments = stream->input.arguments;
+    string_buffer* key = stream->input.key_buffer;
+    string_buffer* value = stream->input.value_buffer;
 
-	initialize_sockets();
- 
-	if(listen(server, 1)== -1) {
-		perror("listen");
-		return NULL;
-	}
+    while (1) {
 
-	FD_ZERO(&readfds);
-	FD_ZERO(&writefds);
-	FD_ZERO(&exceptfds);
-	FD_SET(server,&readfds);
-	FD_SET(server,&exceptfds);
+        int status;
 
-    select(server+1,&readfds,&writefds,&exceptfds,&tv);
-	
-	if(FD_ISSET(server,&readfds)) {
-		struct sockaddr_in pin;
-		int addrlen = sizeof(struct sockaddr_in);
-#if defined(__OS2__) || defined(__WINDOWS__) || defined(WIN32) || defined(WIN64) || defined(_MSC_VER) 
-		asock = (int) accept(server,(struct sockaddr *)&pin,
-											 (int *)&addrlen);
-#else
-		asock = (int) accept(server,(struct sockaddr *)&pin,
-												 (socklen_t *)&addrlen);
-#endif
-	} else {
-        return NULL;
-    }
+        switch (state->stage) {
+        case BINARY_STAGE_HEADER: {
 
-	if (setsockopt(asock, IPPROTO_TCP , TCP_NODELAY,
-						 (const char *)&one, sizeof(int)) == -1) {
-        perror("nodelay");
-        return NULL;
-    }
+            status = read_block(stream, log, key, 9);
+            if (status <= 0) break;
 
+            state->type = (unsigned char) key->buffer[0];
+            state->arguments = decode_length(key->buffer + 1);
+            state->properties = decode_length(key->buffer + 5);
+            state->index = 0;
 
-    stream = (message_stream*) malloc(sizeof(message_stream));
+            if (state->type < TRAX_HELLO || state->type > TRAX_STATE) return TRAX_ERROR;
+            if (state->arguments < 0 || state->arguments > BINARY_MAX_FIELDS) return TRAX_ERROR;
+            if (state->properties < 0 || state->properties > BINARY_MAX_FIELDS) return TRAX_ERROR;
 
-    stream->flags = TRAX_STREAM_SOCKET;
-    stream->flags |= TRAX_STREAM_SOCKET_LISTEN;
-    stream->socket.server = server;
-    stream->socket.socket = asock;
-    stream->buffer_position = 0;
-    stream->buffer_length = 0;
+            binary_next_field(&(stream->input));
+            continue;
+        }
+        case BINARY_STAGE_ARGUMENT_LENGTH:
+        case BINARY_STAGE_KEY_LENGTH:
+        case BINARY_STAGE_VALUE_LENGTH: {
 
-    initialize_cache(stream);
+            status = read_block(stream, log, value, 4);
+            if (status <= 0) break;
 
-    return stream;
-}
+            state->length = decode_length(value->buffer);
+            if (state->length < 0 || state->length > BINARY_MAX_LENGTH) return TRAX_ERROR;
 
-void destroy_message_stream(message_stream** stream) {
+            // Keys are short, a longer one is rejected before any of it is buffered
+            if (state->stage == BINARY_STAGE_KEY_LENGTH && state->length > MAX_KEY_LENGTH) return TRAX_ERROR;
 
-    VALIDATE_MESSAGE_STREAM((*stream));
+            // Arguments are read directly to their place in the arena, which grows with the received
+            // data so that a declared length does not allocate memory on its own
+            if (state->stage == BINARY_STAGE_ARGUMENT_LENGTH) {
+                list_append_space(arguments, state->length < BINARY_CHUNK ? state->length : BINARY_CHUNK);
+                state->offset = 0;
+            }
 
-    if ((*stream)->flags & TRAX_STREAM_SOCKET) {
+            buffer_reset(value);
+            state->stage++;
+            continue;
+        }
+        case BINARY_STAGE_ARGUMENT: {
 
-#if defined(__OS2__) || defined(__WINDOWS__) || defined(WIN32) || defined(WIN64) || defined(_MSC_VER) 
-	    shutdown((*stream)->socket.socket, SD_BOTH);
-#else
-	    shutdown((*stream)->socket.socket, SHUT_RDWR);
-#endif
-        closesocket((*stream)->socket.socket);
+            int last = list_size(arguments) - 1;
 
-    }
-    (*stream)->flags = 0;
-    
-    destroy_cache(*stream);
+            while (1) {
+                int size = list_length(arguments, last);
+                status = read_direct(stream, log, arguments->buffer[last], size, &(state->offset));
+                if (status <= 0 || state->offset == state->length) break;
+                list_resize_last(arguments, (state->length - size < size) ? state->length : size * 2);
+            }
 
-    free(*stream);
-    *stream = 0;
+            if (status <= 0) break;
 
-}
+            state->index++;
+            binary_next_field(&(stream->input));
+            continue;
+        }
+        case BINARY_STAGE_KEY: {
 
-static __INLINE int read_character(message_stream* stream) {
-    char chr;
+            status = read_block(stream, log, key, state->length);
+            if (status <= 0) break;
 
-    if (stream->buffer_position >= stream->buffer_length) {
+            if (!__is_valid_key(key->buffer, state->length)) return TRAX_ERROR;
 
-        if (stream->flags & TRAX_STREAM_SOCKET) {
+            state->stage = BINARY_STAGE_VALUE_LENGTH;
+            continue;
+        }
+        case BINARY_STAGE_VALUE: {
 
-		    stream->buffer_length = recv(stream->socket.socket, stream->buffer, TRAX_BUFFER_SIZE, 0);
+            status = read_block(stream, log, value, state->length);
+            if (status <= 0) break;
 
-        } else {
+            push_property(stream);
 
-        	stream->buffer_length = read(stream->files.input, stream->buffer, TRAX_BUFFER_SIZE);
-           
+            state->index++;
+            binary_next_field(&(stream->input));
+            continue;
         }
+        case BINARY_STAGE_TERMINATOR: {
 
-        if (stream->buffer_length < 0) {
-            return -1; // An error has occured  
-        } 
+            status = read_block(stream, log, key, 1);
+            if (status <= 0) break;
 
-		if (stream->buffer_length == 0) {
-            return -1; // The stream was closed
-        }
+            if (key->buffer[0] != '\n') return TRAX_ERROR;
 
-       // fprintf(stderr, "RCV: %*s \n", stream->buffer_length-1, stream->buffer);
-       // fflush(stderr);
-        stream->buffer_position = 0;
-    }
+            buffer_reset(key);
 
-    chr = stream->buffer[stream->buffer_position];
+            stream->input.log_position = stream->buffer_position;
+            log_binary_message(log, state->type, arguments, stream->input.properties);
 
-    stream->buffer_position++;
+            return state->type;
+        }
+        default:
+            return TRAX_ERROR;
+        }
 
-    return chr;
+        return status == 0 ? TRAX_PENDING : TRAX_ERROR;
+
+    }
 
 }
 
-int read_message(message_stream* stream, trax_logging* log, string_list* arguments, trax_properties* properties) {
+// Advances the parser, the state of a partially read message is kept in the input cache
+static int parse_message(message_stream* stream, trax_logging* log) {
 	
 	VALIDATE_MESSAGE_STREAM(stream);
 
-    list_reset(arguments);
+    if (!stream->input.started) {
+        list_reset(stream->input.arguments);
+        list_reset(stream->input.properties);
+        payload_clear(&(stream->input.payload));
+        stream->input.binary = FALSE;
+        stream->input.started = TRUE;
+    }
 
     while (!stream->input.complete) {
 
     	char chr; 
-    	int val = read_character(stream);
+    	int val;
+
+        if (stream->input.state == PARSE_STATE_BINARY) {
+            int type = read_binary_message(stream, log);
+            if (type == TRAX_PENDING) return TRAX_PENDING;
+            // The other side is obviously capable of binary framing so we can answer the same way.
+            stream->input.message_type = type;
+            stream->input.complete = TRUE;
+            if (type != TRAX_ERROR)
+                stream->flags |= TRAX_STREAM_BINARY;
+            break;
+        }
+
+        // Consume runs of plain token data directly from the receive window,
+        // only delimiters are handled one at a time by the state machine below.
+        if (stream->buffer_position < stream->buffer_length) {
+            string_buffer* target = NULL;
+            int run = scan_run(stream, &target);
+
+            if (run > 0) {
+                const char* start = &(stream->buffer[stream->buffer_position]);
+                if (target) buffer_push_n(target, start, run);
+                else if (stream->input.state == PARSE_STATE_QUOTED_PAYLOAD)
+                    payload_push(&(stream->input.payload), start, run);
+                stream->buffer_position += run;
+                if (stream->buffer_position >= stream->buffer_length) continue;
+            }
+        }
+
+        val = read_character(stream, log);
+
+        if (val == READ_PENDING) return TRAX_PENDING;
 
     	if (val < 0) {
     		if (stream->input.message_type == -1) break;
@@ -316,8 +1330,6 @@ int read_message(message_stream* stream, trax_logging* log, string_list* argumen
     		stream->input.complete = TRUE;
     	} else chr = (char) val;
 
-        LOG_CHAR(log, chr);
-
         switch (stream->input.state) {
             case PARSE_STATE_TYPE: { // Parsing message type
 
@@ -326,10 +1338,8 @@ int read_message(message_stream* stream, trax_logging* log, string_list* argumen
                     buffer_push(stream->input.key_buffer, chr);
 
                 } else if (chr == ' ') {
-                    char* key_tmp;
-                    key_tmp = buffer_extract(stream->input.key_buffer);
-                	stream->input.message_type = __parse_message_type(key_tmp);
-                    free(key_tmp);
+                    buffer_push(stream->input.key_buffer, '\0');
+                	stream->input.message_type = __parse_message_type(stream->input.key_buffer->buffer);
                     
                     if (stream->input.message_type == -1) {
                 		stream->input.state = PARSE_STATE_PASS;
@@ -342,10 +1352,8 @@ int read_message(message_stream* stream, trax_logging* log, string_list* argumen
                     buffer_reset(stream->input.value_buffer);
 
                 } else if (chr == '\n') {
-                    char* key_tmp;
-                    key_tmp = buffer_extract(stream->input.key_buffer);
-                	stream->input.message_type = __parse_message_type(key_tmp);
-                    free(key_tmp);
+                    buffer_push(stream->input.key_buffer, '\0');
+                	stream->input.message_type = __parse_message_type(stream->input.key_buffer->buffer);
 
                     if (stream->input.message_type == -1) {
                 		stream->input.state = PARSE_STATE_PASS;
@@ -406,17 +1414,11 @@ int read_message(message_stream* stream, trax_logging* log, string_list* argumen
                 if (chr == '\\') {
                     stream->input.state = PARSE_STATE_UNQUOTED_ESCAPE_KEY;
                 } else if (chr == '\n') { // append arg and finalize
-                    char* key_tmp;
-                    key_tmp = buffer_extract(stream->input.key_buffer);            
-                    list_append(arguments, key_tmp);
-                    free(key_tmp);
+                    push_argument(stream);
 
                     stream->input.complete = TRUE;
                 } else if (chr == ' ') { // append arg and move on
-                    char* key_tmp;
-                    key_tmp = buffer_extract(stream->input.key_buffer);            
-                    list_append(arguments, key_tmp);
-                    free(key_tmp);
+                    push_argument(stream);
 
                     stream->input.state = PARSE_STATE_SPACE;
                     buffer_reset(stream->input.key_buffer);
@@ -439,22 +1441,14 @@ int read_message(message_stream* stream, trax_logging* log, string_list* argumen
                 if (chr == '\\') {
                     stream->input.state = PARSE_STATE_UNQUOTED_ESCAPE_VALUE;
                 } else if (chr == ' ') {
-                    char *key_tmp, *value_tmp;
-                    key_tmp = buffer_extract(stream->input.key_buffer);
-                    value_tmp = buffer_extract(stream->input.value_buffer);                
-                    trax_properties_set(properties, key_tmp, value_tmp);
-                    free(key_tmp); free(value_tmp);
+                    push_property(stream);
 
                     stream->input.state = PARSE_STATE_SPACE;
                     buffer_reset(stream->input.key_buffer);
                     buffer_reset(stream->input.value_buffer);  
        
                 } else if (chr == '\n') {
-                    char *key_tmp, *value_tmp;
-                    key_tmp = buffer_extract(stream->input.key_buffer);
-                    value_tmp = buffer_extract(stream->input.value_buffer);  
-                    trax_properties_set(properties, key_tmp, value_tmp);
-                    free(key_tmp); free(value_tmp);
+                    push_property(stream);
 
                     stream->input.complete = TRUE;
                     buffer_reset(stream->input.key_buffer);
@@ -509,10 +1503,7 @@ int read_message(message_stream* stream, trax_logging* log, string_list* argumen
                 if (chr == '\\') {
                     stream->input.state = PARSE_STATE_QUOTED_ESCAPE_KEY;
                 } else if (chr == '"') { // append arg and move on
-                    char *key_tmp;
-                    key_tmp = buffer_extract(stream->input.key_buffer);            
-                    list_append(arguments, key_tmp);
-                    free(key_tmp);
+                    push_argument(stream);
 
                 	stream->input.state = PARSE_STATE_SPACE_EXPECT;
                 } else if (chr == '=') { // we have a kwarg
@@ -523,21 +1514,37 @@ int read_message(message_stream* stream, trax_logging* log, string_list* argumen
                 	}
                 } else {                    
                 	buffer_push(stream->input.key_buffer, chr);
+                    // Encoded image content is decoded as it arrives, the argument only keeps the header
+                    if (chr == ';' && buffer_size(stream->input.key_buffer) <= PAYLOAD_HEADER_MAX
+                            && payload_header(stream->input.key_buffer)) {
+                        payload_begin(&(stream->input.payload), stream->input.key_buffer);
+                        stream->input.state = PARSE_STATE_QUOTED_PAYLOAD;
+                    }
                 } 
 
                 break;
 
+            }
+            case PARSE_STATE_QUOTED_PAYLOAD: {
+
+                if (chr == '"') {
+                    payload_finish(&(stream->input.payload), list_size(stream->input.arguments));
+                    push_argument(stream);
+
+                    stream->input.state = PARSE_STATE_SPACE_EXPECT;
+                } else if (chr != '=') { // Padding is not needed to decode the last group
+                    payload_push(&(stream->input.payload), &chr, 1);
+                }
+
+                break;
+
             }
             case PARSE_STATE_QUOTED_VALUE: {
 
                 if (chr == '\\') {
                     stream->input.state = PARSE_STATE_QUOTED_ESCAPE_VALUE;
                 } else if (chr == '"') {
-                    char *key_tmp, *value_tmp;
-                    key_tmp = buffer_extract(stream->input.key_buffer);
-                    value_tmp = buffer_extract(stream->input.value_buffer);                
-                    trax_properties_set(properties, key_tmp, value_tmp);
-                    free(key_tmp); free(value_tmp);
+                    push_property(stream);
 
                     stream->input.state = PARSE_STATE_SPACE_EXPECT;
                     buffer_reset(stream->input.key_buffer);
@@ -600,7 +1607,15 @@ int read_message(message_stream* stream, trax_logging* log, string_list* argumen
                     if (chr == TRAX_PREFIX[prefix_length + stream->input.state])
                     	// When done, go to type parsing
                         stream->input.state++; 
-                    else 
+                    else if (stream->input.state == -1 && chr == TRAX_BINARY_PREFIX[prefix_length - 1]) {
+                        // Binary framed message is read by its own reader
+                        log_consumed(stream, log);
+                        stream->input.state = PARSE_STATE_BINARY;
+                        stream->input.binary = TRUE;
+                        stream->input.binary_state.stage = BINARY_STAGE_HEADER;
+                        buffer_reset(stream->input.key_buffer);
+                        buffer_reset(stream->input.value_buffer);
+                    } else 
                     	// Not a message
                         stream->input.state = chr == '\n' ? -prefix_length : PARSE_STATE_PASS; 
                 }
@@ -611,10 +1626,12 @@ int read_message(message_stream* stream, trax_logging* log, string_list* argumen
 
     }
 
+    log_consumed(stream, log);
     LOG_BUFFER(log, NULL, 0) // Flush the log stream
 
     stream->input.state = -prefix_length;
     stream->input.complete = FALSE;
+    stream->input.started = FALSE;
     buffer_reset(stream->input.key_buffer);
     buffer_reset(stream->input.value_buffer);
 
@@ -622,13 +1639,108 @@ int read_message(message_stream* stream, trax_logging* log, string_list* argumen
     
 }
 
-int write_buffer(message_stream* stream, const char* buf, int len, trax_logging* log) {
+int read_message(message_stream* stream, trax_logging* log) {
+
+    stream->flags &= ~TRAX_STREAM_ASYNC;
+
+    return parse_message(stream, log);
+
+}
+
+int read_message_try(message_stream* stream, trax_logging* log) {
+
+    int result;
+
+    stream->flags |= TRAX_STREAM_ASYNC;
+
+    result = parse_message(stream, log);
+
+    stream->flags &= ~TRAX_STREAM_ASYNC;
+
+    return result;
+
+}
+
+string_list* message_arguments(message_stream* stream) {
+
+    return stream->input.arguments;
+
+}
+
+char* message_take_payload(message_stream* stream, int index, int* length, int* pooled) {
+
+    int i;
+    payload_cache* payload = &(stream->input.payload);
+
+    for (i = 0; i < payload->count; i++) {
+        if (payload->indices[i] == index && payload->blocks[i]) {
+            char* data = payload->blocks[i];
+            payload->blocks[i] = NULL;
+            *length = payload->lengths[i];
+            *pooled = payload->origins[i];
+            return data;
+        }
+    }
+
+    return NULL;
+
+}
+
+void message_stream_set_pool(message_stream* stream, image_pool* pool) {
+
+    stream->input.payload.pool = pool;
+
+}
+
+const char* message_property(message_stream* stream, const char* key) {
+
+    int i;
+    string_list* properties = stream->input.properties;
+
+    // Search backwards so that a repeated key resolves to its last value
+    for (i = list_size(properties) - 2; i >= 0; i -= 2) {
+        if (strcmp(properties->buffer[i], key) == 0)
+            return properties->buffer[i + 1];
+    }
+
+    return NULL;
+
+}
+
+void message_enumerate_properties(message_stream* stream, trax_enumerator enumerator, const void* object) {
+
+    int i, j;
+    string_list* properties = stream->input.properties;
+
+    for (i = 0; i < list_size(properties); i += 2) {
+
+        for (j = i + 2; j < list_size(properties); j += 2) {
+            if (strcmp(properties->buffer[i], properties->buffer[j]) == 0) break;
+        }
+
+        if (j < list_size(properties)) continue;
+
+        enumerator(properties->buffer[i], properties->buffer[i + 1], object);
+    }
+
+}
+
+static int write_buffer(message_stream* stream, const char* buf, int len) {
     if (len < 1) return 1;
 
     if (stream->flags & TRAX_STREAM_SOCKET) {
 
         int cnt = 0;
 
+        if (stream->output.descriptors_count > 0) {
+            // Descriptors travel with the first byte of the message
+            cnt = send_descriptors(stream, buf, len);
+            stream->output.descriptors_count = 0;
+            if (cnt == -1) {
+                return -1;
+            }
+        }
+
         while(cnt < len) {
             #ifdef MSG_NOSIGNAL
             int l = send(stream->socket.socket, buf+cnt, len-cnt, MSG_NOSIGNAL);
@@ -656,58 +1768,33 @@ int write_buffer(message_stream* stream, const char* buf, int len, trax_logging*
 
     }
 
-    LOG_BUFFER(log, buf, len);
-
     return 1;
 }
 
-int write_buffer_escaped(message_stream* stream, const char* buf, int len, trax_logging* log) {
-    int i = 0, j = 0;
-
-    if (len < 1) return 1;
-
-    while (i < len) {
-        // Handle special characters by writting the currenlty scanned part of
-        // the buffer and inserting escape character.
-        if (buf[i] == '"' || buf[i] == '\\' || buf[i] == '\n') {
-            if (write_buffer(stream, &(buf[j]), i - j, log) == -1)
-                return -1;
-            j = i;
-            if (write_buffer(stream, "\\", 1, log) != 1)
-                return -1;
-            // In case of new line we do not insert that symbol but character 'n'.
-            if (buf[i] == '\n') {
-                if (write_buffer(stream, "n", 1, log) != 1)
-                    return -1;
-                j++;
-            }
-
-        }
-        i++;
+static void buffer_push_escaped(string_buffer* buffer, const char* str) {
+
+    while (1) {
+        // Append the currently scanned part of the string up to the next special
+        // character and then insert its escaped version.
+        size_t run = strcspn(str, "\"\\\n");
+        buffer_push_n(buffer, str, (int) run);
+        str += run;
+        if (!*str) break;
+        buffer_push(buffer, '\\');
+        // In case of new line we do not insert that symbol but character 'n'.
+        buffer_push(buffer, *str == '\n' ? 'n' : *str);
+        str++;
     }
-    if (write_buffer(stream, &(buf[j]), i - j, log) == -1)
-        return -1;
 
-    return 1;
 }
 
-typedef struct file_pair {
-    message_stream* stream;
-    trax_logging* log;
-} file_pair;
+// Messages are assembled in the output buffer of the stream and written at once
+#define OUTPUT_STRING(S) { buffer_push_n(stream->output.buffer, S, strlen(S)); }
+#define OUTPUT_ESCAPED(S) { buffer_push_escaped(stream->output.buffer, S); }
 
-#define OUTPUT_STRING(S) { int len = strlen(S); write_buffer(stream, S, len, log); }
-#define OUTPUT_ESCAPED(S) { int len = strlen(S); write_buffer_escaped(stream, S, len, log); }
-/*#define OUTPUT_ESCAPED(S) { int i = 0; while (1) { \
-    if (!S[i]) break; \
-    if (S[i] == '"' || S[i] == '\\') { write_string(stream, "\\", 1); LOG_STR(log, "\\"); } \
-     write_string(stream, &(S[i]), 1); LOG_CHAR(log, S[i]); i++; } \
-    }
-*/
 void __output_properties(const char *key, const char *value, const void *obj) {
     
-    message_stream* stream = ((file_pair *) obj)->stream;
-    trax_logging* log = ((file_pair *) obj)->log;
+    message_stream* stream = (message_stream *) obj;
 
     OUTPUT_STRING("\"");
     OUTPUT_STRING(key);
@@ -717,6 +1804,91 @@ void __output_properties(const char *key, const char *value, const void *obj) {
 
 }
 
+void __collect_properties(const char *key, const char *value, const void *obj) {
+
+    list_append((string_list*) obj, key);
+    list_append((string_list*) obj, value);
+
+}
+
+typedef struct binary_properties {
+    string_buffer* buffer;
+    int count;
+} binary_properties;
+
+static void buffer_push_length(string_buffer* buffer, int length) {
+    char bytes[4];
+    message_encode_length(bytes, length);
+    buffer_push_n(buffer, bytes, 4);
+}
+
+void __output_binary_properties(const char *key, const char *value, const void *obj) {
+
+    binary_properties* pair = (binary_properties *) obj;
+    int length;
+
+    length = strlen(key);
+    buffer_push_length(pair->buffer, length);
+    buffer_push_n(pair->buffer, key, length);
+
+    length = strlen(value);
+    buffer_push_length(pair->buffer, length);
+    buffer_push_n(pair->buffer, value, length);
+
+    pair->count++;
+
+}
+
+static void write_binary_message(message_stream* stream, trax_logging* log, int type, const string_list* arguments, trax_properties* properties) {
+
+    int i, offset;
+    string_buffer* output = stream->output.buffer;
+
+    if (type < TRAX_HELLO || type > TRAX_STATE) return;
+
+    buffer_reset(output);
+
+    buffer_push_n(output, TRAX_BINARY_PREFIX, prefix_length);
+    buffer_push(output, (char) type);
+    buffer_push_length(output, arguments ? list_size(arguments) : 0);
+    offset = buffer_size(output);
+    buffer_push_length(output, 0); // Property count is written after enumeration
+
+    if (arguments) {
+        for (i = 0; i < list_size(arguments); i++) {
+            buffer_push_length(output, list_length(arguments, i));
+            buffer_push_n(output, arguments->buffer[i], list_length(arguments, i));
+        }
+    }
+
+    if (properties) {
+
+        binary_properties pair;
+        pair.buffer = output;
+        pair.count = 0;
+
+        trax_properties_enumerate(properties, __output_binary_properties, &pair);
+
+        message_encode_length(output->buffer + offset, pair.count);
+
+    }
+
+    buffer_push(output, '\n');
+
+    write_buffer(stream, output->buffer, buffer_size(output));
+
+    if (log && log->callback) {
+        string_list* pairs = list_create(8);
+        log->callback(TRAX_BINARY_PREFIX, prefix_length, log->data);
+        if (properties) trax_properties_enumerate(properties, __collect_properties, pairs);
+        log_binary_message(log, type, arguments, pairs);
+        list_destroy(&pairs);
+    }
+
+    LOG_BUFFER(log, NULL, 0); // Flush the log stream
+
+}
+
 void write_message(message_stream* stream, trax_logging* log, int type, const string_list* arguments, trax_properties* properties) {
 
     int i;
@@ -725,6 +1897,13 @@ void write_message(message_stream* stream, trax_logging* log, int type, const st
 
     VALIDATE_MESSAGE_STREAM(stream);
 
+    if (stream->flags & TRAX_STREAM_BINARY) {
+        write_binary_message(stream, log, type, arguments, properties);
+        return;
+    }
+
+    buffer_reset(stream->output.buffer);
+
     switch (type) {
         case TRAX_HELLO:
             OUTPUT_STRING(TRAX_PREFIX);
@@ -764,15 +1943,19 @@ void write_message(message_stream* stream, trax_logging* log, int type, const st
 
     if (properties) {
 
-        file_pair pair;
-        pair.stream = stream;
-        pair.log = log;
-
-        trax_properties_enumerate(properties, __output_properties, &pair);
+        trax_properties_enumerate(properties, __output_properties, stream);
 
     }
 
     OUTPUT_STRING("\n");
+
+    write_buffer(stream, stream->output.buffer->buffer, buffer_size(stream->output.buffer));
+
+    {
+        int token = 0;
+        log_span(log, stream->output.buffer->buffer, buffer_size(stream->output.buffer), &token);
+    }
+
     LOG_BUFFER(log, NULL, 0); // Flush the log stream
 
 }
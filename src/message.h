@@ -2,17 +2,24 @@
 #define _MESSAGE_H_
 
 #define TRAX_PREFIX "@@TRAX:"
+#define TRAX_BINARY_PREFIX "@@TRAX#"
 
 #define TRAX_STREAM_FILES 1
 #define TRAX_STREAM_SOCKET 2
 #define TRAX_STREAM_SOCKET_LISTEN 8
 #define TRAX_STREAM_ASYNC 16
+#define TRAX_STREAM_BINARY 32
+#define TRAX_STREAM_DESCRIPTORS 64
 
+// The receive window starts small and grows while reads keep filling it
 #define TRAX_BUFFER_SIZE 4096
+#define TRAX_BUFFER_MAX 1048576
+#define TRAX_DESCRIPTORS_MAX 16
 
 #include <stdio.h>
 #include <assert.h>
 #include "buffer.h"
+#include "pool.h"
 #include "trax.h"
 
 typedef struct socket_data {
@@ -25,17 +32,59 @@ typedef struct files_data {
     int output;
 } files_data;
 
+typedef struct binary_cache {
+    int stage;
+    int type;
+    int arguments;
+    int properties;
+    int index;
+    int length;
+    int offset;
+} binary_cache;
+
+/**
+ * Base64 content of image arguments is decoded while it is received, the decoded payloads
+ * are kept separately from the arguments, which only hold the header of the URI. Raw images
+ * are decoded to buffers of the image pool if the stream has one.
+**/
+typedef struct payload_cache {
+    char* data;
+    int length;
+    int size;
+    int valid;
+    int pooled;
+    char group[4];
+    int group_length;
+    char** blocks;
+    int* lengths;
+    int* indices;
+    int* origins;
+    int count;
+    int capacity;
+    image_pool* pool;
+} payload_cache;
+
 typedef struct input_cache {
     int message_type;
     int complete;
     int state;
+    int started;
+    int binary;
+    binary_cache binary_state;
     string_buffer* key_buffer, *value_buffer;
+    string_list* arguments;
+    string_list* properties;
+    int descriptors[TRAX_DESCRIPTORS_MAX];
+    int descriptors_count;
+    int log_position;
+    int log_token;
+    payload_cache payload;
 } input_cache;
 
 typedef struct output_cache {
-    int complete;
-    int state;
-    string_buffer* key_buffer, *value_buffer;
+    string_buffer* buffer;
+    int descriptors[TRAX_DESCRIPTORS_MAX];
+    int descriptors_count;
 } output_cache;
 
 
@@ -45,7 +94,8 @@ typedef struct message_stream {
         files_data files;
         socket_data socket;
     };
-    char buffer[TRAX_BUFFER_SIZE];
+    char* buffer;
+    int buffer_size;
     int buffer_position;
     int buffer_length;
     input_cache input;
@@ -54,18 +104,95 @@ typedef struct message_stream {
 
 message_stream* create_message_stream_file(int input, int output);
 
+message_stream* create_message_stream_socket(int socket);
+
 message_stream* create_message_stream_socket_connect(int port);
 
+message_stream* create_message_stream_socket_connect_unix(const char* path);
+
 message_stream* create_message_stream_socket_accept(int server, int timeout);
 
 void destroy_message_stream(message_stream** stream);
 
-int read_message(message_stream* stream, trax_logging* log, string_list* arguments, trax_properties* properties);
+/**
+ * Reads a message and returns its type. The arguments and properties of the message are kept
+ * by the stream in memory that is reused for the next message, so they are only valid until then.
+**/
+int read_message(message_stream* stream, trax_logging* log);
+
+/**
+ * Reads as much of a message as is available without blocking. Returns TRAX_PENDING if the message
+ * is not complete yet, in that case the call has to be repeated.
+**/
+int read_message_try(message_stream* stream, trax_logging* log);
+
+/**
+ * Returns the arguments of the last received message.
+**/
+string_list* message_arguments(message_stream* stream);
+
+/**
+ * Returns the decoded content of an argument of the last received message and passes its ownership
+ * to the caller or returns NULL if the content of the argument was not decoded by the parser. If the
+ * content was decoded to a buffer of the image pool, the pooled flag is set and the buffer has to be
+ * returned to the pool.
+**/
+char* message_take_payload(message_stream* stream, int index, int* length, int* pooled);
+
+/**
+ * Sets the image pool that is used for decoded image content, the pool is not owned by the stream.
+**/
+void message_stream_set_pool(message_stream* stream, image_pool* pool);
+
+/**
+ * Returns the value of a property of the last received message or NULL if it is not set.
+**/
+const char* message_property(message_stream* stream, const char* key);
+
+/**
+ * Enumerates the properties of the last received message, if a key is repeated only its last value is used.
+**/
+void message_enumerate_properties(message_stream* stream, trax_enumerator enumerator, const void* object);
+
+/**
+ * Returns the descriptor that can be polled for incoming data.
+**/
+int message_stream_descriptor(message_stream* stream);
+
+/**
+ * Requests kernel buffers of the given size for the connection (socket send and receive buffers or
+ * the capacity of the pipes), returns FALSE if the connection does not support it.
+**/
+int message_stream_set_capacity(message_stream* stream, int size);
+
+/**
+ * Returns the size of the kernel receive buffer of the connection or -1 if it is not known.
+**/
+int message_stream_get_capacity(message_stream* stream);
 	
 void write_message(message_stream* stream, trax_logging* log, int type, const string_list* arguments, trax_properties* properties);
 
+/**
+ * Attaches a file descriptor to the next written message, returns FALSE if the stream
+ * cannot pass descriptors or too many are already attached. The descriptor is not closed.
+**/
+int message_attach_descriptor(message_stream* stream, int descriptor);
+
+/**
+ * Returns the oldest received file descriptor that was not yet claimed or -1 if there is none.
+ * Descriptors arrive in the order in which they were attached, the caller has to close them.
+**/
+int message_take_descriptor(message_stream* stream);
+
+/**
+ * Writes a length of the binary protocol to four bytes in network order.
+**/
+void message_encode_length(char* destination, int length);
+
 #define LOG_STRING(L, S) { if ((L) && (L)->callback ) { (L)->callback(S, strlen(S), (L)->data); } }
 #define LOG_BUFFER(L, S, N) { if ((L) && (L)->callback ) { (L)->callback(S, N, (L)->data); } }
-#define LOG_CHAR(L, C) { if ((L) && (L)->callback ) { (L)->callback(&(C), 1, (L)->data); } }
+
+// Number of bytes of a token that are logged when payloads are truncated
+#define TRAX_LOG_PAYLOAD 64
 
 #endif
@@ -0,0 +1,143 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4; tab-width: 4 -*- */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "pool.h"
+
+// Images are usually released on the thread that uses the handle, but trackers may also
+// release them elsewhere, a spin lock is enough for the short critical sections below
+#if defined(_MSC_VER)
+#include <windows.h>
+#define POOL_LOCK(P) while (InterlockedExchange(&(P)->lock, 1)) {}
+#define POOL_UNLOCK(P) InterlockedExchange(&(P)->lock, 0)
+#else
+#define POOL_LOCK(P) while (__sync_lock_test_and_set(&(P)->lock, 1)) {}
+#define POOL_UNLOCK(P) __sync_lock_release(&(P)->lock)
+#endif
+
+// Frees idle buffers until at most the given number is left, oldest buffers go first
+static void pool_trim(image_pool* pool, int count) {
+
+    int i, excess = pool->count - count;
+
+    if (excess < 1) return;
+
+    for (i = 0; i < excess; i++)
+        free(pool->buffers[i]);
+
+    memmove(pool->buffers, pool->buffers + excess, sizeof(char*) * count);
+    memmove(pool->sizes, pool->sizes + excess, sizeof(int) * count);
+
+    pool->count = count;
+
+}
+
+static void pool_free(image_pool* pool) {
+
+    pool_trim(pool, 0);
+
+    free(pool->buffers);
+    free(pool->sizes);
+    free(pool);
+
+}
+
+image_pool* image_pool_create(int capacity) {
+
+    image_pool* pool = (image_pool*) malloc(sizeof(image_pool));
+
+    memset(pool, 0, sizeof(image_pool));
+
+    image_pool_set_capacity(pool, capacity);
+
+    return pool;
+
+}
+
+void image_pool_retire(image_pool* pool) {
+
+    int references;
+
+    POOL_LOCK(pool);
+    pool->retired = 1;
+    references = pool->references;
+    POOL_UNLOCK(pool);
+
+    if (references < 1)
+        pool_free(pool);
+
+}
+
+void image_pool_set_capacity(image_pool* pool, int capacity) {
+
+    if (capacity < 0) capacity = 0;
+
+    POOL_LOCK(pool);
+
+    pool_trim(pool, capacity);
+
+    pool->capacity = capacity;
+    pool->buffers = (char**) realloc(pool->buffers, sizeof(char*) * (capacity + 1));
+    pool->sizes = (int*) realloc(pool->sizes, sizeof(int) * (capacity + 1));
+
+    POOL_UNLOCK(pool);
+
+}
+
+char* image_pool_acquire(image_pool* pool, int size) {
+
+    int i;
+    char* data = NULL;
+
+    POOL_LOCK(pool);
+
+    pool->references++;
+
+    // The most recently returned buffer is the most likely to still be in cache
+    for (i = pool->count - 1; i >= 0; i--) {
+        if (pool->sizes[i] != size) continue;
+        data = pool->buffers[i];
+        memmove(pool->buffers + i, pool->buffers + i + 1, sizeof(char*) * (pool->count - i - 1));
+        memmove(pool->sizes + i, pool->sizes + i + 1, sizeof(int) * (pool->count - i - 1));
+        pool->count--;
+        pool->reused++;
+        break;
+    }
+
+    if (!data) pool->allocated++;
+
+    POOL_UNLOCK(pool);
+
+    if (!data) data = (char*) malloc(sizeof(char) * size);
+
+    return data;
+
+}
+
+void image_pool_recycle(image_pool* pool, char* data, int size) {
+
+    int references, retired;
+
+    POOL_LOCK(pool);
+
+    pool->references--;
+    references = pool->references;
+    retired = pool->retired;
+
+    if (!pool->retired && pool->capacity > 0) {
+        pool->buffers[pool->count] = data;
+        pool->sizes[pool->count] = size;
+        pool->count++;
+        data = NULL;
+        pool_trim(pool, pool->capacity);
+    }
+
+    POOL_UNLOCK(pool);
+
+    if (data) free(data);
+
+    if (retired && references < 1)
+        pool_free(pool);
+
+}
@@ -0,0 +1,49 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4; tab-width: 4 -*- */
+
+#ifndef _POOL_H_
+#define _POOL_H_
+
+// Number of idle frame buffers that a server handle keeps by default
+#define POOL_CAPACITY 4
+
+/**
+ * Frame buffers of a handle that are recycled when received images are released. Buffers
+ * are matched by size, which is determined by the geometry and the format of an image.
+ * Images can outlive the handle, the pool is freed when it is retired and its last buffer
+ * is returned.
+**/
+typedef struct image_pool {
+    char** buffers;
+    int* sizes;
+    int count;
+    int capacity;
+    int references;
+    int retired;
+    int reused;
+    int allocated;
+    volatile long lock;
+} image_pool;
+
+image_pool* image_pool_create(int capacity);
+
+/**
+ * Frees the idle buffers and the pool itself once all acquired buffers are returned.
+**/
+void image_pool_retire(image_pool* pool);
+
+/**
+ * Changes the number of idle buffers that are kept, zero disables recycling.
+**/
+void image_pool_set_capacity(image_pool* pool, int capacity);
+
+/**
+ * Returns an idle buffer of the given size or allocates a new one.
+**/
+char* image_pool_acquire(image_pool* pool, int size);
+
+/**
+ * Returns a buffer to the pool, the oldest idle buffer is freed if the pool is full.
+**/
+void image_pool_recycle(image_pool* pool, char* data, int size);
+
+#endif
@@ -6,6 +6,7 @@
 #include <math.h>
 #include <assert.h>
 #include <ctype.h>
+#include <stdint.h>
 
 #include "region.h"
 #include "buffer.h"
@@ -145,24 +146,44 @@ region_bounds compute_bounds_polygon(const region_polygon* polygon) {
 
 }
 
+static int bytes_first(const char* data, int count);
+static int bytes_last(const char* data, int count);
+
 region_bounds compute_bounds_mask(const region_mask* mask) {
 
-	int i, j;
+	int i, j, top, bottom, left, right;
 	region_bounds bounds;
 	bounds.top = FLT_MAX;
 	bounds.bottom = -FLT_MAX;
 	bounds.left = FLT_MAX;
 	bounds.right = -FLT_MAX;
 
-	for (i = 0; i < mask->height; i++) {
-		for (j = 0; j < mask->width; j++) {
-			if (mask->data[j + i * mask->width]) {
-				bounds.top = MIN(bounds.top, i);
-				bounds.bottom = MAX(bounds.bottom, i);
-				bounds.left = MIN(bounds.left, j);
-				bounds.right = MAX(bounds.right, j);
-			}
+	for (top = 0; top < mask->height; top++) {
+		if (bytes_first(mask->data + (size_t) top * mask->width, mask->width) < mask->width) break;
+	}
+
+	for (bottom = mask->height - 1; bottom > top; bottom--) {
+		if (bytes_first(mask->data + (size_t) bottom * mask->width, mask->width) < mask->width) break;
+	}
+
+	if (top < mask->height) {
+
+		left = mask->width;
+		right = -1;
+
+		// Only the part of a row that is outside of the current left and right bounds has to be searched
+		for (i = top; i <= bottom; i++) {
+			const char* row = mask->data + (size_t) i * mask->width;
+			left = bytes_first(row, left);
+			j = bytes_last(row + right + 1, mask->width - right - 1);
+			if (j >= 0) right += j + 1;
 		}
+
+		bounds.top = top;
+		bounds.bottom = bottom;
+		bounds.left = left;
+		bounds.right = right;
+
 	}
 
 	bounds.top += mask->y;
@@ -869,8 +890,593 @@ region_bounds region_compute_bounds(const region_container* region) {
 
 }
 
+// Masks that are only needed to compute an overlap are stored with one bit per pixel, every row
+// starts with a new 64-bit word so that rows can be filled and counted a word at a time
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#if defined(_M_X64)
+#define POPCOUNT(W) ((int) __popcnt64(W))
+#endif
+#elif defined(__GNUC__) || defined(__clang__)
+#define POPCOUNT(W) __builtin_popcountll(W)
+#endif
+
+#ifndef POPCOUNT
+static int popcount_word(uint64_t w) {
+	w = w - ((w >> 1) & 0x5555555555555555ULL);
+	w = (w & 0x3333333333333333ULL) + ((w >> 2) & 0x3333333333333333ULL);
+	w = (w + (w >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+	return (int) ((w * 0x0101010101010101ULL) >> 56);
+}
+#define POPCOUNT(W) popcount_word(W)
+#endif
+
+#define BITS_WORDS(W) (((W) + 63) / 64)
+
+// Packing and counting of masks is vectorized with SSE2 where it is available at compile time and
+// with AVX2 if the processor supports it at runtime, the plain loops are used as a fallback
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BITS_SSE2
+#endif
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__)) && defined(BITS_SSE2)
+#include <immintrin.h>
+#define BITS_AVX2
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+#if defined(_MSC_VER)
+static inline int lowest_bit(unsigned int value) { unsigned long index; _BitScanForward(&index, value); return (int) index; }
+static inline int highest_bit(unsigned int value) { unsigned long index; _BitScanReverse(&index, value); return (int) index; }
+#elif defined(__GNUC__) || defined(__clang__)
+#define lowest_bit(V) __builtin_ctz(V)
+#define highest_bit(V) (31 - __builtin_clz(V))
+#else
+static inline int lowest_bit(unsigned int value) {
+	int index = 0;
+	while (!(value & 1)) { value >>= 1; index++; }
+	return index;
+}
+static inline int highest_bit(unsigned int value) {
+	int index = 0;
+	while (value >>= 1) index++;
+	return index;
+}
+#endif
+
+#define KERNELS_SCALAR 0
+#define KERNELS_SSE2 1
+#define KERNELS_AVX2 2
+
+static int kernels_level() {
+
+	static int level = -1;
+
+	if (__flags & REGION_SCALAR_KERNELS) return KERNELS_SCALAR;
+
+	if (level < 0) {
+		int detected = KERNELS_SCALAR;
+#ifdef BITS_SSE2
+		detected = KERNELS_SSE2;
+#endif
+#ifdef BITS_AVX2
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2")) detected = KERNELS_AVX2;
+#endif
+		level = detected;
+	}
+
+	return level;
+
+}
+
+static uint64_t* bits_create(int width, int height) {
+
+	return (uint64_t*) calloc((size_t) BITS_WORDS(width) * height, sizeof(uint64_t));
+
+}
+
+static int bits_count(const uint64_t* bits, int count);
+
+// Counts the set bits of a row between two pixels (inclusive)
+static int bits_count_span(const uint64_t* row, int from, int to) {
+
+	int i, sum, first = from >> 6, last = to >> 6;
+	uint64_t head = ~((uint64_t) 0) << (from & 63);
+	uint64_t tail = ~((uint64_t) 0) >> (63 - (to & 63));
+
+	if (first == last)
+		return POPCOUNT(row[first] & head & tail);
+
+	sum = POPCOUNT(row[first] & head) + POPCOUNT(row[last] & tail);
+	for (i = first + 1; i < last; i++)
+		sum += POPCOUNT(row[i]);
+
+	return sum;
+
+}
+
+// Rasterized regions are kept as runs of pixels in every row of a window, so that the cost of an
+// overlap depends on the number of runs and not on the size of the regions. Runs of a row are
+// sorted and do not touch, the runs of row i are stored from rows[i] to rows[i + 1].
+typedef struct region_runs {
+	int height;
+	int last;
+	int count;
+	int size;
+	int* rows;
+	int* spans;
+} region_runs;
+
+static region_runs* runs_create(int height) {
+
+	region_runs* runs = (region_runs*) malloc(sizeof(region_runs));
+
+	runs->height = height;
+	runs->last = -1;
+	runs->count = 0;
+	runs->size = 16;
+	runs->rows = (int*) malloc(sizeof(int) * (height + 1));
+	runs->spans = (int*) malloc(sizeof(int) * runs->size * 2);
+
+	return runs;
+
+}
+
+static void runs_destroy(region_runs* runs) {
+
+	free(runs->rows);
+	free(runs->spans);
+	free(runs);
+
+}
+
+// Appends a run of pixels, rows have to be appended in order and runs within a row from left to right
+static void runs_append(region_runs* runs, int row, int from, int to) {
+
+	for (; runs->last < row; runs->last++)
+		runs->rows[runs->last + 1] = runs->count;
+
+	// Runs that overlap or touch the previous run of the row are merged with it
+	if (runs->count > runs->rows[row] && from <= runs->spans[runs->count * 2 - 1] + 1) {
+		runs->spans[runs->count * 2 - 1] = MAX(runs->spans[runs->count * 2 - 1], to);
+		return;
+	}
+
+	if (runs->count == runs->size) {
+		runs->size *= 2;
+		runs->spans = (int*) realloc(runs->spans, sizeof(int) * runs->size * 2);
+	}
+
+	runs->spans[runs->count * 2] = from;
+	runs->spans[runs->count * 2 + 1] = to;
+	runs->count++;
+
+}
+
+// Closes the remaining rows, has to be called before the runs are used
+static void runs_finish(region_runs* runs) {
+
+	for (; runs->last < runs->height; runs->last++)
+		runs->rows[runs->last + 1] = runs->count;
+
+}
+
+static int runs_area(const region_runs* runs) {
+
+	int i, sum = 0;
+
+	for (i = 0; i < runs->rows[runs->height]; i++)
+		sum += runs->spans[i * 2 + 1] - runs->spans[i * 2] + 1;
+
+	return sum;
+
+}
+
+// Counts pixels that are set in both or only in one of two sets of runs by merging the runs of every row
+static void runs_overlap(const region_runs* runs1, const region_runs* runs2, int* only1, int* only2, int* both) {
+
+	int row, area1 = runs_area(runs1), area2 = runs_area(runs2), common = 0;
+
+	for (row = 0; row < runs1->height; row++) {
+
+		int i = runs1->rows[row], j = runs2->rows[row];
+
+		while (i < runs1->rows[row + 1] && j < runs2->rows[row + 1]) {
+			int from = MAX(runs1->spans[i * 2], runs2->spans[j * 2]);
+			int to = MIN(runs1->spans[i * 2 + 1], runs2->spans[j * 2 + 1]);
+
+			if (to >= from) common += to - from + 1;
+
+			if (runs1->spans[i * 2 + 1] < runs2->spans[j * 2 + 1]) i++; else j++;
+		}
+
+	}
+
+	*both = common;
+	*only1 = area1 - common;
+	*only2 = area2 - common;
+
+}
+
+// Counts pixels of runs and of a bit mask of the same window
+static void runs_bits_overlap(const region_runs* runs, const uint64_t* bits, int width, int* only1, int* only2, int* both) {
+
+	int row, i, common = 0;
+	int area1 = runs_area(runs), area2 = bits_count(bits, BITS_WORDS(width) * runs->height);
+
+	for (row = 0; row < runs->height; row++) {
+		for (i = runs->rows[row]; i < runs->rows[row + 1]; i++)
+			common += bits_count_span(bits + (size_t) row * BITS_WORDS(width), runs->spans[i * 2], runs->spans[i * 2 + 1]);
+	}
+
+	*both = common;
+	*only1 = area1 - common;
+	*only2 = area2 - common;
+
+}
+
+// Ors up to 64 bits into a row starting at a given pixel
+static inline void bits_put(uint64_t* row, int position, uint64_t value, int count) {
+
+	int shift = position & 63;
+
+	row[position >> 6] |= value << shift;
+	if (shift && shift + count > 64) row[(position >> 6) + 1] |= value >> (64 - shift);
+
+}
+
+static void bits_pack_scalar(uint64_t* row, int offset, const char* data, int count) {
+
+	int j;
+
+	for (j = 0; j < count; j++) {
+		if (data[j]) row[(offset + j) >> 6] |= ((uint64_t) 1) << ((offset + j) & 63);
+	}
+
+}
+
+static int bits_count_scalar(const uint64_t* bits, int count) {
+
+	int i, sum = 0;
+
+	for (i = 0; i < count; i++)
+		sum += POPCOUNT(bits[i]);
+
+	return sum;
+
+}
+
+static void bits_overlap_scalar(const uint64_t* bits1, const uint64_t* bits2, int count, int* only1, int* only2, int* both) {
+
+	int i;
+
+	*only1 = *only2 = *both = 0;
+
+	for (i = 0; i < count; i++) {
+		*both += POPCOUNT(bits1[i] & bits2[i]);
+		*only1 += POPCOUNT(bits1[i] & ~bits2[i]);
+		*only2 += POPCOUNT(bits2[i] & ~bits1[i]);
+	}
+
+}
+
+#ifdef BITS_SSE2
+
+// Non-zero bytes of 64 bytes of a mask are turned into bits with byte comparisons
+static void bits_pack_sse2(uint64_t* row, int offset, const char* data, int count) {
+
+	int j, k;
+	const __m128i zero = _mm_setzero_si128();
+
+	for (j = 0; j + 64 <= count; j += 64) {
+		uint64_t value = 0;
+		for (k = 0; k < 4; k++) {
+			__m128i v = _mm_loadu_si128((const __m128i*) (data + j + k * 16));
+			value |= ((uint64_t) (~_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) & 0xFFFF)) << (k * 16);
+		}
+		if (value) bits_put(row, offset + j, value, 64);
+	}
+
+	bits_pack_scalar(row, offset + j, data + j, count - j);
+
+}
+
+// Counts bits of every byte of a vector, the counts are summed into its two 64-bit halves
+static inline __m128i popcount_sse2(__m128i v) {
+
+	const __m128i m1 = _mm_set1_epi8(0x55), m2 = _mm_set1_epi8(0x33), m4 = _mm_set1_epi8(0x0F);
+
+	v = _mm_sub_epi8(v, _mm_and_si128(_mm_srli_epi64(v, 1), m1));
+	v = _mm_add_epi8(_mm_and_si128(v, m2), _mm_and_si128(_mm_srli_epi64(v, 2), m2));
+	v = _mm_and_si128(_mm_add_epi8(v, _mm_srli_epi64(v, 4)), m4);
+
+	return _mm_sad_epu8(v, _mm_setzero_si128());
+
+}
+
+static inline int sum_sse2(__m128i v) {
+
+	uint64_t lanes[2];
+
+	_mm_storeu_si128((__m128i*) lanes, v);
+
+	return (int) (lanes[0] + lanes[1]);
+
+}
+
+static int bits_count_sse2(const uint64_t* bits, int count) {
+
+	int i;
+	__m128i sum = _mm_setzero_si128();
+
+	for (i = 0; i + 2 <= count; i += 2)
+		sum = _mm_add_epi64(sum, popcount_sse2(_mm_loadu_si128((const __m128i*) (bits + i))));
+
+	return sum_sse2(sum) + bits_count_scalar(bits + i, count - i);
+
+}
+
+static void bits_overlap_sse2(const uint64_t* bits1, const uint64_t* bits2, int count, int* only1, int* only2, int* both) {
+
+	int i, t1, t2, tb;
+	__m128i sum1 = _mm_setzero_si128(), sum2 = _mm_setzero_si128(), sumb = _mm_setzero_si128();
+
+	for (i = 0; i + 2 <= count; i += 2) {
+		__m128i v1 = _mm_loadu_si128((const __m128i*) (bits1 + i));
+		__m128i v2 = _mm_loadu_si128((const __m128i*) (bits2 + i));
+		sum1 = _mm_add_epi64(sum1, popcount_sse2(v1));
+		sum2 = _mm_add_epi64(sum2, popcount_sse2(v2));
+		sumb = _mm_add_epi64(sumb, popcount_sse2(_mm_and_si128(v1, v2)));
+	}
+
+	bits_overlap_scalar(bits1 + i, bits2 + i, count - i, &t1, &t2, &tb);
+
+	*both = sum_sse2(sumb) + tb;
+	*only1 = sum_sse2(sum1) - sum_sse2(sumb) + t1;
+	*only2 = sum_sse2(sum2) - sum_sse2(sumb) + t2;
+
+}
+
+#endif
+
+#ifdef BITS_AVX2
+
+TARGET_AVX2 static void bits_pack_avx2(uint64_t* row, int offset, const char* data, int count) {
+
+	int j;
+	const __m256i zero = _mm256_setzero_si256();
+
+	for (j = 0; j + 64 <= count; j += 64) {
+		__m256i v1 = _mm256_loadu_si256((const __m256i*) (data + j));
+		__m256i v2 = _mm256_loadu_si256((const __m256i*) (data + j + 32));
+		uint64_t value = (uint64_t) (uint32_t) ~_mm256_movemask_epi8(_mm256_cmpeq_epi8(v1, zero))
+			| ((uint64_t) (uint32_t) ~_mm256_movemask_epi8(_mm256_cmpeq_epi8(v2, zero)) << 32);
+		if (value) bits_put(row, offset + j, value, 64);
+	}
+
+	bits_pack_scalar(row, offset + j, data + j, count - j);
+
+}
+
+// Counts bits of every byte with a lookup of both nibbles, the counts are summed into 64-bit lanes
+TARGET_AVX2 static inline __m256i popcount_avx2(__m256i v) {
+
+	const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+		0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	const __m256i low = _mm256_set1_epi8(0x0F);
+
+	__m256i counts = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, _mm256_and_si256(v, low)),
+		_mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(v, 4), low)));
+
+	return _mm256_sad_epu8(counts, _mm256_setzero_si256());
+
+}
+
+TARGET_AVX2 static inline int sum_avx2(__m256i v) {
+
+	uint64_t lanes[4];
+
+	_mm256_storeu_si256((__m256i*) lanes, v);
+
+	return (int) (lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+
+}
+
+TARGET_AVX2 static int bits_count_avx2(const uint64_t* bits, int count) {
+
+	int i;
+	__m256i sum = _mm256_setzero_si256();
+
+	for (i = 0; i + 4 <= count; i += 4)
+		sum = _mm256_add_epi64(sum, popcount_avx2(_mm256_loadu_si256((const __m256i*) (bits + i))));
+
+	return sum_avx2(sum) + bits_count_scalar(bits + i, count - i);
+
+}
+
+TARGET_AVX2 static void bits_overlap_avx2(const uint64_t* bits1, const uint64_t* bits2, int count, int* only1, int* only2, int* both) {
+
+	int i, t1, t2, tb;
+	__m256i sum1 = _mm256_setzero_si256(), sum2 = _mm256_setzero_si256(), sumb = _mm256_setzero_si256();
+
+	for (i = 0; i + 4 <= count; i += 4) {
+		__m256i v1 = _mm256_loadu_si256((const __m256i*) (bits1 + i));
+		__m256i v2 = _mm256_loadu_si256((const __m256i*) (bits2 + i));
+		sum1 = _mm256_add_epi64(sum1, popcount_avx2(v1));
+		sum2 = _mm256_add_epi64(sum2, popcount_avx2(v2));
+		sumb = _mm256_add_epi64(sumb, popcount_avx2(_mm256_and_si256(v1, v2)));
+	}
+
+	bits_overlap_scalar(bits1 + i, bits2 + i, count - i, &t1, &t2, &tb);
+
+	*both = sum_avx2(sumb) + tb;
+	*only1 = sum_avx2(sum1) - sum_avx2(sumb) + t1;
+	*only2 = sum_avx2(sum2) - sum_avx2(sumb) + t2;
+
+}
+
+#endif
+
+// Sets the bits of a row for the non-zero bytes of a mask row, starting at a given pixel
+static void bits_pack(uint64_t* row, int offset, const char* data, int count) {
+
+	switch (kernels_level()) {
+#ifdef BITS_AVX2
+	case KERNELS_AVX2:
+		bits_pack_avx2(row, offset, data, count);
+		return;
+#endif
+#ifdef BITS_SSE2
+	case KERNELS_SSE2:
+		bits_pack_sse2(row, offset, data, count);
+		return;
+#endif
+	default:
+		bits_pack_scalar(row, offset, data, count);
+	}
+
+}
+
+static int bits_count(const uint64_t* bits, int count) {
+
+	switch (kernels_level()) {
+#ifdef BITS_AVX2
+	case KERNELS_AVX2:
+		return bits_count_avx2(bits, count);
+#endif
+#ifdef BITS_SSE2
+	case KERNELS_SSE2:
+		return bits_count_sse2(bits, count);
+#endif
+	default:
+		return bits_count_scalar(bits, count);
+	}
+
+}
+
+// Counts the pixels of two masks of the same size that are set in both, or only in one of them
+static void bits_overlap(const uint64_t* bits1, const uint64_t* bits2, int count, int* only1, int* only2, int* both) {
+
+	switch (kernels_level()) {
+#ifdef BITS_AVX2
+	case KERNELS_AVX2:
+		bits_overlap_avx2(bits1, bits2, count, only1, only2, both);
+		return;
+#endif
+#ifdef BITS_SSE2
+	case KERNELS_SSE2:
+		bits_overlap_sse2(bits1, bits2, count, only1, only2, both);
+		return;
+#endif
+	default:
+		bits_overlap_scalar(bits1, bits2, count, only1, only2, both);
+	}
+
+}
+
+static int bytes_first_scalar(const char* data, int count) {
+
+	int j;
+
+	for (j = 0; j < count && !data[j]; j++);
+
+	return j;
+
+}
+
+static int bytes_last_scalar(const char* data, int count) {
+
+	int j;
+
+	for (j = count - 1; j >= 0 && !data[j]; j--);
+
+	return j;
+
+}
+
+#ifdef BITS_SSE2
+
+static int bytes_first_sse2(const char* data, int count) {
+
+	int j;
+	const __m128i zero = _mm_setzero_si128();
+
+	for (j = 0; j + 16 <= count; j += 16) {
+		int nonzero = ~_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (data + j)), zero)) & 0xFFFF;
+		if (nonzero) return j + lowest_bit(nonzero);
+	}
+
+	return j + bytes_first_scalar(data + j, count - j);
+
+}
+
+static int bytes_last_sse2(const char* data, int count) {
+
+	int j;
+	const __m128i zero = _mm_setzero_si128();
+
+	for (j = count; j >= 16; j -= 16) {
+		int nonzero = ~_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (data + j - 16)), zero)) & 0xFFFF;
+		if (nonzero) return j - 16 + highest_bit(nonzero);
+	}
+
+	return bytes_last_scalar(data, j);
+
+}
+
+#endif
+
+// Returns the index of the first non-zero byte or count if all bytes are zero
+static int bytes_first(const char* data, int count) {
+
+#ifdef BITS_SSE2
+	if (kernels_level() >= KERNELS_SSE2)
+		return bytes_first_sse2(data, count);
+#endif
+
+	return bytes_first_scalar(data, count);
+
+}
+
+// Returns the index of the last non-zero byte or -1 if all bytes are zero
+static int bytes_last(const char* data, int count) {
+
+#ifdef BITS_SSE2
+	if (kernels_level() >= KERNELS_SSE2)
+		return bytes_last_sse2(data, count);
+#endif
+
+	return bytes_last_scalar(data, count);
+
+}
+
+// Fills a span of pixels in a mask or appends it to runs (or both), returns the number of pixels
+static int fill_span(char* mask, region_runs* runs, int width, int row, int from, int to) {
+
+	if (to < from) return 0;
+
+	if (mask) memset(mask + row * width + from, 1, to - from + 1);
+	if (runs) runs_append(runs, row, from, to);
+
+	return to - from + 1;
+
+}
+
+static int rasterize_polygon_fill(const region_polygon polygon_input, char* mask, region_runs* runs, int width, int height);
+
 int rasterize_polygon(const region_polygon polygon_input, char* mask, int width, int height) {
 
+	return rasterize_polygon_fill(polygon_input, mask, NULL, width, height);
+
+}
+
+// Rasterizes a polygon into a mask or into runs
+static int rasterize_polygon_fill(const region_polygon polygon_input, char* mask, region_runs* runs, int width, int height) {
+
 	int nodes, pixelY, i, j, swap;
 	int sum = 0;
 	region_polygon polygon = polygon_input;
@@ -916,10 +1522,7 @@ int rasterize_polygon(const region_polygon polygon_input, char* mask, int width,
 				if (nodeX[i + 1] > 0 ) {
 					if (nodeX[i] < 0 ) nodeX[i] = 0;
 					if (nodeX[i + 1] > width) nodeX[i + 1] = width - 1;
-					for (j = nodeX[i]; j < nodeX[i + 1]; j++) {
-						if (mask) mask[pixelY * width + j] = 1;
-						sum++;
-					}
+					sum += fill_span(mask, runs, width, pixelY, nodeX[i], nodeX[i + 1] - 1);
 				}
 			}
 		}
@@ -978,10 +1581,7 @@ int rasterize_polygon(const region_polygon polygon_input, char* mask, int width,
 				if (nodeX[i + 1] >= 0) {
 					if (nodeX[i] < 0) nodeX[i] = 0;
 					if (nodeX[i + 1] >= width) nodeX[i + 1] = width - 1;
-					for (j = nodeX[i]; j <= nodeX[i + 1]; j++) {
-						if (mask) mask[pixelY * width + j] = 1;
-						sum++;
-					}
+					sum += fill_span(mask, runs, width, pixelY, nodeX[i], nodeX[i + 1]);
 				}
 				i += 2;
 
@@ -997,22 +1597,242 @@ int rasterize_polygon(const region_polygon polygon_input, char* mask, int width,
 	return sum;
 }
 
+// Signed area of a polygon given by its vertices (shoelace formula)
+static double exact_area(const double* x, const double* y, int count) {
+
+	int i, j;
+	double area = 0;
+
+	for (i = 0, j = count - 1; i < count; j = i++)
+		area += x[j] * y[i] - x[i] * y[j];
+
+	return area / 2;
+
+}
+
+// Clips a polygon with a half-plane on the left side of the line through (ax, ay) and (bx, by)
+// (Sutherland-Hodgman), the output arrays have to hold twice the number of input vertices
+static int exact_clip(const double* x, const double* y, int count, double ax, double ay, double bx, double by, double* ox, double* oy) {
+
+	int i, j, result = 0;
+	double dx = bx - ax, dy = by - ay;
+
+	for (i = 0, j = count - 1; i < count; j = i++) {
+
+		double sj = dx * (y[j] - ay) - dy * (x[j] - ax);
+		double si = dx * (y[i] - ay) - dy * (x[i] - ax);
+
+		if ((si >= 0) != (sj >= 0)) {
+			double t = sj / (sj - si);
+			ox[result] = x[j] + t * (x[i] - x[j]);
+			oy[result] = y[j] + t * (y[i] - y[j]);
+			result++;
+		}
+
+		if (si >= 0) {
+			ox[result] = x[i];
+			oy[result] = y[i];
+			result++;
+		}
+
+	}
+
+	return result;
+
+}
+
+// Converts a polygon to double precision and clips it with the bounds, the degenerate edges that
+// clipping of a concave polygon can leave along the bounds do not change any of the areas
+static int exact_polygon(const region_polygon* polygon, region_bounds bounds, double** x, double** y) {
+
+	int i, count = polygon->count;
+	double *tx, *ty;
+	double limits[4][4];
+	int sides = 0;
+
+	*x = (double*) malloc(sizeof(double) * count);
+	*y = (double*) malloc(sizeof(double) * count);
+
+	for (i = 0; i < count; i++) {
+		(*x)[i] = polygon->x[i];
+		(*y)[i] = polygon->y[i];
+	}
+
+	// Lines that keep the inside on their left side, sides without bounds are skipped
+	if (bounds.left > -FLT_MAX) { limits[sides][0] = bounds.left; limits[sides][1] = 1; limits[sides][2] = bounds.left; limits[sides][3] = 0; sides++; }
+	if (bounds.top > -FLT_MAX) { limits[sides][0] = 0; limits[sides][1] = bounds.top; limits[sides][2] = 1; limits[sides][3] = bounds.top; sides++; }
+	if (bounds.right < FLT_MAX) { limits[sides][0] = bounds.right; limits[sides][1] = 0; limits[sides][2] = bounds.right; limits[sides][3] = 1; sides++; }
+	if (bounds.bottom < FLT_MAX) { limits[sides][0] = 1; limits[sides][1] = bounds.bottom; limits[sides][2] = 0; limits[sides][3] = bounds.bottom; sides++; }
+
+	for (i = 0; i < sides && count > 0; i++) {
+		tx = (double*) malloc(sizeof(double) * count * 2);
+		ty = (double*) malloc(sizeof(double) * count * 2);
+		count = exact_clip(*x, *y, count, limits[i][0], limits[i][1], limits[i][2], limits[i][3], tx, ty);
+		free(*x); free(*y);
+		*x = tx; *y = ty;
+	}
+
+	return count;
+
+}
+
+// Area of intersection of two triangles, the vertices of the second one are in counter-clockwise order
+static double exact_triangle_intersection(const double* x1, const double* y1, const double* x2, const double* y2) {
+
+	int i, j, count = 3;
+	double ax[12], ay[12], bx[12], by[12];
+
+	memcpy(ax, x1, sizeof(double) * 3);
+	memcpy(ay, y1, sizeof(double) * 3);
+
+	for (i = 0, j = 2; i < 3 && count > 0; j = i++) {
+		count = exact_clip(ax, ay, count, x2[j], y2[j], x2[i], y2[i], bx, by);
+		memcpy(ax, bx, sizeof(double) * count);
+		memcpy(ay, by, sizeof(double) * count);
+	}
+
+	return count > 2 ? fabs(exact_area(ax, ay, count)) : 0;
+
+}
+
+// Area of intersection of two polygons. Both polygons are split into triangles that share a common
+// apex, the signed areas of intersections of all pairs of triangles sum up to the intersection as
+// the parts of triangles that lie outside of a polygon cancel out.
+static double exact_intersection(const double* x1, const double* y1, int count1, const double* x2, const double* y2, int count2) {
+
+	int i, j, k, l;
+	double ox = 0, oy = 0, sum = 0;
+	double tx1[3], ty1[3], tx2[3], ty2[3];
+
+	for (i = 0; i < count1; i++) {
+		ox += x1[i] / count1;
+		oy += y1[i] / count1;
+	}
+
+	tx1[0] = tx2[0] = ox;
+	ty1[0] = ty2[0] = oy;
+
+	for (i = 0, j = count1 - 1; i < count1; j = i++) {
+
+		double s1;
+
+		tx1[1] = x1[j]; ty1[1] = y1[j]; tx1[2] = x1[i]; ty1[2] = y1[i];
+		s1 = exact_area(tx1, ty1, 3);
+
+		if (s1 == 0) continue;
+
+		for (k = 0, l = count2 - 1; k < count2; l = k++) {
+
+			double s2;
+
+			tx2[1] = x2[l]; ty2[1] = y2[l]; tx2[2] = x2[k]; ty2[2] = y2[k];
+			s2 = exact_area(tx2, ty2, 3);
+
+			if (s2 == 0) continue;
+
+			if (s2 < 0) {
+				tx2[1] = x2[k]; ty2[1] = y2[k]; tx2[2] = x2[l]; ty2[2] = y2[l];
+			}
+
+			sum += ((s1 > 0) == (s2 > 0) ? 1 : -1) * exact_triangle_intersection(tx1, ty1, tx2, ty2);
+
+		}
+
+	}
+
+	// The sum is oriented by the orientation of both polygons
+	if ((exact_area(x1, y1, count1) < 0) != (exact_area(x2, y2, count2) < 0))
+		sum = -sum;
+
+	return MAX(0, sum);
+
+}
+
+static region_overlap compute_exact_overlap(const region_polygon* p1, const region_polygon* p2, region_bounds bounds) {
+
+	int count1, count2;
+	double *x1, *y1, *x2, *y2;
+	double a1, a2, intersection, total;
+	region_overlap overlap;
+
+	overlap.overlap = 0;
+	overlap.only1 = 0;
+	overlap.only2 = 0;
+
+	count1 = exact_polygon(p1, bounds, &x1, &y1);
+	count2 = exact_polygon(p2, bounds, &x2, &y2);
+
+	a1 = count1 > 2 ? fabs(exact_area(x1, y1, count1)) : 0;
+	a2 = count2 > 2 ? fabs(exact_area(x2, y2, count2)) : 0;
+
+	intersection = (a1 > 0 && a2 > 0) ? MIN(MIN(a1, a2), exact_intersection(x1, y1, count1, x2, y2, count2)) : 0;
+
+	total = a1 + a2 - intersection;
+
+	if (total > 0) {
+		overlap.overlap = (float) (intersection / total);
+		overlap.only1 = (float) ((a1 - intersection) / total);
+		overlap.only2 = (float) ((a2 - intersection) / total);
+	}
+
+	free(x1); free(y1);
+	free(x2); free(y2);
+
+	return overlap;
+
+}
+
+// Returns a polygon view of a rectangle or polygon region without copying the polygon, the corners
+// of a rectangle are stored in the given arrays
+static int exact_region_polygon(const region_container* region, region_polygon* polygon, float* x, float* y) {
+
+	if (region->type == POLYGON) {
+		*polygon = region->data.polygon;
+		return 1;
+	}
+
+	if (region->type != RECTANGLE) return 0;
+
+	x[0] = x[3] = region->data.rectangle.x;
+	x[1] = x[2] = region->data.rectangle.x + region->data.rectangle.width;
+	y[0] = y[1] = region->data.rectangle.y;
+	y[2] = y[3] = region->data.rectangle.y + region->data.rectangle.height;
+
+	polygon->count = 4;
+	polygon->x = x;
+	polygon->y = y;
+
+	return 1;
+
+}
+
 float compute_polygon_overlap(const region_polygon* p1, const region_polygon* p2, float *only1, float *only2, region_bounds bounds) {
 
-	int i;
 	int vol_1 = 0;
 	int vol_2 = 0;
 	int mask_1 = 0;
 	int mask_2 = 0;
 	int mask_intersect = 0;
-	char* mask1 = NULL;
-	char* mask2 = NULL;
+	region_runs* runs1;
+	region_runs* runs2;
 	double a1, a2;
 	float x, y;
 	int width, height;
 	region_polygon op1, op2;
 	region_bounds b1, b2;
 
+	if (__flags & REGION_EXACT_OVERLAP) {
+		region_overlap overlap = compute_exact_overlap(p1, p2, bounds);
+
+		if (only1)
+			(*only1) = overlap.only1;
+
+		if (only2)
+			(*only2) = overlap.only2;
+
+		return overlap.overlap;
+	}
+
 	if (__flags & REGION_LEGACY_RASTERIZATION) {
 		b1 = bounds_intersection(compute_bounds_polygon(p1), bounds);
 		b2 = bounds_intersection(compute_bounds_polygon(p2), bounds);
@@ -1063,28 +1883,25 @@ float compute_polygon_overlap(const region_polygon* p1, const region_polygon* p2
 
 	}
 
-	mask1 = (char*) malloc(sizeof(char) * width * height);
-	mask2 = (char*) malloc(sizeof(char) * width * height);
+	runs1 = runs_create(height);
+	runs2 = runs_create(height);
 
 	op1 = offset_polygon(*p1, -x, -y);
 	op2 = offset_polygon(*p2, -x, -y);
 
-	rasterize_polygon(op1, mask1, width, height);
-	rasterize_polygon(op2, mask2, width, height);
+	rasterize_polygon_fill(op1, NULL, runs1, width, height);
+	rasterize_polygon_fill(op2, NULL, runs2, width, height);
 
-	for (i = 0; i < width * height; i++) {
-		if (mask1[i]) vol_1++;
-		if (mask2[i]) vol_2++;
-		if (mask1[i] && mask2[i]) mask_intersect++;
-		else if (mask1[i]) mask_1++;
-		else if (mask2[i]) mask_2++;
-	}
+	runs_finish(runs1);
+	runs_finish(runs2);
+
+	runs_overlap(runs1, runs2, &mask_1, &mask_2, &mask_intersect);
 
 	free_polygon(&op1);
 	free_polygon(&op2);
 
-	free(mask1);
-	free(mask2);
+	runs_destroy(runs1);
+	runs_destroy(runs2);
 
 	if (only1)
 		(*only1) = (float) mask_1 / (float) (mask_1 + mask_2 + mask_intersect);
@@ -1096,6 +1913,160 @@ float compute_polygon_overlap(const region_polygon* p1, const region_polygon* p2
 
 }
 
+static int rectangle_span(const region_rectangle* rectangle, int x, int y, int width, int height, int* span);
+
+static int span_area(const int* span);
+
+// Same as region_get_mask_offset for a mask region, but the window is written to a cleared bit mask
+static void region_get_bits_offset(const region_container* r, uint64_t* bits, int x, int y, int width, int height) {
+
+	int i;
+
+	int tx = MAX((r->data.mask).x, x);
+	int ty = MAX((r->data.mask).y, y);
+
+	int gx = tx - (r->data.mask).x;
+	int gy = ty - (r->data.mask).y;
+
+	int tw = MIN(x + width, (r->data.mask).x + (r->data.mask).width) - tx;
+	int th = MIN(y + height, (r->data.mask).y + (r->data.mask).height) - ty;
+
+	for (i = 0; i < th && tw > 0; i++) {
+		bits_pack(bits + (size_t) (i + ty - y) * BITS_WORDS(width), tx - x,
+		          &((r->data.mask).data[gx + (i + gy) * (r->data.mask).width]), tw);
+	}
+
+}
+
+// Same as region_get_mask_offset for a rectangle or a polygon, but the window is rasterized into runs
+static region_runs* region_get_runs_offset(const region_container* r, int x, int y, int width, int height) {
+
+	int i, span[4];
+	region_polygon p;
+	region_runs* runs = runs_create(height);
+
+	if (r->type == RECTANGLE && rectangle_span(&(r->data.rectangle), x, y, width, height, span)) {
+		for (i = span[1]; i <= span[3] && span[0] <= span[2]; i++)
+			runs_append(runs, i, span[0], span[2]);
+		runs_finish(runs);
+		return runs;
+	}
+
+	if (r->type == RECTANGLE) {
+		region_container* t = region_convert(r, POLYGON);
+		p = offset_polygon(t->data.polygon, -x, -y);
+		region_release(&t);
+	} else {
+		p = offset_polygon(r->data.polygon, -x, -y);
+	}
+
+	rasterize_polygon_fill(p, NULL, runs, width, height);
+	runs_finish(runs);
+
+	free_polygon(&p);
+
+	return runs;
+
+}
+
+// Counts the pixels of a region in a window
+static int region_count_window(const region_container* r, int x, int y, int width, int height) {
+
+	int count;
+
+	if (width < 1 || height < 1) return 0;
+
+	if (r->type == MASK) {
+		uint64_t* bits = bits_create(width, height);
+		region_get_bits_offset(r, bits, x, y, width, height);
+		count = bits_count(bits, BITS_WORDS(width) * height);
+		free(bits);
+	} else {
+		region_runs* runs = region_get_runs_offset(r, x, y, width, height);
+		count = runs_area(runs);
+		runs_destroy(runs);
+	}
+
+	return count;
+
+}
+
+// Pixels of a window that a rectangle covers when it is rasterized, the span (left, top, right, bottom)
+// is inclusive and may be empty. The arithmetic follows region_get_mask_offset and rasterize_polygon
+// step by step so that the result is the same. Returns 0 if the rectangle is degenerate (or too large)
+// and has to be rasterized instead.
+static int rectangle_span(const region_rectangle* rectangle, int x, int y, int width, int height, int* span) {
+
+	float x0, y0, x1, y1;
+
+	if (isnan(rectangle->x) || isnan(rectangle->y) || isnan(rectangle->width) || isnan(rectangle->height) ||
+	        isinf(rectangle->x) || isinf(rectangle->y) || isinf(rectangle->width) || isinf(rectangle->height))
+		return 0;
+
+	if (fabs(rectangle->x) + fabs(rectangle->width) > 1e8 || fabs(rectangle->y) + fabs(rectangle->height) > 1e8)
+		return 0;
+
+	if (__flags & REGION_LEGACY_RASTERIZATION) {
+
+		int n0, n1;
+
+		x0 = rectangle->x; x0 += (float) -x;
+		x1 = rectangle->x + rectangle->width; x1 += (float) -x;
+		y0 = rectangle->y; y0 += (float) -y;
+		y1 = rectangle->y + rectangle->height; y1 += (float) -y;
+
+		if (!(x0 < x1) || !(y0 < y1)) return 0;
+
+		// Rows strictly below the top edge up to the bottom edge, columns up to the right edge
+		n0 = (int) x0;
+		n1 = (int) x1;
+
+		span[1] = MAX(0, (int) floor(y0) + 1);
+		span[3] = MIN(height - 1, (int) floor(y1));
+
+		if (n0 >= width || n1 <= 0) {
+			span[0] = 0; span[2] = -1;
+		} else {
+			span[0] = MAX(0, n0);
+			span[2] = ((n1 > width) ? width - 1 : n1) - 1;
+		}
+
+	} else {
+
+		x0 = rectangle->x; x0 += (float) -x;
+		x1 = rectangle->x + rectangle->width - 1; x1 += (float) -x;
+		y0 = rectangle->y; y0 += (float) -y;
+		y1 = rectangle->y + rectangle->height - 1; y1 += (float) -y;
+
+		x0 = round(x0); x1 = round(x1);
+		y0 = round(y0); y1 = round(y1);
+
+		if (!((int) x0 < (int) x1) || !((int) y0 < (int) y1)) return 0;
+
+		span[1] = MAX(0, (int) y0);
+		span[3] = MIN(height - 1, (int) y1);
+
+		if ((int) x0 >= width || (int) x1 < 0) {
+			span[0] = 0; span[2] = -1;
+		} else {
+			span[0] = MAX(0, (int) x0);
+			span[2] = MIN(width - 1, (int) x1);
+		}
+
+	}
+
+	return 1;
+
+}
+
+static int span_area(const int* span) {
+
+	if (span[2] < span[0] || span[3] < span[1]) return 0;
+
+	return (span[2] - span[0] + 1) * (span[3] - span[1] + 1);
+
+}
+
 #define COPY_POLYGON(TP, P) { P.count = TP->data.polygon.count; P.x = TP->data.polygon.x; P.y = TP->data.polygon.y; }
 
 region_overlap region_compute_overlap(const region_container* ra, const region_container* rb, region_bounds bounds) {
@@ -1109,14 +2080,22 @@ region_overlap region_compute_overlap(const region_container* ra, const region_c
 	int mask_1 = 0;
 	int mask_2 = 0;
 	int mask_intersect = 0;
+	int span1[4], span2[4];
+	int valid1, valid2;
 
-	region_container* ta = NULL;
-	region_container* tb = NULL;
 	region_overlap overlap;
 	overlap.overlap = 0;
 	overlap.only1 = 0;
 	overlap.only2 = 0;
 
+	if (__flags & REGION_EXACT_OVERLAP) {
+		region_polygon p1, p2;
+		float x1[4], y1[4], x2[4], y2[4];
+
+		// Masks are still rasterized, the exact area is only known for rectangles and polygons
+		if (exact_region_polygon(ra, &p1, x1, y1) && exact_region_polygon(rb, &p2, x2, y2))
+			return compute_exact_overlap(&p1, &p2, bounds);
+	}
 
 	if (__flags & REGION_LEGACY_RASTERIZATION) {
 		b1 = bounds_intersection(region_compute_bounds(ra), bounds);
@@ -1142,49 +2121,66 @@ region_overlap region_compute_overlap(const region_container* ra, const region_c
 	if (a1 / a2 < 1e-10 || a2 / a1 < 1e-10 || width < 1 || height < 1) 
 		return overlap;
 
-	if (bounds_overlap(b1, b2) == 0) {
-
-		int i;
-
-		ta = region_create_mask(b1.left, b1.top, b1.right - b1.left + 1, b1.bottom - b1.top + 1);
-		tb = region_create_mask(b2.left, b2.top, b2.right - b2.left + 1, b2.bottom - b2.top + 1);
+	// Rectangles that are not degenerate do not have to be rasterized in the common window
+	valid1 = ra->type == RECTANGLE && rectangle_span(&(ra->data.rectangle), x, y, width, height, span1);
+	valid2 = rb->type == RECTANGLE && rectangle_span(&(rb->data.rectangle), x, y, width, height, span2);
 
-		region_get_mask_offset(ra, ta->data.mask.data, b1.left, b1.top, b1.right - b1.left + 1, b1.bottom - b1.top + 1);
-		region_get_mask_offset(rb, tb->data.mask.data, b2.left, b2.top, b2.right - b2.left + 1, b2.bottom - b2.top + 1);
-
-		for (i = 0; i < (b1.right - b1.left + 1) * (b1.bottom - b1.top + 1); i++) {
-			if (ta->data.mask.data[i]) vol_1++;
-		}
+	if (bounds_overlap(b1, b2) == 0) {
 
-		for (i = 0; i < (b2.right - b2.left + 1) * (b2.bottom - b2.top + 1); i++) {
-			if (tb->data.mask.data[i]) vol_2++;
-		}
+		// Both regions are counted in their own windows
+		vol_1 = region_count_window(ra, (int) b1.left, (int) b1.top, (int) (b1.right - b1.left + 1), (int) (b1.bottom - b1.top + 1));
+		vol_2 = region_count_window(rb, (int) b2.left, (int) b2.top, (int) (b2.right - b2.left + 1), (int) (b2.bottom - b2.top + 1));
 
 		overlap.only1 = (float) vol_1 / (float) (vol_1 + vol_2);
 		overlap.only2 = (float) vol_2 / (float) (vol_1 + vol_2);
 
 	} else {
 
-		int i;
-		char* mask1;
-		char* mask2;
-
-		ta = region_create_mask(x, y, width, height);
-		tb = region_create_mask(x, y, width, height);
-
-		mask1 = ta->data.mask.data;
-		mask2 = tb->data.mask.data;
-
-		region_get_mask_offset(ra, ta->data.mask.data, x, y, width, height);
-		region_get_mask_offset(rb, tb->data.mask.data, x, y, width, height);
+		if (valid1 && valid2) {
+			// Both rectangles cover a span of pixels, so does their intersection
+			int intersection[4];
+			intersection[0] = MAX(span1[0], span2[0]);
+			intersection[1] = MAX(span1[1], span2[1]);
+			intersection[2] = MIN(span1[2], span2[2]);
+			intersection[3] = MIN(span1[3], span2[3]);
+
+			mask_intersect = span_area(intersection);
+			mask_1 = span_area(span1) - mask_intersect;
+			mask_2 = span_area(span2) - mask_intersect;
+		} else if (ra->type == MASK && rb->type == MASK) {
+			// Masks are stored densely anyway, they are compared as bit masks
+			uint64_t* bits1 = bits_create(width, height);
+			uint64_t* bits2 = bits_create(width, height);
+
+			region_get_bits_offset(ra, bits1, x, y, width, height);
+			region_get_bits_offset(rb, bits2, x, y, width, height);
+
+			bits_overlap(bits1, bits2, BITS_WORDS(width) * height, &mask_1, &mask_2, &mask_intersect);
+
+			free(bits1);
+			free(bits2);
+		} else if (ra->type == MASK || rb->type == MASK) {
+			// The other region is only rasterized into runs, the mask is counted within them
+			uint64_t* bits = bits_create(width, height);
+			region_runs* runs = region_get_runs_offset(ra->type == MASK ? rb : ra, x, y, width, height);
+
+			region_get_bits_offset(ra->type == MASK ? ra : rb, bits, x, y, width, height);
+
+			if (ra->type == MASK)
+				runs_bits_overlap(runs, bits, width, &mask_2, &mask_1, &mask_intersect);
+			else
+				runs_bits_overlap(runs, bits, width, &mask_1, &mask_2, &mask_intersect);
+
+			free(bits);
+			runs_destroy(runs);
+		} else {
+			region_runs* runs1 = region_get_runs_offset(ra, x, y, width, height);
+			region_runs* runs2 = region_get_runs_offset(rb, x, y, width, height);
 
+			runs_overlap(runs1, runs2, &mask_1, &mask_2, &mask_intersect);
 
-		for (i = 0; i < width * height; i++) {
-			if (mask1[i]) vol_1++;
-			if (mask2[i]) vol_2++;
-			if (mask1[i] && mask2[i]) mask_intersect++;
-			else if (mask1[i]) mask_1++;
-			else if (mask2[i]) mask_2++;
+			runs_destroy(runs1);
+			runs_destroy(runs2);
 		}
 
 		overlap.only1 = (float) mask_1 / (float) (mask_1 + mask_2 + mask_intersect);
@@ -1193,9 +2189,6 @@ region_overlap region_compute_overlap(const region_container* ra, const region_c
 
 	}
 
-	if (ta) region_release(&ta);
-	if (tb) region_release(&tb);
-
 	return overlap;
 
 }
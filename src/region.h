@@ -38,6 +38,10 @@
 #define TRAX_DEFAULT_CODE 0
 
 #define REGION_LEGACY_RASTERIZATION 1
+// Overlap of rectangles and polygons is computed from their exact areas instead of rasterization
+#define REGION_EXACT_OVERLAP 2
+// Masks are counted with plain C loops even if the processor supports vector instructions
+#define REGION_SCALAR_KERNELS 4
 
 #ifdef __cplusplus
 extern "C" {
@@ -0,0 +1,393 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4; tab-width: 4 -*- */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "shared.h"
+#include "debug.h"
+
+#if defined(__OS2__) || defined(__WINDOWS__) || defined(WIN32) || defined(WIN64) || defined(_MSC_VER)
+
+#define SHARED_DISABLED
+
+#else
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#endif
+
+static int segment_counter = 0;
+
+int shared_supported() {
+#ifdef SHARED_DISABLED
+    return 0;
+#else
+    return 1;
+#endif
+}
+
+static void segment_unmap(shared_segment* segment) {
+
+#ifndef SHARED_DISABLED
+    if (segment->data) munmap(segment->data, segment->size);
+    if (segment->owner) shm_unlink(segment->name);
+    if (segment->descriptor >= 0) close(segment->descriptor);
+#endif
+
+    free(segment);
+
+}
+
+static shared_segment* segment_create(int size) {
+
+#ifdef SHARED_DISABLED
+    return NULL;
+#else
+    int fd = -1, attempt;
+    shared_segment* segment = (shared_segment*) malloc(sizeof(shared_segment));
+
+    memset(segment, 0, sizeof(shared_segment));
+    segment->descriptor = -1;
+
+    for (attempt = 0; attempt < 16 && fd < 0; attempt++) {
+        snprintf(segment->name, SHARED_NAME_LENGTH, "/trax.%d.%d", (int) getpid(), segment_counter++);
+        fd = shm_open(segment->name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+        if (fd < 0 && errno != EEXIST) break;
+    }
+
+    if (fd < 0) {
+        DEBUGMSG("Unable to create shared memory segment\n");
+        free(segment);
+        return NULL;
+    }
+
+    if (ftruncate(fd, size) != 0) {
+        close(fd);
+        shm_unlink(segment->name);
+        free(segment);
+        return NULL;
+    }
+
+    segment->data = (char*) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (segment->data == MAP_FAILED) {
+        shm_unlink(segment->name);
+        free(segment);
+        return NULL;
+    }
+
+    segment->size = size;
+    segment->owner = 1;
+
+    return segment;
+#endif
+
+}
+
+static shared_segment* segment_open(const char* name) {
+
+#ifdef SHARED_DISABLED
+    return NULL;
+#else
+    int fd;
+    struct stat status;
+    shared_segment* segment;
+
+    if (strlen(name) >= SHARED_NAME_LENGTH) return NULL;
+
+    fd = shm_open(name, O_RDONLY, 0);
+
+    if (fd < 0) return NULL;
+
+    if (fstat(fd, &status) != 0 || status.st_size < 1) {
+        close(fd);
+        return NULL;
+    }
+
+    segment = (shared_segment*) malloc(sizeof(shared_segment));
+    memset(segment, 0, sizeof(shared_segment));
+    segment->descriptor = -1;
+    strcpy(segment->name, name);
+
+    segment->size = (int) status.st_size;
+    segment->data = (char*) mmap(NULL, segment->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (segment->data == MAP_FAILED) {
+        free(segment);
+        return NULL;
+    }
+
+    return segment;
+#endif
+
+}
+
+shared_segment* shared_segment_map(int descriptor, int size, int private_copy) {
+
+#ifdef SHARED_DISABLED
+    return NULL;
+#else
+    shared_segment* segment;
+    char* data;
+
+    if (size < 1) return NULL;
+
+    if (private_copy)
+        data = (char*) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, descriptor, 0);
+    else
+        data = (char*) mmap(NULL, size, PROT_READ, MAP_SHARED, descriptor, 0);
+
+    if (data == MAP_FAILED) return NULL;
+
+    segment = (shared_segment*) malloc(sizeof(shared_segment));
+    memset(segment, 0, sizeof(shared_segment));
+
+    segment->data = data;
+    segment->size = size;
+    segment->descriptor = descriptor;
+    // Nobody else keeps the segment, it is unmapped when the last image is released
+    segment->retired = 1;
+
+    return segment;
+#endif
+
+}
+
+int shared_descriptor_size(int descriptor) {
+
+#ifdef SHARED_DISABLED
+    return -1;
+#else
+    struct stat status;
+
+    if (fstat(descriptor, &status) != 0) return -1;
+
+    return (int) status.st_size;
+#endif
+
+}
+
+int shared_descriptor_duplicate(int descriptor) {
+
+#ifdef SHARED_DISABLED
+    return -1;
+#else
+    return fcntl(descriptor, F_DUPFD_CLOEXEC, 0);
+#endif
+
+}
+
+int shared_descriptor_open(const char* path) {
+
+#ifdef SHARED_DISABLED
+    return -1;
+#else
+    return open(path, O_RDONLY | O_CLOEXEC);
+#endif
+
+}
+
+void shared_descriptor_close(int descriptor) {
+
+#ifndef SHARED_DISABLED
+    close(descriptor);
+#endif
+
+}
+
+// Releases the segment immediately if no image is using it or defers it to the last image
+static void segment_retire(shared_segment* segment) {
+
+    segment->retired = 1;
+
+    if (segment->references < 1)
+        segment_unmap(segment);
+
+}
+
+shared_context* shared_context_create() {
+
+    shared_context* context = (shared_context*) malloc(sizeof(shared_context));
+
+    memset(context, 0, sizeof(shared_context));
+
+    return context;
+
+}
+
+// Releases the oldest pending slot of a ring
+static void ring_release(shared_ring* ring) {
+
+    shared_segment* segment = ring->pending[0];
+
+    ring->count--;
+    memmove(ring->pending, ring->pending + 1, sizeof(shared_segment*) * ring->count);
+    memmove(ring->frames, ring->frames + 1, sizeof(int) * ring->count);
+
+    shared_segment_dereference(segment);
+
+}
+
+void shared_context_destroy(shared_context** context) {
+
+    int i;
+    shared_segment* segment;
+
+    if (!*context) return;
+
+    for (i = 0; i < TRAX_CHANNELS; i++) {
+        while ((*context)->rings[i].count > 0)
+            ring_release(&((*context)->rings[i]));
+        if ((*context)->rings[i].segment)
+            segment_retire((*context)->rings[i].segment);
+    }
+
+    segment = (*context)->mapped;
+
+    while (segment) {
+        shared_segment* next = segment->next;
+        segment_retire(segment);
+        segment = next;
+    }
+
+    free(*context);
+    *context = NULL;
+
+}
+
+shared_segment* shared_ring_acquire(shared_context* context, int channel, int size, int* offset) {
+
+    shared_ring* ring;
+
+    assert(channel >= 0 && channel < TRAX_CHANNELS);
+
+    ring = &(context->rings[channel]);
+
+    // Slots are reused in order, the next one is still in use if all of them are pending
+    if (ring->count >= SHARED_SLOTS) return NULL;
+
+    if (!ring->segment || ring->slot_size < size) {
+
+        // Slots are page aligned so that the reader can map them efficiently
+        int slot_size = ((size + 4095) / 4096) * 4096;
+
+        if (ring->segment) {
+            segment_retire(ring->segment);
+            ring->segment = NULL;
+        }
+
+        ring->segment = segment_create(slot_size * SHARED_SLOTS);
+
+        if (!ring->segment) return NULL;
+
+        ring->slot_size = slot_size;
+        ring->slot = 0;
+
+    }
+
+    *offset = ring->slot * ring->slot_size;
+    ring->slot = (ring->slot + 1) % SHARED_SLOTS;
+
+    shared_segment_reference(ring->segment);
+    ring->pending[ring->count] = ring->segment;
+    ring->frames[ring->count] = context->sent;
+    ring->count++;
+
+    return ring->segment;
+
+}
+
+void shared_context_sent(shared_context* context) {
+
+    context->sent++;
+
+}
+
+void shared_context_acknowledge(shared_context* context) {
+
+    int i;
+
+    if (context->acknowledged >= context->sent) return;
+
+    for (i = 0; i < TRAX_CHANNELS; i++) {
+        shared_ring* ring = &(context->rings[i]);
+        while (ring->count > 0 && ring->frames[0] <= context->acknowledged)
+            ring_release(ring);
+    }
+
+    context->acknowledged++;
+
+}
+
+// Removes a segment from the list of mapped segments and releases it once no image is using it
+static void context_unmap(shared_context* context, shared_segment* segment) {
+
+    int i;
+    shared_segment** link = &(context->mapped);
+
+    for (i = 0; i < TRAX_CHANNELS; i++) {
+        if (context->channels[i] == segment) context->channels[i] = NULL;
+    }
+
+    while (*link && *link != segment)
+        link = &((*link)->next);
+
+    if (*link) *link = segment->next;
+
+    segment_retire(segment);
+
+}
+
+shared_segment* shared_context_map(shared_context* context, int channel, const char* name) {
+
+    shared_segment* segment = context->mapped;
+
+    assert(channel >= 0 && channel < TRAX_CHANNELS);
+
+    while (segment) {
+        if (strcmp(segment->name, name) == 0) break;
+        segment = segment->next;
+    }
+
+    if (!segment) {
+
+        segment = segment_open(name);
+
+        if (!segment) return NULL;
+
+        segment->next = context->mapped;
+        context->mapped = segment;
+
+    }
+
+    // The client replaces the segment of a channel when the frames grow, the old one is not used again
+    if (context->channels[channel] && context->channels[channel] != segment)
+        context_unmap(context, context->channels[channel]);
+
+    context->channels[channel] = segment;
+
+    return segment;
+
+}
+
+void shared_segment_reference(shared_segment* segment) {
+
+    segment->references++;
+
+}
+
+void shared_segment_dereference(shared_segment* segment) {
+
+    segment->references--;
+
+    if (segment->retired && segment->references < 1)
+        segment_unmap(segment);
+
+}
@@ -0,0 +1,104 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4; tab-width: 4 -*- */
+
+#ifndef _SHARED_H_
+#define _SHARED_H_
+
+#include "trax.h"
+
+// Number of frames that can be written to a channel before a slot is reused
+#define SHARED_SLOTS 4
+#define SHARED_NAME_LENGTH 64
+
+typedef struct shared_segment {
+    char name[SHARED_NAME_LENGTH];
+    char* data;
+    int size;
+    int owner;
+    int descriptor;
+    int references;
+    int retired;
+    struct shared_segment* next;
+} shared_segment;
+
+/**
+ * Slots of a ring that were written and not yet acknowledged, oldest first. Every slot keeps a reference
+ * to its segment, so a replaced segment is only released once the server has answered all its frames.
+**/
+typedef struct shared_ring {
+    shared_segment* segment;
+    int slot_size;
+    int slot;
+    shared_segment* pending[SHARED_SLOTS];
+    int frames[SHARED_SLOTS];
+    int count;
+} shared_ring;
+
+/**
+ * Shared memory state of a handle. The client writes frames to a ring of slots
+ * for each channel and counts the frames that were sent and acknowledged, the
+ * server keeps the segments it has mapped and the last segment of each channel.
+**/
+typedef struct shared_context {
+    shared_ring rings[TRAX_CHANNELS];
+    int sent;
+    int acknowledged;
+    shared_segment* mapped;
+    shared_segment* channels[TRAX_CHANNELS];
+} shared_context;
+
+int shared_supported();
+
+shared_context* shared_context_create();
+
+void shared_context_destroy(shared_context** context);
+
+/**
+ * Returns the segment and the offset of the next free slot of a channel ring that can hold the given
+ * number of bytes for the frame that is being sent. Returns NULL if the memory is not available or if
+ * all slots still hold frames that were not acknowledged.
+**/
+shared_segment* shared_ring_acquire(shared_context* context, int channel, int size, int* offset);
+
+/**
+ * Marks the end of a frame, the slots acquired since the previous call belong to it.
+**/
+void shared_context_sent(shared_context* context);
+
+/**
+ * Releases the slots of the oldest frame that was not acknowledged, replies arrive in the order of frames.
+**/
+void shared_context_acknowledge(shared_context* context);
+
+/**
+ * Returns a read-only mapping of a named segment for a channel, the mapping is cached in the context.
+ * When a new segment arrives on a channel, the previous segment of the channel is released as soon as
+ * no image is using it.
+**/
+shared_segment* shared_context_map(shared_context* context, int channel, const char* name);
+
+/**
+ * Maps a file descriptor as a standalone segment that is released together with its last reference,
+ * the segment takes ownership of the descriptor. A private mapping is a writable copy-on-write view
+ * of the data, otherwise the data is shared and read-only.
+**/
+shared_segment* shared_segment_map(int descriptor, int size, int private_copy);
+
+/**
+ * Returns the size of the file behind a descriptor or -1 if it cannot be determined.
+**/
+int shared_descriptor_size(int descriptor);
+
+int shared_descriptor_duplicate(int descriptor);
+
+/**
+ * Opens a file for reading, returns -1 if the file cannot be opened or if descriptors are not supported.
+**/
+int shared_descriptor_open(const char* path);
+
+void shared_descriptor_close(int descriptor);
+
+void shared_segment_reference(shared_segment* segment);
+
+void shared_segment_dereference(shared_segment* segment);
+
+#endif
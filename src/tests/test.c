@@ -4,6 +4,8 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <math.h>
+#include <stdlib.h>
+#include <time.h>
 
 #include "trax.h"
 #include "message.h"
@@ -18,6 +20,12 @@
 
 #endif
 
+void copy_property(const char *key, const char *value, const void *obj) {
+
+    trax_properties_set((trax_properties*) obj, key, value);
+
+}
+
 void print_raster(char* raster, int x, int y, int width, int height) {
 
     int i, j;
@@ -54,7 +62,6 @@ int main( int argc, char** argv) {
 
     if (strcmpi(argv[1], "parsing") == 0) {
 
-        string_list *arguments;
         trax_properties* properties;
         int input;
         int output = fileno(stdout);
@@ -63,7 +70,6 @@ int main( int argc, char** argv) {
 
         input = open(argv[2], O_RDONLY);
 
-        arguments = list_create(8);
         properties = trax_properties_create();
 
         message_stream* stream = create_message_stream_file(input, output);
@@ -72,20 +78,20 @@ int main( int argc, char** argv) {
 
             int type;
 
-            list_reset(arguments);
             trax_properties_clear(properties);
 
-            type = read_message(stream, NULL, arguments, properties);
+            type = read_message(stream, NULL);
 
             if (type == TRAX_ERROR) break;
 
-            write_message(stream, NULL, type, arguments, properties); 
+            message_enumerate_properties(stream, copy_property, properties);
+
+            write_message(stream, NULL, type, message_arguments(stream), properties); 
 
         }
 
         close(input);
 
-        list_destroy(&arguments);
         trax_properties_release(&properties);
 
         destroy_message_stream(&stream);
@@ -186,6 +192,56 @@ int main( int argc, char** argv) {
 
         region_release(&a);
         region_release(&b);
+    } else if (strcmpi(argv[1], "benchmark") == 0) {
+
+        // Times the overlap of two random masks and of a mask and a polygon, with vectorized and plain kernels
+        region_container* a, *b, *c;
+        int i, j, size, repeat;
+        clock_t start;
+        float overlap = 0;
+
+        size = argc > 2 ? atoi(argv[2]) : 1000;
+        repeat = argc > 3 ? atoi(argv[3]) : 100;
+
+        if (size < 1 || repeat < 1) return 0;
+
+        a = region_create_mask(0, 0, size, size);
+        b = region_create_mask(size / 10, size / 10, size, size);
+        region_parse("0,0,1,0,1,1,0,1", &c);
+
+        for (i = 0; i < size * size; i++) {
+            a->data.mask.data[i] = rand() % 2;
+            b->data.mask.data[i] = rand() % 3 == 0;
+        }
+
+        for (i = 0; i < c->data.polygon.count; i++) {
+            c->data.polygon.x[i] = c->data.polygon.x[i] * size + size / 2;
+            c->data.polygon.y[i] = c->data.polygon.y[i] * size + size / 2;
+        }
+
+        for (j = 0; j < 2; j++) {
+
+            if (j == 1) region_set_flags(REGION_SCALAR_KERNELS);
+
+            start = clock();
+            for (i = 0; i < repeat; i++)
+                overlap = region_compute_overlap(a, b, region_no_bounds).overlap;
+            fprintf(stdout, "%s kernels, mask and mask: %f (%.3f ms)\n", j ? "Scalar" : "Vector", overlap,
+                (double) (clock() - start) * 1000 / CLOCKS_PER_SEC / repeat);
+
+            start = clock();
+            for (i = 0; i < repeat; i++)
+                overlap = region_compute_overlap(a, c, region_no_bounds).overlap;
+            fprintf(stdout, "%s kernels, mask and polygon: %f (%.3f ms)\n", j ? "Scalar" : "Vector", overlap,
+                (double) (clock() - start) * 1000 / CLOCKS_PER_SEC / repeat);
+
+        }
+
+        region_clear_flags(REGION_SCALAR_KERNELS);
+
+        region_release(&a);
+        region_release(&b);
+        region_release(&c);
     }
 }
 
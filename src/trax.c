@@ -4,6 +4,7 @@
 #include <string.h>
 #include <assert.h>
 #include <float.h>
+#include <limits.h>
 
 #define _TRAX_BUILDING
 
@@ -13,6 +14,9 @@
 #include "buffer.h"
 #include "message.h"
 #include "base64.h"
+#include "shared.h"
+#include "pool.h"
+#include "delta.h"
 #include "debug.h"
 
 #define VALIDATE_HANDLE(H) assert(((H)->flags & TRAX_FLAG_VALID))
@@ -180,10 +184,110 @@ int decode_memory_format(char* name) {
     if (strcmpi(name, "gray16") == 0)
         return TRAX_IMAGE_MEMORY_GRAY16;
 
+    if (strcmpi(name, "bgr") == 0)
+        return TRAX_IMAGE_MEMORY_BGR;
+
+    if (strcmpi(name, "rgba") == 0)
+        return TRAX_IMAGE_MEMORY_RGBA;
+
+    if (strcmpi(name, "bgra") == 0)
+        return TRAX_IMAGE_MEMORY_BGRA;
+
+    if (strcmpi(name, "nv12") == 0)
+        return TRAX_IMAGE_MEMORY_NV12;
+
     return TRAX_IMAGE_MEMORY_ILLEGAL;
 
 }
 
+const char* encode_memory_format(int format) {
+
+    switch (format) {
+    case TRAX_IMAGE_MEMORY_RGB:
+        return "rgb";
+    case TRAX_IMAGE_MEMORY_GRAY8:
+        return "gray8";
+    case TRAX_IMAGE_MEMORY_GRAY16:
+        return "gray16";
+    case TRAX_IMAGE_MEMORY_BGR:
+        return "bgr";
+    case TRAX_IMAGE_MEMORY_RGBA:
+        return "rgba";
+    case TRAX_IMAGE_MEMORY_BGRA:
+        return "bgra";
+    case TRAX_IMAGE_MEMORY_NV12:
+        return "nv12";
+    }
+
+    return NULL;
+
+}
+
+// Number of bytes in a packed row of pixels, for NV12 this is also the size of a row of interleaved chroma samples
+static int memory_row_size(int width, int format) {
+
+    switch (format) {
+    case TRAX_IMAGE_MEMORY_GRAY8:
+    case TRAX_IMAGE_MEMORY_NV12:
+        return width;
+    case TRAX_IMAGE_MEMORY_GRAY16:
+        return width * 2;
+    case TRAX_IMAGE_MEMORY_RGB:
+    case TRAX_IMAGE_MEMORY_BGR:
+        return width * 3;
+    case TRAX_IMAGE_MEMORY_RGBA:
+    case TRAX_IMAGE_MEMORY_BGRA:
+        return width * 4;
+    }
+
+    return 0;
+
+}
+
+// Number of rows in the image data, the chroma plane of NV12 adds a row for every two rows of pixels
+static int memory_rows(int height, int format) {
+
+    return format == TRAX_IMAGE_MEMORY_NV12 ? height + height / 2 : height;
+
+}
+
+// Size of packed image data in bytes or -1 if the geometry is not valid for the format
+static int memory_size(int width, int height, int format) {
+
+    int row = memory_row_size(width, format);
+
+    if (width < 1 || height < 1 || row < 1) return -1;
+
+    // Chroma of NV12 is subsampled in both directions
+    if (format == TRAX_IMAGE_MEMORY_NV12 && ((width & 1) || (height & 1))) return -1;
+
+    if (memory_rows(height, format) > INT_MAX / row) return -1;
+
+    return row * memory_rows(height, format);
+
+}
+
+#define MEMORY_STRIDE(image) ((image)->stride > 0 ? (image)->stride : memory_row_size((image)->width, (image)->format))
+
+// Returns packed data of a memory image, strided rows are copied to a temporary buffer that has to be freed
+static const char* memory_packed(const trax_image* image, char** temporary) {
+
+    int i, row = memory_row_size(image->width, image->format);
+    int rows = memory_rows(image->height, image->format);
+
+    *temporary = NULL;
+
+    if (image->stride < 1 || image->stride == row) return image->data;
+
+    *temporary = (char*) malloc(sizeof(char) * row * rows);
+
+    for (i = 0; i < rows; i++)
+        memcpy(*temporary + i * row, image->data + i * image->stride, row);
+
+    return *temporary;
+
+}
+
 
 int compare_prefix(char* str, const char* prefix) {
     int i = 0;
@@ -261,20 +365,17 @@ char* image_encode(trax_image* image) {
     }
     case TRAX_IMAGE_MEMORY: {
         int offset = 0;
-        const char* format = image->format == TRAX_IMAGE_MEMORY_RGB ? "rgb" :
-                             image->format == TRAX_IMAGE_MEMORY_GRAY8 ? "gray8" :
-                             image->format == TRAX_IMAGE_MEMORY_GRAY16 ? "gray16" : NULL;
-        int depth = image->format == TRAX_IMAGE_MEMORY_RGB ? 1 :
-                    (image->format == TRAX_IMAGE_MEMORY_GRAY8 ? 1 :
-                     (image->format == TRAX_IMAGE_MEMORY_GRAY16 ? 2 : 0));
-        int channels = image->format == TRAX_IMAGE_MEMORY_RGB ? 3 : 1;
-        int length = (image->width * image->height * depth * channels);
+        char* temporary;
+        const char* format = encode_memory_format(image->format);
+        int length = memory_size(image->width, image->height, image->format);
         int encoded = base64encodelen(length);
         int header = snprintf(NULL, 0, "image:%d;%d;%s;", image->width, image->height, format);
+        const char* data = memory_packed(image, &temporary);
         assert(format);
         result = (char*) malloc(sizeof(char) * (encoded + header + 1));
         offset += sprintf(result, "image:%d;%d;%s;", image->width, image->height, format);
-        base64encode(result + offset, (unsigned char*)image->data, length);
+        base64encode(result + offset, (const unsigned char*) data, length);
+        if (temporary) free(temporary);
         break;
     }
     case TRAX_IMAGE_BUFFER: {
@@ -297,7 +398,34 @@ char* image_encode(trax_image* image) {
     return result;
 }
 
-trax_image* image_decode(char* buffer) {
+void image_release_pooled(trax_image* image) {
+
+    image_pool_recycle((image_pool*) image->owner, image->data, memory_size(image->width, image->height, image->format));
+
+}
+
+// Creates a memory image for a received frame, its buffer is taken from the pool of the handle if there is one
+trax_image* image_create_pooled(image_pool* pool, char* data, int width, int height, int format) {
+
+    trax_image* result;
+
+    if (!pool && !data) return trax_image_create_memory(width, height, format);
+
+    result = (trax_image*) malloc(sizeof(trax_image));
+    result->type = TRAX_IMAGE_MEMORY;
+    result->width = width;
+    result->height = height;
+    result->format = format;
+    result->data = data ? data : image_pool_acquire(pool, memory_size(width, height, format));
+    result->release = pool ? image_release_pooled : NULL;
+    result->owner = pool;
+    result->stride = 0;
+
+    return result;
+
+}
+
+trax_image* image_decode(char* buffer, int length, image_pool* pool) {
 
     trax_image* result = NULL;
 
@@ -312,62 +440,682 @@ trax_image* image_decode(char* buffer) {
     if (strcmp(buffer, "file") == 0) {
         result = trax_image_create_path(buffer + (compare_prefix(resource, "//") ? 7 : 5));
     } else if (strcmp(buffer, "image") == 0) {
-        int outlen, width, height, depth, format, channels, allocated, verify;
+        int outlen, width, height, format, allocated, verify;
+        char* token;
+
+        width = strtol(resource, &resource, 10);
+        if (resource[0] != ';') return result;
+        height = strtol(resource + 1, &resource, 10);
+        if (resource[0] != ';') return result;
+        token = resource + 1;
+        resource = strntok(token, ';', 32);
+
+        if (!resource) return NULL;
+        format = decode_memory_format(token);
+
+        outlen = base64decodelen_n(resource, (buffer + length) - resource);
+
+        allocated = memory_size(width, height, format);
+
+        if (allocated < 1 || outlen != allocated) return result;
+
+        result = image_create_pooled(pool, NULL, width, height, format);
+        verify = base64decode_n((unsigned char*)result->data, resource, (buffer + length) - resource);
+
+        assert(verify == allocated);
+
+    } else if (strcmp(buffer, "data") == 0) {
+        int format, outlen;
+        char* token;
+
+        token = resource;
+        resource = strntok(token, ';', 32);
+        if (!resource) return NULL;
+        format = decode_buffer_format(token);
+        outlen = base64decodelen_n(resource, (buffer + length) - resource);
+
+        result = (trax_image*) malloc(sizeof(trax_image));
+        result->type = TRAX_IMAGE_BUFFER;
+        result->height = 1;
+        result->format = format;
+
+        result->data = (char*) malloc(sizeof(char) * (outlen));
+        result->release = NULL;
+        result->owner = NULL;
+        result->stride = 0;
+        result->width = base64decode_n((unsigned char*)result->data, resource, (buffer + length) - resource);
+    } else {
+        *(resource--) = ':'; // Restore the semicolon and use the buffer as URL
+        result = trax_image_create_url(buffer);
+    }
+    return result;
+
+}
+
+#define IS_BINARY(H) ((((message_stream*)(H)->stream)->flags & TRAX_STREAM_BINARY))
+
+// Binary framing can carry raw image data, only the URI header is kept in text
+char* image_encode_raw(trax_image* image, int* length) {
+
+    char* result = NULL;
+
+    switch (image->type) {
+    case TRAX_IMAGE_MEMORY: {
+        int i, row = memory_row_size(image->width, image->format);
+        const char* format = encode_memory_format(image->format);
+        int size = memory_size(image->width, image->height, image->format);
+        int header = snprintf(NULL, 0, "image:%d;%d;%s;", image->width, image->height, format);
+        assert(format);
+        result = (char*) malloc(sizeof(char) * (header + size + 1));
+        sprintf(result, "image:%d;%d;%s;", image->width, image->height, format);
+        // Rows are packed while they are copied
+        for (i = 0; i < size / row; i++)
+            memcpy(result + header + i * row, image->data + i * MEMORY_STRIDE(image), row);
+        result[header + size] = 0;
+        *length = header + size;
+        break;
+    }
+    case TRAX_IMAGE_BUFFER: {
+        int size = image->width;
+        const char* format = (image->format == TRAX_IMAGE_BUFFER_JPEG) ? "image/jpeg" :
+                             ((image->format == TRAX_IMAGE_BUFFER_PNG) ? "image/png" : NULL);
+        int header = snprintf(NULL, 0, "data:%s;", format);
+        assert(format);
+        result = (char*) malloc(sizeof(char) * (header + size + 1));
+        sprintf(result, "data:%s;", format);
+        memcpy(result + header, image->data, size);
+        result[header + size] = 0;
+        *length = header + size;
+        break;
+    }
+    default: {
+        result = image_encode(image);
+        *length = strlen(result);
+    }
+    }
+
+    return result;
+}
+
+trax_image* image_decode_raw(char* buffer, int length, image_pool* pool) {
+
+    trax_image* result = NULL;
+    char* resource = parse_uri(buffer);
+
+    if (!resource || (strcmp(buffer, "image") != 0 && strcmp(buffer, "data") != 0)) {
+        if (resource) *(resource - 1) = ':'; // Restore the separator
+        return image_decode(buffer, length, pool);
+    }
+
+    if (strcmp(buffer, "image") == 0) {
+        int width, height, format, size;
+        char* token;
+
+        width = strtol(resource, &resource, 10);
+        if (resource[0] != ';') return result;
+        height = strtol(resource + 1, &resource, 10);
+        if (resource[0] != ';') return result;
+        token = resource + 1;
+        resource = strntok(token, ';', 32);
+
+        if (!resource) return NULL;
+        format = decode_memory_format(token);
+
+        if (format == TRAX_IMAGE_MEMORY_ILLEGAL) return NULL;
+
+        size = memory_size(width, height, format);
+
+        if (size < 1 || (buffer + length) - resource != size) return result;
+
+        result = image_create_pooled(pool, NULL, width, height, format);
+        memcpy(result->data, resource, size);
+
+    } else {
+        int format, size;
+        char* token;
+
+        token = resource;
+        resource = strntok(token, ';', 32);
+        if (!resource) return NULL;
+        format = decode_buffer_format(token);
+        size = (int) ((buffer + length) - resource);
+
+        if (size < 1) return NULL;
+
+        result = (trax_image*) malloc(sizeof(trax_image));
+        result->type = TRAX_IMAGE_BUFFER;
+        result->width = size;
+        result->height = 1;
+        result->format = format;
+        result->data = (char*) malloc(sizeof(char) * size);
+        result->release = NULL;
+        result->owner = NULL;
+        result->stride = 0;
+        memcpy(result->data, resource, size);
+    }
+
+    return result;
+
+}
+
+// The parser has already decoded the content of the image, the image takes over its memory, which
+// belongs to the given pool if it was decoded to a pooled buffer
+trax_image* image_decode_payload(char* buffer, char* payload, int size, image_pool* pool) {
+
+    trax_image* result = NULL;
+    char* resource = parse_uri(buffer);
+
+    if (resource && strcmp(buffer, "image") == 0) {
+        int width, height, format;
+        char* token;
+
+        width = strtol(resource, &resource, 10);
+        if (resource[0] != ';') goto done;
+        height = strtol(resource + 1, &resource, 10);
+        if (resource[0] != ';') goto done;
+        token = resource + 1;
+        resource = strntok(token, ';', 32);
+
+        if (!resource) goto done;
+        format = decode_memory_format(token);
+
+        if (format == TRAX_IMAGE_MEMORY_ILLEGAL || size < 1 || size != memory_size(width, height, format)) goto done;
+
+        return image_create_pooled(pool, payload, width, height, format);
+
+    } else if (resource && strcmp(buffer, "data") == 0) {
         char* token;
 
-        width = strtol(resource, &resource, 10);
-        if (resource[0] != ';') return result;
-        height = strtol(resource + 1, &resource, 10);
-        if (resource[0] != ';') return result;
-        token = resource + 1;
-        resource = strntok(token, ';', 32);
+        token = resource;
+        resource = strntok(token, ';', 32);
+        if (!resource || size < 1) goto done;
+
+        result = (trax_image*) malloc(sizeof(trax_image));
+        result->type = TRAX_IMAGE_BUFFER;
+        result->width = size;
+        result->height = 1;
+        result->format = decode_buffer_format(token);
+
+    }
+
+done:
+
+    if (!result) {
+        if (pool)
+            image_pool_recycle(pool, payload, size);
+        else
+            free(payload);
+        return NULL;
+    }
+
+    result->data = payload;
+    result->release = NULL;
+    result->owner = NULL;
+    result->stride = 0;
+
+    return result;
+
+}
+
+// Copies a memory image to a shared memory slot, only its location is sent in the message
+char* image_encode_shared(trax_handle* handle, trax_image* image, int channel) {
+
+    int offset, header;
+    char* result;
+    shared_segment* segment;
+    int i, row = memory_row_size(image->width, image->format);
+    const char* format = encode_memory_format(image->format);
+    int size = memory_size(image->width, image->height, image->format);
+
+    assert(format);
+
+    if (!handle->shared) handle->shared = shared_context_create();
+
+    segment = shared_ring_acquire((shared_context*) handle->shared, channel, size, &offset);
+
+    if (!segment) return NULL;
+
+    for (i = 0; i < size / row; i++)
+        memcpy(segment->data + offset + i * row, image->data + i * MEMORY_STRIDE(image), row);
+
+    header = snprintf(NULL, 0, "shm:%s;%d;%d;%d;%s", segment->name, offset, image->width, image->height, format);
+    result = (char*) malloc(sizeof(char) * (header + 1));
+    sprintf(result, "shm:%s;%d;%d;%d;%s", segment->name, offset, image->width, image->height, format);
+
+    return result;
+
+}
+
+void image_release_shared(trax_image* image) {
+
+    shared_segment_dereference((shared_segment*) image->owner);
+
+}
+
+// Maps a shared memory slot as a read-only memory image, the segment is kept
+// alive until all the images that reference it are released.
+trax_image* image_decode_shared(trax_handle* handle, char* resource, int channel) {
+
+    int offset, width, height, format, size;
+    char* token;
+    trax_image* result;
+    shared_segment* segment;
+
+    if (!TRAX_SUPPORTS(handle->metadata->format_image, TRAX_IMAGE_SHM)) return NULL;
+
+    token = resource;
+    resource = strntok(token, ';', SHARED_NAME_LENGTH);
+    if (!resource) return NULL;
+
+    offset = strtol(resource, &resource, 10);
+    if (resource[0] != ';') return NULL;
+    width = strtol(resource + 1, &resource, 10);
+    if (resource[0] != ';') return NULL;
+    height = strtol(resource + 1, &resource, 10);
+    if (resource[0] != ';') return NULL;
+
+    format = decode_memory_format(resource + 1);
+
+    size = memory_size(width, height, format);
+
+    if (format == TRAX_IMAGE_MEMORY_ILLEGAL || size < 1 || offset < 0) return NULL;
+
+    if (!handle->shared) handle->shared = shared_context_create();
+
+    segment = shared_context_map((shared_context*) handle->shared, channel, token);
+
+    if (!segment || offset > segment->size - size) return NULL;
+
+    result = (trax_image*) malloc(sizeof(trax_image));
+    result->type = TRAX_IMAGE_MEMORY;
+    result->width = width;
+    result->height = height;
+    result->format = format;
+    result->data = segment->data + offset;
+    result->release = image_release_shared;
+    result->owner = segment;
+    result->stride = 0;
+
+    shared_segment_reference(segment);
+
+    return result;
+
+}
+
+// Passes the descriptor of a descriptor-backed image along with the message, only the image header is sent in the message
+char* image_encode_descriptor(trax_handle* handle, trax_image* image) {
+
+    int header;
+    char* result;
+    shared_segment* segment;
+
+    if (image->release != image_release_shared || !image->owner) return NULL;
+
+    segment = (shared_segment*) image->owner;
+
+    if (segment->descriptor < 0) return NULL;
+
+    if (image->type == TRAX_IMAGE_MEMORY) {
+
+        const char* format = encode_memory_format(image->format);
+
+        assert(format);
+
+        if (!message_attach_descriptor((message_stream*)handle->stream, segment->descriptor)) return NULL;
+
+        header = snprintf(NULL, 0, "fd:image;%d;%d;%s", image->width, image->height, format);
+        result = (char*) malloc(sizeof(char) * (header + 1));
+        sprintf(result, "fd:image;%d;%d;%s", image->width, image->height, format);
+
+        return result;
+
+    } else if (image->type == TRAX_IMAGE_BUFFER) {
+
+        if (!message_attach_descriptor((message_stream*)handle->stream, segment->descriptor)) return NULL;
+
+        header = snprintf(NULL, 0, "fd:data;%d", image->width);
+        result = (char*) malloc(sizeof(char) * (header + 1));
+        sprintf(result, "fd:data;%d", image->width);
+
+        return result;
+
+    }
+
+    return NULL;
+
+}
+
+// Maps a passed descriptor as a memory or buffer image. The mapping is private, so the
+// server can modify the data without affecting the client.
+trax_image* image_decode_descriptor(trax_handle* handle, char* resource) {
+
+    int descriptor, size, available;
+    trax_image* result = NULL;
+    shared_segment* segment;
+
+    // Descriptors are consumed in order, even if the image turns out to be invalid
+    descriptor = message_take_descriptor((message_stream*)handle->stream);
+
+    if (descriptor < 0) return NULL;
+
+    available = shared_descriptor_size(descriptor);
+
+    result = (trax_image*) malloc(sizeof(trax_image));
+
+    if (compare_prefix(resource, "image;")) {
+
+        resource += 6;
+        result->type = TRAX_IMAGE_MEMORY;
+        result->width = strtol(resource, &resource, 10);
+        if (resource[0] != ';') goto failure;
+        result->height = strtol(resource + 1, &resource, 10);
+        if (resource[0] != ';') goto failure;
+        result->format = decode_memory_format(resource + 1);
+
+        if (result->format == TRAX_IMAGE_MEMORY_ILLEGAL) goto failure;
+
+        size = memory_size(result->width, result->height, result->format);
+
+    } else if (compare_prefix(resource, "data;")) {
+
+        size = strtol(resource + 5, NULL, 10);
+
+        if (size < 5) goto failure;
+
+        result->type = TRAX_IMAGE_BUFFER;
+        result->width = size;
+        result->height = 1;
+
+    } else goto failure;
+
+    if (size < 1 || size > available) goto failure;
+
+    segment = shared_segment_map(descriptor, size, 1);
+
+    if (!segment) goto failure;
+
+    if (result->type == TRAX_IMAGE_BUFFER) {
+        result->format = verify_image_format(segment->data);
+        if (result->format == TRAX_IMAGE_BUFFER_ILLEGAL) {
+            // Unmaps the segment and closes the descriptor
+            shared_segment_reference(segment);
+            shared_segment_dereference(segment);
+            free(result);
+            return NULL;
+        }
+    }
+
+    result->data = segment->data;
+    result->release = image_release_shared;
+    result->owner = segment;
+    result->stride = 0;
+
+    shared_segment_reference(segment);
+
+    return result;
+
+failure:
+
+    shared_descriptor_close(descriptor);
+    free(result);
+    return NULL;
+
+}
+
+#define CLAMP_BYTE(V) ((char) ((V) < 0 ? 0 : ((V) > 255 ? 255 : (V))))
+
+// Converts a color memory image to RGB for trackers that do not accept its format
+static trax_image* image_convert_rgb(const trax_image* image) {
+
+    int i, j;
+    trax_image* result = trax_image_create_memory(image->width, image->height, TRAX_IMAGE_MEMORY_RGB);
+
+    for (j = 0; j < image->height; j++) {
+
+        const unsigned char* src = (const unsigned char*) trax_image_get_memory_row(image, j);
+        char* dst = trax_image_write_memory_row(result, j);
+
+        switch (image->format) {
+        case TRAX_IMAGE_MEMORY_BGR:
+        case TRAX_IMAGE_MEMORY_BGRA: {
+            int step = image->format == TRAX_IMAGE_MEMORY_BGR ? 3 : 4;
+            for (i = 0; i < image->width; i++, src += step, dst += 3) {
+                dst[0] = src[2]; dst[1] = src[1]; dst[2] = src[0];
+            }
+            break;
+        }
+        case TRAX_IMAGE_MEMORY_RGBA: {
+            for (i = 0; i < image->width; i++, src += 4, dst += 3) {
+                dst[0] = src[0]; dst[1] = src[1]; dst[2] = src[2];
+            }
+            break;
+        }
+        case TRAX_IMAGE_MEMORY_NV12: {
+            // BT.601 with limited range in 16 bit fixed point, as produced by most cameras
+            const unsigned char* chroma = (const unsigned char*) trax_image_get_memory_row(image, image->height + j / 2);
+            for (i = 0; i < image->width; i++, dst += 3) {
+                int y = 76309 * (src[i] - 16);
+                int u = chroma[i & ~1] - 128, v = chroma[i | 1] - 128;
+                dst[0] = CLAMP_BYTE((y + 104597 * v + 32768) >> 16);
+                dst[1] = CLAMP_BYTE((y - 25675 * u - 53279 * v + 32768) >> 16);
+                dst[2] = CLAMP_BYTE((y + 132201 * u + 32768) >> 16);
+            }
+            break;
+        }
+        }
+
+    }
+
+    return result;
+
+}
+
+// Extracts a part of a memory image and resamples it to the given size with nearest neighbour sampling,
+// a part that keeps its size references the data of the original image
+static trax_image* image_crop(const trax_image* image, int x, int y, int width, int height, int target_width, int target_height) {
+
+    int i, j, k;
+    int pixel = memory_row_size(1, image->format);
+    int stride = MEMORY_STRIDE(image);
+    trax_image* result;
+    int* columns;
+
+    if (width == target_width && height == target_height && image->format != TRAX_IMAGE_MEMORY_NV12)
+        return trax_image_create_memory_wrap(width, height, image->format, stride,
+            image->data + (size_t) y * stride + (size_t) x * pixel, NULL, NULL);
+
+    result = trax_image_create_memory(target_width, target_height, image->format);
+    columns = (int*) malloc(sizeof(int) * target_width);
+
+    for (i = 0; i < target_width; i++)
+        columns[i] = (x + (int) (((long long) i * width) / target_width)) * pixel;
+
+    for (j = 0; j < target_height; j++) {
+        const char* src = trax_image_get_memory_row(image, y + (int) (((long long) j * height) / target_height));
+        char* dst = trax_image_write_memory_row(result, j);
+        for (i = 0; i < target_width; i++, dst += pixel)
+            for (k = 0; k < pixel; k++) dst[k] = src[columns[i] + k];
+    }
+
+    if (image->format == TRAX_IMAGE_MEMORY_NV12) {
+        // Chroma samples are taken in pairs, the part starts at even coordinates
+        for (j = 0; j < target_height / 2; j++) {
+            const char* src = trax_image_get_memory_row(image, image->height + (y + (int) (((long long) j * 2 * height) / target_height)) / 2);
+            char* dst = trax_image_write_memory_row(result, target_height + j);
+            for (i = 0; i < target_width; i += 2) {
+                int column = columns[i] & ~1;
+                dst[i] = src[column];
+                dst[i + 1] = src[column + 1];
+            }
+        }
+    }
+
+    free(columns);
+
+    return result;
+
+}
+
+// Encodes the tiles of a memory image that changed since the last frame of the channel, the image is sent whole
+// if there is no previous frame with the same geometry
+static char* image_encode_delta(trax_handle* handle, trax_image* image, int channel, int* length) {
+
+    char *result, *payload, *temporary = NULL;
+    const char* format = encode_memory_format(image->format);
+    int row = memory_row_size(image->width, image->format);
+    int rows = memory_rows(image->height, image->format);
+    int header, size, tile = DELTA_TILE;
+
+    assert(format);
+
+    payload = delta_encode((delta_context*) handle->delta, channel, image->data, MEMORY_STRIDE(image), image->width, image->height,
+        image->format, rows, row, memory_row_size(1, image->format), 0, &size);
+
+    if (!payload) {
+        tile = 0;
+        size = row * rows;
+        payload = (char*) memory_packed(image, &temporary);
+    }
+
+    header = snprintf(NULL, 0, "delta:%d;%d;%s;%d;", image->width, image->height, format, tile);
+
+    if (IS_BINARY(handle)) {
+        result = (char*) malloc(sizeof(char) * (header + size + 1));
+        sprintf(result, "delta:%d;%d;%s;%d;", image->width, image->height, format, tile);
+        memcpy(result + header, payload, size);
+        result[header + size] = 0;
+        *length = header + size;
+    } else {
+        result = (char*) malloc(sizeof(char) * (header + base64encodelen(size) + 1));
+        sprintf(result, "delta:%d;%d;%s;%d;", image->width, image->height, format, tile);
+        base64encode(result + header, (const unsigned char*) payload, size);
+        *length = strlen(result);
+    }
+
+    if (tile) free(payload);
+    if (temporary) free(temporary);
+
+    return result;
+
+}
+
+// Reconstructs a frame from the tiles that changed since the last frame of the channel
+static trax_image* image_decode_delta(trax_handle* handle, string_list* arguments, int index, int channel) {
+
+    char *token, *data = NULL;
+    char* buffer = arguments->buffer[index];
+    char* end = buffer + list_length(arguments, index);
+    char* resource = parse_uri(buffer);
+    int width, height, format, tile, size, pooled = 0, owned = 0;
+    const char* frame;
+    trax_image* result = NULL;
+
+    width = strtol(resource, &resource, 10);
+    if (resource[0] != ';') return NULL;
+    height = strtol(resource + 1, &resource, 10);
+    if (resource[0] != ';') return NULL;
+    token = resource + 1;
+    resource = strntok(token, ';', 32);
+    if (!resource) return NULL;
+    format = decode_memory_format(token);
+    tile = strtol(resource, &resource, 10);
+    if (resource[0] != ';') return NULL;
+    resource++;
+
+    if (format == TRAX_IMAGE_MEMORY_ILLEGAL || memory_size(width, height, format) < 1) return NULL;
+
+    if (((message_stream*)handle->stream)->input.binary) {
+        data = resource;
+        size = (int) (end - resource);
+    } else {
+        data = message_take_payload((message_stream*)handle->stream, index, &size, &pooled);
+        if (!data) {
+            data = (char*) malloc(sizeof(char) * base64decodelen_n(resource, end - resource));
+            size = base64decode_n((unsigned char*) data, resource, end - resource);
+        }
+        owned = 1;
+    }
+
+    // The last frames are only kept once the client starts sending them
+    if (!handle->delta) handle->delta = delta_context_create();
 
-        if (!resource) return NULL;
-        format = decode_memory_format(token);
+    frame = delta_apply((delta_context*) handle->delta, channel, width, height, format, memory_rows(height, format),
+        memory_row_size(width, format), memory_row_size(1, format), tile, data, size);
 
-        outlen = base64decodelen(resource) - 1;
+    if (frame) {
+        result = image_create_pooled((image_pool*) handle->pool, NULL, width, height, format);
+        memcpy(result->data, frame, memory_size(width, height, format));
+    }
 
-        depth = format == TRAX_IMAGE_MEMORY_RGB ? 1 :
-                (format == TRAX_IMAGE_MEMORY_GRAY8 ? 1 :
-                 (format == TRAX_IMAGE_MEMORY_GRAY16 ? 2 : 0));
-        channels = format == TRAX_IMAGE_MEMORY_RGB ? 3 : 1;
-        allocated =  (width * height * depth * channels);
+    if (owned) {
+        if (pooled) image_pool_recycle((image_pool*) handle->pool, data, size);
+        else free(data);
+    }
 
-        if (width < 1 || height < 1 || outlen != allocated) return result;
+    return result;
 
-        result = (trax_image*) malloc(sizeof(trax_image));
-        result->type = TRAX_IMAGE_MEMORY;
-        result->width = width;
-        result->height = height;
-        result->format = format;
-        result->data = (char*) malloc(sizeof(char) * allocated);
-        verify = base64decode((unsigned char*)result->data, resource);
+}
 
-        assert(verify == allocated);
+// Appends an encoded image to message arguments using the encoding supported by the stream
+void image_append(trax_handle* handle, string_list* arguments, trax_image* image, int channel) {
 
-    } else if (strcmp(buffer, "data") == 0) {
-        int format, outlen;
-        char* token;
+    if (image->type == TRAX_IMAGE_MEMORY && !TRAX_SUPPORTS(handle->metadata->format_memory, TRAX_IMAGE_MEMORY_FLAG(image->format))) {
+        trax_image* converted = image_convert_rgb(image);
+        image_append(handle, arguments, converted, channel);
+        trax_image_release(&converted);
+        return;
+    }
 
-        token = resource;
-        resource = strntok(token, ';', 32);
-        if (!resource) return NULL;
-        format = decode_buffer_format(token);
-        outlen = base64decodelen(resource);
+    if (((message_stream*)handle->stream)->flags & TRAX_STREAM_DESCRIPTORS) {
+        char* buffer = image_encode_descriptor(handle, image);
+        if (buffer) {
+            list_append_direct(arguments, buffer);
+            return;
+        }
+    }
 
-        result = (trax_image*) malloc(sizeof(trax_image));
-        result->type = TRAX_IMAGE_BUFFER;
-        result->width = outlen;
-        result->height = 1;
-        result->format = format;
+    if (image->type == TRAX_IMAGE_MEMORY && TRAX_SUPPORTS(handle->metadata->format_image, TRAX_IMAGE_SHM)) {
+        // Fall back to regular encoding if shared memory is not available
+        char* buffer = image_encode_shared(handle, image, channel);
+        if (buffer) {
+            list_append_direct(arguments, buffer);
+            return;
+        }
+    }
 
-        result->data = (char*) malloc(sizeof(char) * (outlen));
-        base64decode((unsigned char*)result->data, resource);
+    if (image->type == TRAX_IMAGE_MEMORY && handle->delta) {
+        int length;
+        char* buffer = image_encode_delta(handle, image, channel, &length);
+        list_append_direct_n(arguments, buffer, length);
+    } else if (IS_BINARY(handle)) {
+        int length;
+        char* buffer = image_encode_raw(image, &length);
+        list_append_direct_n(arguments, buffer, length);
     } else {
-        *(resource--) = ':'; // Restore the semicolon and use the buffer as URL
-        result = trax_image_create_url(buffer);
+        char* buffer = image_encode(image);
+        list_append_direct(arguments, buffer);
+    }
+
+}
+
+// Decodes an image argument of the last received message
+trax_image* image_extract(trax_handle* handle, string_list* arguments, int index, int channel) {
+
+    if (compare_prefix(arguments->buffer[index], "delta:")) {
+        return image_decode_delta(handle, arguments, index, channel);
+    } else if (compare_prefix(arguments->buffer[index], "shm:")) {
+        return image_decode_shared(handle, arguments->buffer[index] + 4, channel);
+    } else if (compare_prefix(arguments->buffer[index], "fd:")) {
+        return image_decode_descriptor(handle, arguments->buffer[index] + 3);
+    } else if (((message_stream*)handle->stream)->input.binary) {
+        return image_decode_raw(arguments->buffer[index], list_length(arguments, index), (image_pool*) handle->pool);
+    } else {
+        int size, pooled;
+        char* payload = message_take_payload((message_stream*)handle->stream, index, &size, &pooled);
+        if (payload)
+            return image_decode_payload(arguments->buffer[index], payload, size, pooled ? (image_pool*) handle->pool : NULL);
+        return image_decode(arguments->buffer[index], list_length(arguments, index), (image_pool*) handle->pool);
     }
-    return result;
 
 }
 
@@ -417,6 +1165,40 @@ void image_formats_encode(int formats, char *key) {
 
 }
 
+// Unknown memory formats are skipped, they may be added by newer versions of the protocol
+int memory_formats_decode(char *str) {
+
+    int formats = 0;
+
+    char *pch;
+
+    if (!str) return 0;
+
+    pch = strtok (str, " ;");
+    while (pch != NULL) {
+        int format = decode_memory_format(pch);
+        if (format != TRAX_IMAGE_MEMORY_ILLEGAL)
+            formats |= TRAX_IMAGE_MEMORY_FLAG(format);
+        pch = strtok (NULL, " ;");
+    }
+
+    return formats;
+}
+
+void memory_formats_encode(int formats, char *key) {
+
+    int format;
+    char* pch = key;
+
+    pch[0] = 0;
+
+    for (format = TRAX_IMAGE_MEMORY_GRAY8; format <= TRAX_IMAGE_MEMORY_NV12; format++) {
+        if (TRAX_SUPPORTS(formats, TRAX_IMAGE_MEMORY_FLAG(format)))
+            pch += sprintf(pch, "%s;", encode_memory_format(format));
+    }
+
+}
+
 int region_formats_decode(char *str) {
 
     int formats = 0;
@@ -517,13 +1299,41 @@ void channels_encode(int channels, char *key) {
 
 }
 
-void copy_properties(const trax_properties* source, trax_properties* dest, int flags) {
+static trax_enumerator property_copier(int flags) {
 
-    trax_enumerator f = (flags & COPY_ALL) ?
+    return (flags & COPY_ALL) ?
      ((flags && COPY_OVERWRITE) ? copy_property_overwrite : copy_property_safe) :
      ((flags && COPY_OVERWRITE) ? copy_property_external_overwrite : copy_property_external_safe);
-    
-    trax_properties_enumerate(source, f, dest);
+
+}
+
+void copy_properties(const trax_properties* source, trax_properties* dest, int flags) {
+
+    trax_properties_enumerate(source, property_copier(flags), dest);
+
+}
+
+// Copies the properties of the last message received by the handle
+static void copy_message_properties(trax_handle* handle, trax_properties* dest, int flags) {
+
+    message_enumerate_properties((message_stream*)handle->stream, property_copier(flags), dest);
+
+}
+
+static int message_property_int(trax_handle* handle, const char* key, int def) {
+
+    char* end;
+    long ret;
+    const char* value = message_property((message_stream*)handle->stream, key);
+
+    if (value == NULL) return def;
+
+    if (value[0] != '\0') {
+        ret = (int) strtod(value, &end);
+        return (*end == '\0' && end != value) ? (int) ret : def;
+    }
+
+    return def;
 
 }
 
@@ -558,10 +1368,57 @@ void set_error(trax_handle* handle, const char *format, ...) {
 }
 
 
+typedef struct roi_rectangle {
+    int active;
+    int x, y, width, height;
+    float scale;
+} roi_rectangle;
+
+// Region of interest state of a handle, a request for the next frame and the part covered by the last frame
+typedef struct roi_state {
+    roi_rectangle request;
+    roi_rectangle frame;
+} roi_state;
+
+static roi_state* roi_state_create() {
+
+    roi_state* roi = (roi_state*) malloc(sizeof(roi_state));
+
+    memset(roi, 0, sizeof(roi_state));
+
+    return roi;
+
+}
+
+// Parses a region given as x,y,width,height and an optional scale, the region is inactive if it is not valid
+static void roi_parse(const char* value, roi_rectangle* roi) {
+
+    float scale = 1;
+
+    roi->active = 0;
+
+    if (!value || sscanf(value, "%d,%d,%d,%d,%f", &roi->x, &roi->y, &roi->width, &roi->height, &scale) < 4)
+        return;
+
+    if (roi->width < 1 || roi->height < 1) return;
+
+    roi->scale = (scale > 0 && scale <= 1) ? scale : 1;
+    roi->active = 1;
+
+}
+
+static void roi_encode(const roi_rectangle* roi, char* buffer) {
+
+    if (roi->scale < 1)
+        snprintf(buffer, BUFFER_LENGTH, "%d,%d,%d,%d,%g", roi->x, roi->y, roi->width, roi->height, roi->scale);
+    else
+        snprintf(buffer, BUFFER_LENGTH, "%d,%d,%d,%d", roi->x, roi->y, roi->width, roi->height);
+
+}
+
 trax_handle* client_setup(message_stream* stream, const trax_logging log) {
 
     trax_properties* tmp_properties;
-    string_list* arguments;
     char *tmp, *tracker_name, *tracker_description, *tracker_family;
     int region_formats, image_formats, channels, flags;
 
@@ -573,20 +1430,29 @@ trax_handle* client_setup(message_stream* stream, const trax_logging log) {
     client->stream = stream;
     client->error = NULL;
     client->objects = 0;
+    client->shared = NULL;
+    client->pending = NULL;
+    client->sequence = 0;
+    client->inflight = 0;
+    client->pipeline = 0;
+    client->pool = NULL;
+    client->roi = NULL;
+    client->delta = NULL;
 
     tmp_properties = trax_properties_create();
-    arguments = list_create(8);
 
-    if (read_message((message_stream*)client->stream, &LOGGER(client), arguments, tmp_properties) != TRAX_HELLO) {
+    if (read_message((message_stream*)client->stream, &LOGGER(client)) != TRAX_HELLO) {
         DEBUGMSG("Unable to parse hello message.");
         goto failure;
     }
 
-    if (list_size(arguments) > 0) {
-        DEBUGMSG("Illegal number of arguments %d, required more.", list_size(arguments));
+    if (list_size(message_arguments((message_stream*)client->stream)) > 0) {
+        DEBUGMSG("Illegal number of arguments %d, required more.", list_size(message_arguments((message_stream*)client->stream)));
         goto failure;
     }
 
+    copy_message_properties(client, tmp_properties, COPY_ALL | COPY_OVERWRITE);
+
     client->version = trax_properties_get_int(tmp_properties, "trax.version", 1);
 
     tmp = trax_properties_get(tmp_properties, "trax.region");
@@ -619,6 +1485,17 @@ trax_handle* client_setup(message_stream* stream, const trax_logging log) {
         }
     }
 
+    // Tracker may ask for only a part of the next frame in its replies
+    if (trax_properties_get_int(tmp_properties, "trax.roi", 0)) {
+        flags |= TRAX_METADATA_ROI;
+        client->roi = roi_state_create();
+    }
+
+    // Server can reconstruct frames from changed tiles, the client has to enable it
+    if (trax_properties_get_int(tmp_properties, "trax.delta", 0)) {
+        flags |= TRAX_METADATA_DELTA;
+    }
+
     client->metadata = trax_metadata_create(region_formats, image_formats, channels,
                                             tracker_name, tracker_description, tracker_family, flags);
 
@@ -628,14 +1505,34 @@ trax_handle* client_setup(message_stream* stream, const trax_logging log) {
 
     copy_properties(tmp_properties, client->metadata->custom, COPY_EXTERNAL | COPY_OVERWRITE);
 
+    if (trax_properties_get_int(tmp_properties, "trax.binary", 0)) {
+        ((message_stream*)client->stream)->flags |= TRAX_STREAM_BINARY;
+    }
+
+    if (!trax_properties_get_int(tmp_properties, "trax.descriptors", 0)) {
+        ((message_stream*)client->stream)->flags &= ~TRAX_STREAM_DESCRIPTORS;
+    }
+
+    if (trax_properties_get_int(tmp_properties, "trax.shm", 0) && shared_supported()) {
+        client->metadata->format_image |= TRAX_IMAGE_SHM;
+    }
+
+    // Older servers only know the default memory formats
+    tmp = trax_properties_get(tmp_properties, "trax.memory");
+    client->metadata->format_memory = memory_formats_decode(tmp) | TRAX_IMAGE_MEMORY_DEFAULT;
+    if (tmp) free(tmp);
+
+    // Server echoes frame sequence numbers, more than one frame can be sent ahead of the replies
+    if (trax_properties_get_int(tmp_properties, "trax.pipeline", 0)) {
+        client->pipeline = 1;
+    }
+
     trax_properties_release(&tmp_properties);
-    list_destroy(&arguments);
 
     return client;
 
 failure:
 
-    list_destroy(&arguments);
     trax_properties_release(&tmp_properties);
     free(client);
     return NULL;
@@ -647,7 +1544,7 @@ trax_handle* server_setup(trax_metadata *metadata, message_stream* stream, const
     trax_properties* properties;
     trax_handle* server = (trax_handle*) malloc(sizeof(trax_handle));
     string_list* arguments;
-    int flags;
+    int flags, image_formats;
     char tmp[BUFFER_LENGTH];
 
     server->flags = (TRAX_FLAG_SERVER) | TRAX_FLAG_VALID;
@@ -655,6 +1552,16 @@ trax_handle* server_setup(trax_metadata *metadata, message_stream* stream, const
     server->error = NULL;
     server->stream = stream;
     server->objects = 0;
+    server->shared = NULL;
+    server->pending = NULL;
+    server->sequence = -1;
+    server->inflight = 0;
+    server->pipeline = 0;
+    server->pool = image_pool_create(POOL_CAPACITY);
+    server->roi = NULL;
+    server->delta = NULL;
+
+    message_stream_set_pool(stream, (image_pool*) server->pool);
 
     if (metadata->custom) {
         properties = trax_properties_copy(metadata->custom);
@@ -671,9 +1578,27 @@ trax_handle* server_setup(trax_metadata *metadata, message_stream* stream, const
     region_formats_encode(metadata->format_region, tmp);
     trax_properties_set(properties, "trax.region", tmp);
 
-    image_formats_encode(metadata->format_image, tmp);
+    image_formats = metadata->format_image;
+
+    // Shared memory images are delivered as memory images
+    if (TRAX_SUPPORTS(image_formats, TRAX_IMAGE_SHM)) {
+        if (shared_supported()) {
+            image_formats |= TRAX_IMAGE_MEMORY;
+            trax_properties_set_int(properties, "trax.shm", 1);
+        } else {
+            image_formats &= ~TRAX_IMAGE_SHM;
+        }
+    }
+
+    image_formats_encode(image_formats, tmp);
     trax_properties_set(properties, "trax.image", tmp);
 
+    // Additional memory formats are only announced when the tracker accepts them
+    if (TRAX_SUPPORTS(image_formats, TRAX_IMAGE_MEMORY) && (metadata->format_memory | TRAX_IMAGE_MEMORY_DEFAULT) != TRAX_IMAGE_MEMORY_DEFAULT) {
+        memory_formats_encode(metadata->format_memory | TRAX_IMAGE_MEMORY_DEFAULT, tmp);
+        trax_properties_set(properties, "trax.memory", tmp);
+    }
+
     channels_encode(metadata->channels, tmp);
     trax_properties_set(properties, "trax.channels", tmp);
 
@@ -686,17 +1611,40 @@ trax_handle* server_setup(trax_metadata *metadata, message_stream* stream, const
     if (metadata->tracker_family)
         trax_properties_set(properties, "trax.family", metadata->tracker_family);
 
+    // Announce support for binary message framing, the client may switch to it after the introduction
+    trax_properties_set_int(properties, "trax.binary", 1);
+
+    // Images can be passed as file descriptors over a Unix domain socket
+    if (((message_stream*)server->stream)->flags & TRAX_STREAM_DESCRIPTORS)
+        trax_properties_set_int(properties, "trax.descriptors", 1);
+
+    // Replies are tagged with the sequence number of the frame so that the client can pipeline frames
+    trax_properties_set_int(properties, "trax.pipeline", 1);
+
+    // Raw images can be sent as tiles that changed since the previous frame of the channel
+    if (TRAX_SUPPORTS(image_formats, TRAX_IMAGE_MEMORY))
+        trax_properties_set_int(properties, "trax.delta", 1);
+
+    flags = 0;
+
     if (IS_VERSION_4(server)) {
-        flags = 0;
         if (metadata->flags & TRAX_METADATA_MULTI_OBJECT) {
             flags |= TRAX_METADATA_MULTI_OBJECT;
             trax_properties_set_int(properties, "trax.multiobject", 1);
         }
     }
 
-    server->metadata = trax_metadata_create(metadata->format_region, metadata->format_image, metadata->channels,
+    if (metadata->flags & TRAX_METADATA_ROI) {
+        flags |= TRAX_METADATA_ROI;
+        trax_properties_set_int(properties, "trax.roi", 1);
+        server->roi = roi_state_create();
+    }
+
+    server->metadata = trax_metadata_create(metadata->format_region, image_formats, metadata->channels,
                                             metadata->tracker_name, metadata->tracker_description, metadata->tracker_family, flags);
 
+    server->metadata->format_memory = metadata->format_memory | TRAX_IMAGE_MEMORY_DEFAULT;
+
     arguments = list_create(1);
 
     write_message((message_stream*)server->stream, &LOGGER(server), TRAX_HELLO, arguments, properties);
@@ -720,57 +1668,267 @@ trax_metadata* trax_metadata_create(int region_formats, int image_formats, int c
     metadata->format_image = image_formats;
     metadata->channels = channels;
 
-    metadata->tracker_name = (tracker_name) ? strdup(tracker_name) : NULL;
-    metadata->tracker_description = (tracker_description) ? strdup(tracker_description) : NULL;
-    metadata->tracker_family = (tracker_family) ? strdup(tracker_family) : NULL;
+    metadata->tracker_name = (tracker_name) ? strdup(tracker_name) : NULL;
+    metadata->tracker_description = (tracker_description) ? strdup(tracker_description) : NULL;
+    metadata->tracker_family = (tracker_family) ? strdup(tracker_family) : NULL;
+
+    metadata->custom = trax_properties_create();
+
+    metadata->flags = flags;
+
+    metadata->format_memory = TRAX_IMAGE_MEMORY_DEFAULT;
+
+    return metadata;
+
+}
+
+void trax_metadata_release(trax_metadata** metadata) {
+
+    if (!*metadata) return;
+
+    if ((*metadata)->tracker_name) free((*metadata)->tracker_name);
+    if ((*metadata)->tracker_description) free((*metadata)->tracker_description);
+    if ((*metadata)->tracker_family) free((*metadata)->tracker_family);
+
+    if ((*metadata)->custom) trax_properties_release(&(*metadata)->custom);
+
+    free(*metadata);
+
+    *metadata = NULL;
+
+}
+
+
+trax_handle* trax_client_setup_file(int input, int output, const trax_logging log) {
+
+    message_stream* stream = create_message_stream_file(input, output);
+
+    return client_setup(stream, log);
+
+}
+
+trax_handle* trax_client_setup_socket(int server, int timeout, const trax_logging log) {
+
+    message_stream* stream = create_message_stream_socket_accept(server, timeout);
+
+    if (!stream) return NULL;
+
+    return client_setup(stream, log);
+
+}
+
+// Returns a copy of the frame properties tagged with the sequence number and the part of the image that
+// is sent, returns NULL if the frame does not have to be tagged
+static trax_properties* client_sequence_tag(trax_handle* client, trax_properties* properties, const roi_rectangle* crop) {
+
+    trax_properties* tagged;
+
+    if (client->pipeline < 1 && !crop) return NULL;
+
+    tagged = properties ? trax_properties_copy(properties) : trax_properties_create();
+
+    if (crop) {
+        char tmp[BUFFER_LENGTH];
+        roi_encode(crop, tmp);
+        trax_properties_set(tagged, "trax.roi", tmp);
+    }
+
+    if (client->pipeline < 1) return tagged;
+
+    trax_properties_set_int(tagged, "trax.sequence", client->sequence);
+
+    client->sequence++;
+    client->inflight++;
+
+    return tagged;
+
+}
+
+// Crops the images of a frame to the part requested by the tracker, returns zero if the whole frame has to be sent.
+// The request is only used once, the images are cropped only if all of them are memory images of the same size.
+static int client_crop_frame(trax_handle* client, trax_image_list* images, trax_image_list* cropped, roi_rectangle* crop) {
+
+    int i, x0, y0, x1, y1, width, height, even = 0;
+    trax_image* reference = NULL;
+    roi_rectangle request;
+
+    if (!client->roi || !((roi_state*) client->roi)->request.active) return 0;
+
+    request = ((roi_state*) client->roi)->request;
+    ((roi_state*) client->roi)->request.active = 0;
+
+    for (i = 0; i < TRAX_CHANNELS; i++) {
+        trax_image* image;
+        if (!TRAX_SUPPORTS(client->metadata->channels, TRAX_CHANNEL_ID(i))) continue;
+        image = images->images[i];
+        if (!image || image->type != TRAX_IMAGE_MEMORY) return 0;
+        if (reference && (image->width != reference->width || image->height != reference->height)) return 0;
+        if (image->format == TRAX_IMAGE_MEMORY_NV12) even = 1;
+        reference = image;
+    }
+
+    if (!reference) return 0;
+
+    x0 = MAX(0, request.x);
+    y0 = MAX(0, request.y);
+    x1 = MIN(reference->width, request.x + request.width);
+    y1 = MIN(reference->height, request.y + request.height);
+
+    // Subsampled chroma requires the part to be aligned to pairs of pixels
+    if (even) {
+        x0 &= ~1; y0 &= ~1;
+        x1 = MIN(reference->width, (x1 + 1) & ~1);
+        y1 = MIN(reference->height, (y1 + 1) & ~1);
+    }
+
+    if (x1 - x0 < 1 || y1 - y0 < 1) return 0;
+
+    width = MAX(1, (int) ((x1 - x0) * request.scale + 0.5f));
+    height = MAX(1, (int) ((y1 - y0) * request.scale + 0.5f));
+
+    if (even) {
+        width = MAX(2, width & ~1);
+        height = MAX(2, height & ~1);
+    }
+
+    if (x1 - x0 == reference->width && y1 - y0 == reference->height && width == reference->width && height == reference->height)
+        return 0;
+
+    for (i = 0; i < TRAX_CHANNELS; i++) {
+        if (TRAX_SUPPORTS(client->metadata->channels, TRAX_CHANNEL_ID(i)))
+            cropped->images[i] = image_crop(images->images[i], x0, y0, x1 - x0, y1 - y0, width, height);
+    }
+
+    crop->active = 1;
+    crop->x = x0;
+    crop->y = y0;
+    crop->width = x1 - x0;
+    crop->height = y1 - y0;
+    crop->scale = 1;
+
+    return 1;
+
+}
+
+// Interprets the last received reply of the server for the given object, returns the type of the message or TRAX_ERROR
+static int client_process_reply(trax_handle* client, int result, trax_object_list* objects, int index, trax_properties* properties) {
+
+    string_list* arguments = message_arguments((message_stream*)client->stream);
+
+    if (result == TRAX_STATE) {
+
+        region_container *_region = NULL;
+
+        if (list_size(arguments) != 1)
+            return TRAX_ERROR;
+
+        if (client->inflight > 0) {
+            // Replies arrive in the order of frames, the oldest frame in flight is answered
+            int sequence = message_property_int(client, "trax.sequence", -1);
+            if (sequence != client->sequence - client->inflight) {
+                set_error(client, "Protocol error, reply sequence %d does not match frame %d", sequence, client->sequence - client->inflight);
+                return TRAX_ERROR;
+            }
+            if (index == client->objects - 1)
+                client->inflight--;
+        }
+
+        // Shared memory slots of the frame can be reused once all of its replies are received
+        if (index == client->objects - 1 && client->shared)
+            shared_context_acknowledge((shared_context*) client->shared);
+
+        if (client->roi) {
+            const char* value = message_property((message_stream*)client->stream, "trax.roi");
+            if (value) roi_parse(value, &((roi_state*) client->roi)->request);
+        }
+
+        if (!region_parse(arguments->buffer[0], &_region))
+            return TRAX_ERROR;
+
+        trax_object_list_set(objects, index, _region);
+        region_release(&_region);
+        copy_message_properties(client, trax_object_list_properties(objects, index), COPY_ALL | COPY_OVERWRITE);
+
+    } else if (result == TRAX_QUIT) {
+
+        if (list_size(arguments) != 0)
+            return TRAX_ERROR;
+
+        if (properties)
+            copy_message_properties(client, properties, COPY_ALL | COPY_OVERWRITE);
+
+        client->flags |= TRAX_FLAG_TERMINATED;
+        client->inflight = 0;
+
+    }
+
+    return result;
+
+}
+
+int trax_client_wait(trax_handle* client, trax_object_list** objects, trax_properties* properties) {
 
-    metadata->custom = trax_properties_create();
+    int result = TRAX_ERROR;
 
-    metadata->flags = flags;
+    (*objects) = NULL;
 
-    return metadata;
+    VALIDATE_CLIENT_HANDLE(client);
 
-}
+    if (!HANDLE_ALIVE(client)) {
+        set_error(client, "Tracker not alive");
+        return TRAX_ERROR;
+    }
 
-void trax_metadata_release(trax_metadata** metadata) {
+    (*objects) = trax_object_list_create(client->objects);
 
-    if (!*metadata) return;
+    for (int i = 0; i < client->objects; i++) {
 
-    if ((*metadata)->tracker_name) free((*metadata)->tracker_name);
-    if ((*metadata)->tracker_description) free((*metadata)->tracker_description);
-    if ((*metadata)->tracker_family) free((*metadata)->tracker_family);
+        result = read_message((message_stream*)client->stream, &LOGGER(client));
 
-    if ((*metadata)->custom) trax_properties_release(&(*metadata)->custom);
+        result = client_process_reply(client, result, *objects, i, properties);
 
-    free(*metadata);
+        if (result == TRAX_QUIT || result == TRAX_ERROR) {
+            trax_object_list_release(objects);
+            break;
+        }
 
-    *metadata = NULL;
+    }
+
+    return result;
 
 }
 
+// State of a reply that is received incrementally
+typedef struct client_pending {
+    trax_object_list* objects;
+    int received;
+} client_pending;
 
-trax_handle* trax_client_setup_file(int input, int output, const trax_logging log) {
+static client_pending* client_pending_create(trax_handle* client) {
 
-    message_stream* stream = create_message_stream_file(input, output);
+    client_pending* pending = (client_pending*) malloc(sizeof(client_pending));
 
-    return client_setup(stream, log);
+    pending->objects = trax_object_list_create(client->objects);
+    pending->received = 0;
+
+    return pending;
 
 }
 
-trax_handle* trax_client_setup_socket(int server, int timeout, const trax_logging log) {
+static void client_pending_release(client_pending** pending) {
 
-    message_stream* stream = create_message_stream_socket_accept(server, timeout);
+    if (!*pending) return;
 
-    if (!stream) return NULL;
+    if ((*pending)->objects) trax_object_list_release(&(*pending)->objects);
 
-    return client_setup(stream, log);
+    free(*pending);
+    *pending = NULL;
 
 }
 
-int trax_client_wait(trax_handle* client, trax_object_list** objects, trax_properties* properties) {
+int trax_client_wait_try(trax_handle* client, trax_object_list** objects, trax_properties* properties) {
 
-    trax_properties* tmp_properties;
-    string_list* arguments;
+    client_pending* pending;
     int result = TRAX_ERROR;
 
     (*objects) = NULL;
@@ -782,69 +1940,31 @@ int trax_client_wait(trax_handle* client, trax_object_list** objects, trax_prope
         return TRAX_ERROR;
     }
 
-    (*objects) = trax_object_list_create(client->objects);
-
-    for (int i = 0; i < client->objects; i++) {
-
-        tmp_properties = trax_properties_create();
-        arguments = list_create(8);
-        result = read_message((message_stream*)client->stream, &LOGGER(client), arguments, tmp_properties);
+    if (!client->pending) client->pending = client_pending_create(client);
 
-        if (result == TRAX_STATE) {
+    pending = (client_pending*) client->pending;
 
-            region_container *_region = NULL;
-
-            if (list_size(arguments) != 1) {
-                list_destroy(&arguments);
-                trax_properties_release(&tmp_properties);
-                trax_object_list_release(objects);
-                result = TRAX_ERROR;
-                break;
-            }
-            
-            if (!region_parse(arguments->buffer[0], &_region)) {
-                list_destroy(&arguments);
-                trax_properties_release(&tmp_properties);
-                trax_object_list_release(objects);
-                result = TRAX_ERROR;
-                break;
-            }
+    while (pending->received < client->objects) {
 
-            trax_object_list_set((*objects), i, _region);
-            region_release(&_region);
-            copy_properties(tmp_properties, trax_object_list_properties((*objects), i), COPY_ALL | COPY_OVERWRITE);
+        result = read_message_try((message_stream*)client->stream, &LOGGER(client));
 
-        } else if (result == TRAX_QUIT) {
+        if (result == TRAX_PENDING) return TRAX_PENDING;
 
-            if (list_size(arguments) != 0) {
-                list_destroy(&arguments);
-                trax_properties_release(&tmp_properties);
-                trax_object_list_release(objects);
-                result = TRAX_ERROR;
-                break;
-            }
-    
-            if (properties)
-                copy_properties(tmp_properties, properties, COPY_ALL | COPY_OVERWRITE);
+        result = client_process_reply(client, result, pending->objects, pending->received, properties);
 
-            client->flags |= TRAX_FLAG_TERMINATED;
+        if (result == TRAX_QUIT || result == TRAX_ERROR) break;
 
-            list_destroy(&arguments);
-            trax_properties_release(&tmp_properties);
-            trax_object_list_release(objects);
-            break;
-        } else if (result == TRAX_ERROR) {
-            list_destroy(&arguments);
-            trax_properties_release(&tmp_properties);
-            trax_object_list_release(objects);
-            break;
-        }
+        pending->received++;
 
-        list_destroy(&arguments);
-        trax_properties_release(&tmp_properties);
+    }
 
+    if (result != TRAX_QUIT && result != TRAX_ERROR) {
+        (*objects) = pending->objects;
+        pending->objects = NULL;
     }
 
+    client_pending_release((client_pending**) &client->pending);
+
     return result;
 
 }
@@ -879,6 +1999,14 @@ int trax_client_initialize(trax_handle* client, trax_image_list* images, trax_ob
         return TRAX_ERROR;
     }
 
+    if (client->inflight > 0) {
+        set_error(client, "Replies to previous frames not received yet");
+        return TRAX_ERROR;
+    }
+
+    // Initialization frames are always sent whole
+    if (client->roi) ((roi_state*) client->roi)->request.active = 0;
+
     if (IS_VERSION_4(client)) {
         if (client->objects > 0) {
             // Reset object count with an empty initialize message
@@ -905,8 +2033,7 @@ int trax_client_initialize(trax_handle* client, trax_image_list* images, trax_ob
                 set_error(client, "Required image channel not provided (ID: %d)", TRAX_CHANNEL_ID(i));
                 goto failure;
             }
-            char* buffer = image_encode(images->images[i]);
-            list_append_direct(arguments, buffer);
+            image_append(client, arguments, images->images[i], i);
 
         }
     }
@@ -928,7 +2055,12 @@ int trax_client_initialize(trax_handle* client, trax_image_list* images, trax_ob
         free(data);
     }
 
-    write_message((message_stream*)client->stream, &LOGGER(client), TRAX_INITIALIZE, arguments, properties);
+    {
+        trax_properties* tagged = client_sequence_tag(client, properties, NULL);
+        write_message((message_stream*)client->stream, &LOGGER(client), TRAX_INITIALIZE, arguments, tagged ? tagged : properties);
+        if (tagged) trax_properties_release(&tagged);
+        if (client->shared) shared_context_sent((shared_context*) client->shared);
+    }
 
     list_destroy(&arguments);
 
@@ -956,6 +2088,11 @@ int trax_client_frame(trax_handle* client, trax_image_list* images, trax_object_
         return TRAX_ERROR;
     }
 
+    if (client->pipeline > 0 && client->inflight >= client->pipeline) {
+        set_error(client, "Too many frames in flight");
+        return TRAX_ERROR;
+    }
+
     if (IS_VERSION_4(client)) {
 
         int n = (objects) ? trax_object_list_count(objects) : 0;
@@ -965,6 +2102,12 @@ int trax_client_frame(trax_handle* client, trax_image_list* images, trax_object_
             return TRAX_ERROR;
         }
 
+        // The number of replies to a frame has to be known when it is received
+        if (n > 0 && client->inflight > 0) {
+            set_error(client, "Unable to add new objects while frames are in flight");
+            return TRAX_ERROR;
+        }
+
         for (i = 0; i < n; i++) {
             char* data = NULL;
             string_list* arguments;
@@ -1007,28 +2150,67 @@ int trax_client_frame(trax_handle* client, trax_image_list* images, trax_object_
 
     {
         string_list* arguments;
+        trax_properties* tagged;
+        trax_image_list cropped;
+        roi_rectangle crop;
+
+        for (i = 0; i < TRAX_CHANNELS; i++) {
+            if (TRAX_SUPPORTS(client->metadata->channels, TRAX_CHANNEL_ID(i)) && !images->images[i]) {
+                set_error(client, "Required image channel not provided (ID: %d)", TRAX_CHANNEL_ID(i));
+                return TRAX_ERROR;
+            }
+        }
+
+        memset(&cropped, 0, sizeof(trax_image_list));
+
+        // Frames that add new objects are sent whole
+        if (!objects || trax_object_list_count(objects) == 0) {
+            if (!client_crop_frame(client, images, &cropped, &crop)) crop.active = 0;
+        } else crop.active = 0;
+
         arguments = list_create(1);
 
         for (i = 0; i < TRAX_CHANNELS; i++) {
-            if (TRAX_SUPPORTS(client->metadata->channels, TRAX_CHANNEL_ID(i))) {
-                if (!images->images[i]) {
-                    set_error(client, "Required image channel not provided (ID: %d)", TRAX_CHANNEL_ID(i));
-                    list_destroy(&arguments);
-                    return TRAX_ERROR;
-                }
-                char* buffer = image_encode(images->images[i]);
-                list_append_direct(arguments, buffer);
-            } 
+            if (TRAX_SUPPORTS(client->metadata->channels, TRAX_CHANNEL_ID(i)))
+                image_append(client, arguments, crop.active ? cropped.images[i] : images->images[i], i);
         }
 
-        write_message((message_stream*)client->stream, &LOGGER(client), TRAX_FRAME, arguments, properties);
+        tagged = client_sequence_tag(client, properties, crop.active ? &crop : NULL);
+        write_message((message_stream*)client->stream, &LOGGER(client), TRAX_FRAME, arguments, tagged ? tagged : properties);
+        if (tagged) trax_properties_release(&tagged);
+        if (client->shared) shared_context_sent((shared_context*) client->shared);
         list_destroy(&arguments);
 
+        for (i = 0; i < TRAX_CHANNELS; i++) {
+            if (cropped.images[i]) trax_image_release(&cropped.images[i]);
+        }
+
         return TRAX_OK;
     }
 
 }
 
+int trax_client_frame_begin(trax_handle* client, trax_image_list* images, trax_object_list* objects, trax_properties* properties) {
+
+    int result;
+
+    VALIDATE_CLIENT_HANDLE(client);
+
+    // With pipelining the frame limit is checked when the frame is sent
+    if (client->pending && client->pipeline < 2) {
+        set_error(client, "Previous reply not received yet");
+        return TRAX_ERROR;
+    }
+
+    result = trax_client_frame(client, images, objects, properties);
+
+    if (result == TRAX_OK && !client->pending)
+        client->pending = client_pending_create(client);
+
+    return result;
+
+}
+
 trax_handle* trax_server_setup_v(trax_metadata *metadata, const trax_logging log, int version) {
 
     message_stream* stream;
@@ -1037,7 +2219,15 @@ trax_handle* trax_server_setup_v(trax_metadata *metadata, const trax_logging log
 
     if (env_socket) {
 
-        stream = create_message_stream_socket_connect(atoi(env_socket));
+        // Either a TCP port, a Unix domain socket path or an inherited connected socket
+        if (compare_prefix(env_socket, "unix:"))
+            stream = create_message_stream_socket_connect_unix(env_socket + 5);
+        else if (compare_prefix(env_socket, "fd:"))
+            stream = create_message_stream_socket(atoi(env_socket + 3));
+        else
+            stream = create_message_stream_socket_connect(atoi(env_socket));
+
+        if (!stream) return NULL;
 
     } else {
 
@@ -1075,7 +2265,6 @@ int trax_server_wait_sot(trax_handle* server, trax_image_list** images, trax_reg
     int result = TRAX_ERROR;
     int i, j = 0;
     string_list* arguments;
-    trax_properties* tmp_properties;
 
     VALIDATE_SERVER_HANDLE(server);
 
@@ -1093,10 +2282,13 @@ int trax_server_wait_sot(trax_handle* server, trax_image_list** images, trax_reg
 
     int argument_count = trax_image_list_count(server->metadata->channels);
 
-    tmp_properties = trax_properties_create();
-    arguments = list_create(8);
+    result = read_message((message_stream*)server->stream, &LOGGER(server));
+    arguments = message_arguments((message_stream*)server->stream);
 
-    result = read_message((message_stream*)server->stream, &LOGGER(server), arguments, tmp_properties);
+    server->sequence = message_property_int(server, "trax.sequence", -1);
+
+    if (server->roi)
+        roi_parse(message_property((message_stream*)server->stream, "trax.roi"), &((roi_state*) server->roi)->frame);
 
     if (result == TRAX_FRAME) {
 
@@ -1111,7 +2303,7 @@ int trax_server_wait_sot(trax_handle* server, trax_image_list** images, trax_reg
 
             if (TRAX_SUPPORTS(server->metadata->channels, TRAX_CHANNEL_ID(i))) {
 
-                (*images)->images[i] = image_decode(arguments->buffer[j]);
+                (*images)->images[i] = image_extract(server, arguments, j, i);
                 if (!(*images)->images[i] || !TRAX_SUPPORTS(server->metadata->format_image, (*images)->images[i]->type))
                     goto failure;
                 j++;
@@ -1121,7 +2313,7 @@ int trax_server_wait_sot(trax_handle* server, trax_image_list** images, trax_reg
         }
 
         if (properties)
-            copy_properties(tmp_properties, properties, COPY_ALL | COPY_OVERWRITE);
+            copy_message_properties(server, properties, COPY_ALL | COPY_OVERWRITE);
         goto end;
 
     } else if (result == TRAX_QUIT) {
@@ -1132,7 +2324,7 @@ int trax_server_wait_sot(trax_handle* server, trax_image_list** images, trax_reg
         }   
 
         if (properties)
-            copy_properties(tmp_properties, properties, COPY_ALL | COPY_OVERWRITE);
+            copy_message_properties(server, properties, COPY_ALL | COPY_OVERWRITE);
 
         server->flags |= TRAX_FLAG_TERMINATED;
 
@@ -1151,7 +2343,7 @@ int trax_server_wait_sot(trax_handle* server, trax_image_list** images, trax_reg
 
             if (TRAX_SUPPORTS(server->metadata->channels, TRAX_CHANNEL_ID(i))) {
 
-                (*images)->images[i] = image_decode(arguments->buffer[j]);
+                (*images)->images[i] = image_extract(server, arguments, j, i);
                 if (!(*images)->images[i] || !TRAX_SUPPORTS(server->metadata->format_image, (*images)->images[i]->type))
                     goto failure;
                 j++;
@@ -1165,7 +2357,7 @@ int trax_server_wait_sot(trax_handle* server, trax_image_list** images, trax_reg
         }
 
         if (properties)
-            copy_properties(tmp_properties, properties, COPY_ALL | COPY_OVERWRITE);
+            copy_message_properties(server, properties, COPY_ALL | COPY_OVERWRITE);
 
         server->objects = 1;
 
@@ -1188,9 +2380,6 @@ failure:
 
 end:
 
-    list_destroy(&arguments);
-    trax_properties_release(&tmp_properties);
-
     return result;
 }
 
@@ -1199,7 +2388,6 @@ int trax_server_wait_mot(trax_handle* server, trax_image_list** images, trax_obj
     int result = TRAX_ERROR;
     int i, j = 0;
     string_list* arguments;
-    trax_properties* tmp_properties;
     int object_capacity = 1;
     int object_count = 0;
     trax_region** object_regions = (trax_region**) malloc(sizeof(trax_region*) * object_capacity);
@@ -1219,10 +2407,9 @@ int trax_server_wait_mot(trax_handle* server, trax_image_list** images, trax_obj
     int argument_count = trax_image_list_count(server->metadata->channels);
 
     while (1) {
-        tmp_properties = trax_properties_create();
-        arguments = list_create(8);
+        int code = read_message((message_stream*)server->stream, &LOGGER(server));
 
-        int code = read_message((message_stream*)server->stream, &LOGGER(server), arguments, tmp_properties);
+        arguments = message_arguments((message_stream*)server->stream);
 
         if (code == TRAX_ERROR) {
             goto failure;
@@ -1236,7 +2423,7 @@ int trax_server_wait_mot(trax_handle* server, trax_image_list** images, trax_obj
             }   
 
             if (properties)
-                copy_properties(tmp_properties, properties, COPY_EXTERNAL | COPY_OVERWRITE);
+                copy_message_properties(server, properties, COPY_EXTERNAL | COPY_OVERWRITE);
 
             result = TRAX_QUIT;
             server->flags |= TRAX_FLAG_TERMINATED;
@@ -1245,6 +2432,11 @@ int trax_server_wait_mot(trax_handle* server, trax_image_list** images, trax_obj
 
         if (code == TRAX_FRAME) {
 
+            server->sequence = message_property_int(server, "trax.sequence", -1);
+
+            if (server->roi)
+                roi_parse(message_property((message_stream*)server->stream, "trax.roi"), &((roi_state*) server->roi)->frame);
+
             if (result == TRAX_INITIALIZE && object_count == 0) {
                 set_error(server, "No object was given to track");
                 goto failure;
@@ -1263,7 +2455,7 @@ int trax_server_wait_mot(trax_handle* server, trax_image_list** images, trax_obj
 
                 if (TRAX_SUPPORTS(server->metadata->channels, TRAX_CHANNEL_ID(i))) {
 
-                    (*images)->images[i] = image_decode(arguments->buffer[j]);
+                    (*images)->images[i] = image_extract(server, arguments, j, i);
                     if (!(*images)->images[i] || !TRAX_SUPPORTS(server->metadata->format_image, (*images)->images[i]->type))
                         goto failure;
                     j++;
@@ -1273,7 +2465,7 @@ int trax_server_wait_mot(trax_handle* server, trax_image_list** images, trax_obj
             }
 
             if (properties)
-                copy_properties(tmp_properties, properties, COPY_ALL | COPY_OVERWRITE);
+                copy_message_properties(server, properties, COPY_ALL | COPY_OVERWRITE);
             goto end;
         }
 
@@ -1304,14 +2496,11 @@ int trax_server_wait_mot(trax_handle* server, trax_image_list** images, trax_obj
             }
 
             object_properties[object_count-1] = trax_properties_create();
-            copy_properties(tmp_properties, object_properties[object_count-1], COPY_ALL | COPY_OVERWRITE);
+            copy_message_properties(server, object_properties[object_count-1], COPY_ALL | COPY_OVERWRITE);
 
             result = TRAX_INITIALIZE;
         }
 
-        list_destroy(&arguments);
-        trax_properties_release(&tmp_properties);
-
     }
 
 failure:
@@ -1344,19 +2533,43 @@ end:
         server->objects += object_count;
     } 
 
-    if (arguments) list_destroy(&arguments);
-    if (tmp_properties) trax_properties_release(&tmp_properties);
-
     free(object_regions);
     free(object_properties);
 
     return result;
 }
 
+// Returns a copy of the reply properties tagged with the sequence number of the current frame and a pending
+// region of interest request that is sent with the last reply to the frame, returns NULL if nothing is added
+static trax_properties* server_sequence_tag(trax_handle* server, trax_properties* properties, int last) {
+
+    trax_properties* tagged;
+    roi_state* roi = (roi_state*) server->roi;
+    int request = last && roi && roi->request.active;
+
+    if (server->sequence < 0 && !request) return NULL;
+
+    tagged = properties ? trax_properties_copy(properties) : trax_properties_create();
+
+    if (server->sequence >= 0)
+        trax_properties_set_int(tagged, "trax.sequence", server->sequence);
+
+    if (request) {
+        char tmp[BUFFER_LENGTH];
+        roi_encode(&roi->request, tmp);
+        trax_properties_set(tagged, "trax.roi", tmp);
+        roi->request.active = 0;
+    }
+
+    return tagged;
+
+}
+
 int trax_server_reply_sot(trax_handle* server, trax_region* region, trax_properties* properties) {
 
     char* data;
     string_list* arguments;
+    trax_properties* tagged;
 
     VALIDATE_SERVER_HANDLE(server);
 
@@ -1380,7 +2593,9 @@ int trax_server_reply_sot(trax_handle* server, trax_region* region, trax_propert
 
     list_append_direct(arguments, data);
 
-    write_message((message_stream*)server->stream, &LOGGER(server), TRAX_STATE, arguments, properties);
+    tagged = server_sequence_tag(server, properties, 1);
+    write_message((message_stream*)server->stream, &LOGGER(server), TRAX_STATE, arguments, tagged ? tagged : properties);
+    if (tagged) trax_properties_release(&tagged);
 
     list_destroy(&arguments);
 
@@ -1393,6 +2608,7 @@ int trax_server_reply_mot(trax_handle* server, trax_object_list* objects) {
     int n, i;
     char* data;
     string_list* arguments;
+    trax_properties* tagged;
 
     VALIDATE_SERVER_HANDLE(server);
 
@@ -1422,7 +2638,9 @@ int trax_server_reply_mot(trax_handle* server, trax_object_list* objects) {
         if (!data) return TRAX_ERROR;
         arguments = list_create(1);
         list_append_direct(arguments, data);
-        write_message((message_stream*)server->stream, &LOGGER(server), TRAX_STATE, arguments, trax_object_list_properties(objects, i));
+        tagged = server_sequence_tag(server, trax_object_list_properties(objects, i), i == n - 1);
+        write_message((message_stream*)server->stream, &LOGGER(server), TRAX_STATE, arguments, tagged ? tagged : trax_object_list_properties(objects, i));
+        if (tagged) trax_properties_release(&tagged);
         list_destroy(&arguments);
     }
 
@@ -1430,6 +2648,56 @@ int trax_server_reply_mot(trax_handle* server, trax_object_list* objects) {
 }
 
 
+int trax_server_request_roi(trax_handle* server, int x, int y, int width, int height, float scale) {
+
+    roi_state* roi;
+
+    VALIDATE_SERVER_HANDLE(server);
+
+    clear_error(server);
+
+    if (!server->roi) {
+        set_error(server, "Region of interest not enabled");
+        return TRAX_ERROR;
+    }
+
+    if (width < 1 || height < 1 || !(scale > 0 && scale <= 1)) {
+        set_error(server, "Illegal region of interest");
+        return TRAX_ERROR;
+    }
+
+    roi = (roi_state*) server->roi;
+
+    roi->request.active = 1;
+    roi->request.x = x;
+    roi->request.y = y;
+    roi->request.width = width;
+    roi->request.height = height;
+    roi->request.scale = scale;
+
+    return TRAX_OK;
+
+}
+
+int trax_server_get_roi(trax_handle* server, int* x, int* y, int* width, int* height) {
+
+    roi_state* roi;
+
+    VALIDATE_SERVER_HANDLE(server);
+
+    roi = (roi_state*) server->roi;
+
+    if (!roi || !roi->frame.active) return 0;
+
+    if (x) *x = roi->frame.x;
+    if (y) *y = roi->frame.y;
+    if (width) *width = roi->frame.width;
+    if (height) *height = roi->frame.height;
+
+    return 1;
+
+}
+
 const char* trax_get_error(trax_handle* handle) {
 
     VALIDATE_HANDLE(handle);
@@ -1487,6 +2755,17 @@ int trax_cleanup(trax_handle** handle) {
 
     destroy_message_stream((message_stream**) & (*handle)->stream);
 
+    shared_context_destroy((shared_context**) & (*handle)->shared);
+
+    client_pending_release((client_pending**) & (*handle)->pending);
+
+    // Received images that are still in use keep the pool alive
+    if ((*handle)->pool) image_pool_retire((image_pool*) (*handle)->pool);
+
+    if ((*handle)->roi) free((*handle)->roi);
+
+    delta_context_destroy((delta_context**) & (*handle)->delta);
+
     clear_error(*handle);
 
     free(*handle);
@@ -1500,7 +2779,32 @@ int trax_set_parameter(trax_handle* handle, int id, int value) {
     if (!HANDLE_ALIVE(handle))
         return TRAX_ERROR;
 
-    // No settable parameters at the moment.
+    switch (id) {
+    case TRAX_PARAMETER_PIPELINE:
+        // Only available on the client side and if the server echoes sequence numbers
+        if ((handle->flags & TRAX_FLAG_SERVER) || handle->pipeline < 1)
+            return 0;
+        handle->pipeline = (value < 1) ? 1 : value;
+        // Frames in flight must not overwrite shared memory slots that the server may still read
+        if (TRAX_SUPPORTS(handle->metadata->format_image, TRAX_IMAGE_SHM) && handle->pipeline > SHARED_SLOTS - 1)
+            handle->pipeline = SHARED_SLOTS - 1;
+        return 1;
+    case TRAX_PARAMETER_CAPACITY:
+        return message_stream_set_capacity((message_stream*)handle->stream, value) ? 1 : 0;
+    case TRAX_PARAMETER_POOL:
+        if (!handle->pool) return 0;
+        image_pool_set_capacity((image_pool*) handle->pool, value);
+        return 1;
+    case TRAX_PARAMETER_DELTA:
+        // Only the client decides, the server has to support reconstruction of frames
+        if ((handle->flags & TRAX_FLAG_SERVER) || !(handle->metadata->flags & TRAX_METADATA_DELTA))
+            return 0;
+        if (value && !handle->delta)
+            handle->delta = delta_context_create();
+        else if (!value)
+            delta_context_destroy((delta_context**) &handle->delta);
+        return 1;
+    }
 
     return 0;
 }
@@ -1523,6 +2827,30 @@ int trax_get_parameter(trax_handle* handle, int id, int* value) {
     case TRAX_PARAMETER_MULTIOBJECT:
         *value = ((handle->metadata->flags) & TRAX_METADATA_MULTI_OBJECT) ? 1 : 0;
         return 1;
+    case TRAX_PARAMETER_DESCRIPTOR:
+        *value = message_stream_descriptor((message_stream*)handle->stream);
+        return 1;
+    case TRAX_PARAMETER_PIPELINE:
+        *value = handle->pipeline;
+        return 1;
+    case TRAX_PARAMETER_CAPACITY:
+        *value = message_stream_get_capacity((message_stream*)handle->stream);
+        return (*value < 0) ? 0 : 1;
+    case TRAX_PARAMETER_POOL:
+        *value = handle->pool ? ((image_pool*) handle->pool)->capacity : 0;
+        return 1;
+    case TRAX_PARAMETER_POOL_REUSED:
+        *value = handle->pool ? ((image_pool*) handle->pool)->reused : 0;
+        return 1;
+    case TRAX_PARAMETER_POOL_ALLOCATED:
+        *value = handle->pool ? ((image_pool*) handle->pool)->allocated : 0;
+        return 1;
+    case TRAX_PARAMETER_ROI:
+        *value = handle->roi ? 1 : 0;
+        return 1;
+    case TRAX_PARAMETER_DELTA:
+        *value = handle->delta ? 1 : 0;
+        return 1;
     }
 
     return 0;
@@ -1530,7 +2858,11 @@ int trax_get_parameter(trax_handle* handle, int id, int* value) {
 
 void trax_image_release(trax_image** image) {
 
-    if ((*image)->data) {
+    if ((*image)->release) {
+        // Data is owned by someone else
+        (*image)->release(*image);
+        (*image)->data = 0;
+    } else if ((*image)->data) {
         free((*image)->data);
         (*image)->data = 0;
     }
@@ -1548,6 +2880,9 @@ trax_image* trax_image_create_path(const char* path) {
     img->width = 0;
     img->height = 0;
     img->data = (char*) malloc(sizeof(char) * (strlen(path) + 1));
+    img->release = NULL;
+    img->owner = NULL;
+    img->stride = 0;
     strcpy(img->data, path);
 
     return img;
@@ -1561,6 +2896,9 @@ trax_image* trax_image_create_url(const char* url) {
     img->width = 0;
     img->height = 0;
     img->data = (char*) malloc(sizeof(char) * (strlen(url) + 1));
+    img->release = NULL;
+    img->owner = NULL;
+    img->stride = 0;
     strcpy(img->data, url);
 
     return img;
@@ -1569,16 +2907,41 @@ trax_image* trax_image_create_url(const char* url) {
 
 trax_image* trax_image_create_memory(int width, int height, int format) {
 
-    int channels, depth;
+    int size;
+    trax_image* img;
+
+    size = memory_size(width, height, format);
+
+    assert(size > 0);
+
+    img = (trax_image*) malloc(sizeof(trax_image));
+
+    img->type = TRAX_IMAGE_MEMORY;
+    img->width = width;
+    img->height = height;
+    img->format = format;
+    img->data = (char*) malloc(sizeof(char) * size);
+    img->release = NULL;
+    img->owner = NULL;
+    img->stride = 0;
+
+    return img;
+
+}
+
+// Memory of a wrapped image without a release callback belongs to the caller
+static void image_release_borrowed(trax_image* image) {
+    (void) image;
+}
+
+trax_image* trax_image_create_memory_wrap(int width, int height, int format, int stride, char* data, void (*release)(trax_image* image), void* owner) {
+
     trax_image* img;
 
-    assert(format == TRAX_IMAGE_MEMORY_GRAY8 ||
-           format == TRAX_IMAGE_MEMORY_GRAY16 || format == TRAX_IMAGE_MEMORY_RGB);
+    assert(memory_size(width, height, format) > 0);
+    assert(stride == 0 || stride >= memory_row_size(width, format));
 
-    depth = format == TRAX_IMAGE_MEMORY_RGB ? 1 :
-            (format == TRAX_IMAGE_MEMORY_GRAY8 ? 1 :
-             (format == TRAX_IMAGE_MEMORY_GRAY16 ? 2 : 0));
-    channels = format == TRAX_IMAGE_MEMORY_RGB ? 3 : 1;
+    if (!data) return NULL;
 
     img = (trax_image*) malloc(sizeof(trax_image));
 
@@ -1586,7 +2949,10 @@ trax_image* trax_image_create_memory(int width, int height, int format) {
     img->width = width;
     img->height = height;
     img->format = format;
-    img->data = (char*) malloc(sizeof(char) * (width * height * depth * channels));
+    img->data = data;
+    img->release = release ? release : image_release_borrowed;
+    img->owner = owner;
+    img->stride = stride;
 
     return img;
 
@@ -1608,12 +2974,115 @@ trax_image* trax_image_create_buffer(int length, const char* data) {
     img->height = 1;
     img->format = format;
     img->data = (char*) malloc(sizeof(char) * length);
+    img->release = NULL;
+    img->owner = NULL;
+    img->stride = 0;
     memcpy(img->data, data, length);
 
     return img;
 
 }
 
+trax_image* trax_image_create_memory_descriptor(int descriptor, int width, int height, int format) {
+
+    int size, copy;
+    trax_image* img;
+    shared_segment* segment;
+
+    size = memory_size(width, height, format);
+
+    assert(size > 0);
+
+    if (shared_descriptor_size(descriptor) < size) return NULL;
+
+    copy = shared_descriptor_duplicate(descriptor);
+
+    if (copy < 0) return NULL;
+
+    segment = shared_segment_map(copy, size, 0);
+
+    if (!segment) {
+        shared_descriptor_close(copy);
+        return NULL;
+    }
+
+    img = (trax_image*) malloc(sizeof(trax_image));
+
+    img->type = TRAX_IMAGE_MEMORY;
+    img->width = width;
+    img->height = height;
+    img->format = format;
+    img->data = segment->data;
+    img->release = image_release_shared;
+    img->owner = segment;
+    img->stride = 0;
+
+    shared_segment_reference(segment);
+
+    return img;
+
+}
+
+// Maps an encoded image from a descriptor that is owned by the image from now on
+static trax_image* image_map_buffer(int descriptor) {
+
+    int length, format;
+    trax_image* img;
+    shared_segment* segment;
+
+    length = shared_descriptor_size(descriptor);
+
+    segment = (length < 5) ? NULL : shared_segment_map(descriptor, length, 0);
+
+    if (!segment) {
+        shared_descriptor_close(descriptor);
+        return NULL;
+    }
+
+    shared_segment_reference(segment);
+
+    format = verify_image_format(segment->data);
+
+    if (format == TRAX_IMAGE_BUFFER_ILLEGAL) {
+        shared_segment_dereference(segment);
+        return NULL;
+    }
+
+    img = (trax_image*) malloc(sizeof(trax_image));
+
+    img->type = TRAX_IMAGE_BUFFER;
+    img->width = length;
+    img->height = 1;
+    img->format = format;
+    img->data = segment->data;
+    img->release = image_release_shared;
+    img->owner = segment;
+    img->stride = 0;
+
+    return img;
+
+}
+
+trax_image* trax_image_create_buffer_descriptor(int descriptor) {
+
+    int copy = shared_descriptor_duplicate(descriptor);
+
+    if (copy < 0) return NULL;
+
+    return image_map_buffer(copy);
+
+}
+
+trax_image* trax_image_create_buffer_file(const char* path) {
+
+    int descriptor = shared_descriptor_open(path);
+
+    if (descriptor < 0) return NULL;
+
+    return image_map_buffer(descriptor);
+
+}
+
 int trax_image_get_type(const trax_image* image) {
 
     if (!image) return TRAX_IMAGE_EMPTY;
@@ -1647,36 +3116,28 @@ void trax_image_get_memory_header(const trax_image* image, int* width, int* heig
 
 }
 
-#define MEMORY_DEPTH(image) (image->format == TRAX_IMAGE_MEMORY_RGB ? 1 : \
-    (image->format == TRAX_IMAGE_MEMORY_GRAY8 ? 1 : \
-    (image->format == TRAX_IMAGE_MEMORY_GRAY16 ? 2 : 0))) \
+int trax_image_get_memory_stride(const trax_image* image) {
 
-#define MEMORY_CHANNELS(image) (image->format == TRAX_IMAGE_MEMORY_RGB ? 3 : 1)
+    assert(image->type == TRAX_IMAGE_MEMORY);
 
-char* trax_image_write_memory_row(trax_image* image, int row) {
+    return MEMORY_STRIDE(image);
 
-    int depth, channels;
+}
 
-    assert(image->type == TRAX_IMAGE_MEMORY);
-    assert(row >= 0 && row < image->height);
+char* trax_image_write_memory_row(trax_image* image, int row) {
 
-    depth = MEMORY_DEPTH(image);
-    channels = MEMORY_CHANNELS(image);
+    assert(image->type == TRAX_IMAGE_MEMORY);
+    assert(row >= 0 && row < memory_rows(image->height, image->format));
 
-    return &(image->data[depth * channels * row]);
+    return &(image->data[MEMORY_STRIDE(image) * row]);
 }
 
 const char* trax_image_get_memory_row(const trax_image* image, int row) {
 
-    int depth, channels;
-
     assert(image->type == TRAX_IMAGE_MEMORY);
-    assert(row >= 0 && row < image->height);
-
-    depth = MEMORY_DEPTH(image);
-    channels = MEMORY_CHANNELS(image);
+    assert(row >= 0 && row < memory_rows(image->height, image->format));
 
-    return &(image->data[depth * channels * row]);
+    return &(image->data[MEMORY_STRIDE(image) * row]);
 }
 
 const char* trax_image_get_buffer(const trax_image* image, int* length, int* format) {
@@ -137,6 +137,8 @@ Metadata::Metadata(trax_metadata* metadata) {
     wrap(trax_metadata_create(metadata->format_region, metadata->format_image, metadata->channels,
 		metadata->tracker_name, metadata->tracker_description, metadata->tracker_family, metadata->flags));
 
+    this->metadata->format_memory = metadata->format_memory;
+
 }
 
 Metadata::~Metadata() {
@@ -150,6 +152,18 @@ int Metadata::image_formats() const {
 
 }
 
+int Metadata::memory_formats() const {
+
+	return metadata->format_memory;
+
+}
+
+void Metadata::set_memory_formats(int formats) {
+
+	metadata->format_memory = formats | TRAX_IMAGE_MEMORY_DEFAULT;
+
+}
+
 int Metadata::region_formats() const {
 
 	return metadata->format_region;
@@ -380,6 +394,51 @@ int Client::frame(const ImageList& image, const ObjectList& objects, const Prope
 
 }
 
+int Client::frame_begin(const ImageList& image, const Properties& properties) {
+	if (!claims()) return -1;
+
+	return trax_client_frame_begin(handle, image.list, NULL, properties.properties);
+
+}
+
+int Client::frame_begin(const ImageList& image, const ObjectList& objects, const Properties& properties) {
+
+	if (!claims()) return -1;
+
+	return trax_client_frame_begin(handle, image.list, objects.list, properties.properties);
+
+}
+
+int Client::wait_try(ObjectList& objects, Properties& properties) {
+
+	if (!claims()) return -1;
+
+	trax_object_list* tobjects = NULL;
+
+	properties.ensure_unique();
+
+	int result = trax_client_wait_try(handle, &tobjects, properties.properties);
+
+	if (tobjects) {
+		objects.wrap(tobjects);
+	}
+
+	return result;
+
+}
+
+int Client::descriptor() {
+
+	int value = -1;
+
+	if (!claims()) return -1;
+
+	trax_get_parameter(handle, TRAX_PARAMETER_DESCRIPTOR, &value);
+
+	return value;
+
+}
+
 ServerSOT::ServerSOT(Metadata metadata, Logging log) {
 
 	wrap(trax_server_setup_v(metadata.metadata, log, 3));
@@ -421,6 +480,22 @@ int ServerSOT::reply(const Region& region, const Properties& properties) {
 
 }
 
+int ServerSOT::request_roi(int x, int y, int width, int height, float scale) {
+
+	if (!claims()) return -1;
+
+	return trax_server_request_roi(handle, x, y, width, height, scale);
+
+}
+
+bool ServerSOT::get_roi(int* x, int* y, int* width, int* height) {
+
+	if (!claims()) return false;
+
+	return trax_server_get_roi(handle, x, y, width, height) != 0;
+
+}
+
 ServerMOT::ServerMOT(Metadata metadata, Logging log) {
 
 	wrap(trax_server_setup_v(metadata.metadata, log, 0));
@@ -509,6 +584,22 @@ int ServerMOT::reply(const ObjectList& objects) {
 
 }
 
+int ServerMOT::request_roi(int x, int y, int width, int height, float scale) {
+
+	if (!claims()) return -1;
+
+	return trax_server_request_roi(handle, x, y, width, height, scale);
+
+}
+
+bool ServerMOT::get_roi(int* x, int* y, int* width, int* height) {
+
+	if (!claims()) return false;
+
+	return trax_server_get_roi(handle, x, y, width, height) != 0;
+
+}
+
 Image::Image() {
 	image = NULL;
 }
@@ -551,12 +642,36 @@ Image Image::create_memory(int width, int height, int format) {
 	return image;
 }
 
+Image Image::create_memory_wrap(int width, int height, int format, int stride, char* data, void (*release)(trax_image* image), void* owner) {
+	Image image;
+	image.wrap(trax_image_create_memory_wrap(width, height, format, stride, data, release, owner));
+	return image;
+}
+
 Image Image::create_buffer(int length, const char* data) {
 	Image image;
 	image.wrap(trax_image_create_buffer(length, data));
 	return image;
 }
 
+Image Image::create_memory_descriptor(int descriptor, int width, int height, int format) {
+	Image image;
+	image.wrap(trax_image_create_memory_descriptor(descriptor, width, height, format));
+	return image;
+}
+
+Image Image::create_buffer_descriptor(int descriptor) {
+	Image image;
+	image.wrap(trax_image_create_buffer_descriptor(descriptor));
+	return image;
+}
+
+Image Image::create_buffer_file(const std::string& path) {
+	Image image;
+	image.wrap(trax_image_create_buffer_file(path.c_str()));
+	return image;
+}
+
 Image::~Image() {
 	release();
 }
@@ -581,6 +696,10 @@ void Image::get_memory_header(int* width, int* height, int* format) const {
 	trax_image_get_memory_header(image, width, height, format);
 }
 
+int Image::get_memory_stride() const {
+	return trax_image_get_memory_stride(image);
+}
+
 char* Image::write_memory_row(int row) {
 	return trax_image_write_memory_row(image, row);
 }
@@ -44,8 +44,10 @@
 #include <stdexcept>
 #include <iostream>
 #include <map>
+#include <set>
 #include <string>
 #include <vector>
+#include <deque>
 #include <fstream>
 #include <sstream>
 #include <streambuf>
@@ -84,11 +86,12 @@ __inline void sleep(long time) {
 
 #include "getopt.h"
 #include "region.h"
+#include "threads.h"
 
 using namespace std;
 using namespace trax;
 
-#define CMD_OPTIONS "hsdI:G:f:O:S:r:t:T:p:e:xXQ"
+#define CMD_OPTIONS "hsdI:G:f:O:S:r:t:T:p:e:k:L:xXUPQ"
 
 #ifndef MAX
 #define MAX(a,b) ((a) > (b)) ? (a) : (b)
@@ -111,7 +114,7 @@ void print_help() {
 
     cout << "Usage: traxclient [-h] [-d] [-I image_list] [-O output_file] \n";
     cout << "\t [-f threshold] [-r frames] [-G groundtruth_file] [-e name=value] \n";
-    cout << "\t [-p name=value] [-t timeout] [-s] [-T timing_file] [-x] [-X]\n";
+    cout << "\t [-p name=value] [-t timeout] [-s] [-T timing_file] [-k frames] [-L frames] [-x] [-X] [-U] [-P]\n";
     cout << "\t -- <command_part1> <command_part2> ...";
 
     cout << "\n\nProgram arguments: \n";
@@ -127,9 +130,13 @@ void print_help() {
     cout << "\t-r\tReinitialization offset\n";
     cout << "\t-e\tEnvironmental variable (multiple occurences allowed)\n";
     cout << "\t-p\tTracker parameter (multiple occurences allowed)\n";
+    cout << "\t-k\tNumber of frames sent ahead of tracker replies (if supported by tracker)\n";
+    cout << "\t-L\tNumber of frames loaded in background ahead of the tracker (0 to disable)\n";
     cout << "\t-Q\tWait for tracker to respond, then output its information and quit.\n";
     cout << "\t-x\tUse explicit streams, not standard ones.\n";
     cout << "\t-X\tUse TCP/IP sockets instead of file streams.\n";
+    cout << "\t-U\tUse a Unix domain socket instead of file streams.\n";
+    cout << "\t-P\tUse an inherited socket pair instead of file streams.\n";
     cout << "\n";
 
     cout << "\n";
@@ -374,8 +381,12 @@ Image load_image(string& path, int formats) {
         return Image::create_path(path);
     }
     case TRAX_IMAGE_BUFFER: {
+        // Map the file if possible, the data is then encoded directly from the mapping
+        image = Image::create_buffer_file(path);
+        if (!image.empty())
+            return image;
         // Read the file to memory
-        std::ifstream t(path.c_str());
+        std::ifstream t(path.c_str(), std::ios::binary);
         t.seekg(0, std::ios::end);
         size_t size = t.tellg();
         std::string buffer(size, ' ');
@@ -417,6 +428,169 @@ ImageList load_images(vector<string>& path, int channels, int formats) {
 
 }
 
+#define PREFETCH_THREADS 4
+
+// Loads the images of the frames that follow the requested one in background threads, so that reading
+// and decoding of images overlaps with the tracker processing the current frame. Frames are expected
+// to be requested in order, skipping frames discards the ones that were loaded before them.
+class ImagePrefetcher {
+public:
+
+    ImagePrefetcher(vector<vector<string> >& images, int channels, int formats, int depth) :
+        images(images), channels(channels), formats(formats), depth(MAX(0, depth)),
+        start(0), next(0), limit(0), active(true) {
+
+        workers.resize(MIN(this->depth, PREFETCH_THREADS));
+
+        for (size_t i = 0; i < workers.size(); i++)
+            CREATE_THREAD(workers[i], prefetch_loop, this);
+
+    }
+
+    ~ImagePrefetcher() {
+
+        MUTEX_SYNCHRONIZE(mutex) {
+            active = false;
+        }
+
+        for (size_t i = 0; i < workers.size(); i++) {
+            work.notify();
+            RELEASE_THREAD(workers[i]);
+        }
+
+    }
+
+    ImageList get(size_t frame) {
+
+        if (workers.empty())
+            return load_images(images[frame], channels, formats);
+
+        MUTEX_SYNCHRONIZE(mutex) {
+
+            // Frames before the requested one will not be needed anymore
+            loaded.erase(loaded.begin(), loaded.lower_bound(frame));
+            start = frame;
+            limit = MIN(frame + depth + 1, images.size());
+
+            // A frame that was already taken (when the tracker is reinitialized after sending frames ahead)
+            // is neither loaded nor loading, it has to be scheduled again together with the ones after it
+            if (frame < next && loaded.find(frame) == loaded.end() && loading.find(frame) == loading.end())
+                next = frame;
+            else
+                next = MAX(next, frame);
+
+        }
+
+        work.notify();
+
+        while (true) {
+
+            MUTEX_SYNCHRONIZE(mutex) {
+
+                if (!failure.empty())
+                    throw std::runtime_error(failure);
+
+                map<size_t, ImageList>::iterator it = loaded.find(frame);
+
+                if (it != loaded.end()) {
+                    // Image lists are moved in and out of the queue while it is locked, since their
+                    // reference counts are not shared between threads
+                    ImageList list(std::move(it->second));
+                    loaded.erase(it);
+                    start = frame + 1;
+                    limit = MIN(start + depth, images.size());
+                    work.notify();
+                    return list;
+                }
+
+            }
+
+            // The signal is not latched, a notification that comes before the wait only delays the check
+            ready.wait(10);
+
+        }
+
+    }
+
+private:
+
+    static THREAD_CALLBACK(prefetch_loop, param) {
+
+        ImagePrefetcher* prefetcher = (ImagePrefetcher*) param;
+
+        while (true) {
+
+            size_t frame = 0;
+            bool scheduled = false;
+
+            MUTEX_SYNCHRONIZE(prefetcher->mutex) {
+
+                if (!prefetcher->active)
+                    return 0;
+
+                if (prefetcher->next < prefetcher->limit) {
+                    frame = prefetcher->next++;
+                    prefetcher->loading.insert(frame);
+                    scheduled = true;
+                }
+
+            }
+
+            if (!scheduled) {
+                prefetcher->work.wait(10);
+                continue;
+            }
+
+            try {
+
+                ImageList list = load_images(prefetcher->images[frame], prefetcher->channels, prefetcher->formats);
+
+                MUTEX_SYNCHRONIZE(prefetcher->mutex) {
+                    prefetcher->loading.erase(frame);
+                    if (frame >= prefetcher->start)
+                        prefetcher->loaded[frame] = std::move(list);
+                    else
+                        list = ImageList();
+                }
+
+            } catch (const std::exception &e) {
+
+                MUTEX_SYNCHRONIZE(prefetcher->mutex) {
+                    prefetcher->loading.erase(frame);
+                    prefetcher->failure = e.what();
+                }
+
+            }
+
+            prefetcher->ready.notify();
+
+        }
+
+        return 0;
+
+    }
+
+    vector<vector<string> >& images;
+    int channels;
+    int formats;
+    size_t depth;
+
+    size_t start;
+    size_t next;
+    size_t limit;
+    bool active;
+    string failure;
+
+    map<size_t, ImageList> loaded;
+    set<size_t> loading;
+    vector<THREAD> workers;
+
+    Mutex mutex;
+    Signal work;
+    Signal ready;
+
+};
+
 ConnectionMode connection = CONNECTION_DEFAULT;
 VerbosityMode verbosity = VERBOSITY_DEFAULT;
 
@@ -442,6 +616,8 @@ int main( int argc, char** argv) {
     float threshold = -1;
     int timeout = 30;
     int reinitialize = 0;
+    int pipeline = 1;
+    int prefetch = 2;
 
     string timing_file;
     string tracker_command;
@@ -474,6 +650,12 @@ int main( int argc, char** argv) {
             case 'X':
                 connection = CONNECTION_SOCKETS;
                 break;
+            case 'U':
+                connection = CONNECTION_UNIX;
+                break;
+            case 'P':
+                connection = CONNECTION_SOCKETPAIR;
+                break;
             case 'Q':
                 query_mode = true;
                 break;
@@ -498,6 +680,12 @@ int main( int argc, char** argv) {
             case 't':
                 timeout = MAX(0, atoi(optarg));
                 break;
+            case 'k':
+                pipeline = MAX(1, atoi(optarg));
+                break;
+            case 'L':
+                prefetch = MAX(0, atoi(optarg));
+                break;
             case 'T':
                 timing_file = string(optarg);
                 break;
@@ -550,6 +738,12 @@ int main( int argc, char** argv) {
                 region_set_flags(REGION_LEGACY_RASTERIZATION);
         }
 
+        if(getenv("TRAX_REGION_EXACT")) {
+            printf("TRAX_REGION_EXACT: %s \n", getenv("TRAX_REGION_EXACT"));
+            if (strcmpi(getenv("TRAX_REGION_EXACT"), "true") == 0)
+                region_set_flags(REGION_EXACT_OVERLAP);
+        }
+
         print_debug("Tracker command: '%s'\n", tracker_command.c_str());
 
         if (threshold >= 0)
@@ -620,6 +814,14 @@ int main( int argc, char** argv) {
 
             tracker.query();
 
+            // The image formats do not change when the tracker is restarted, so the same images can be used
+            Metadata metadata = tracker.metadata();
+
+            ImagePrefetcher prefetcher(images, metadata.channels(), metadata.image_formats(), prefetch);
+
+            if (prefetch > 0)
+                print_debug("Frames loaded ahead: %d\n", prefetch);
+
             size_t frame = 0;
             while (frame < images.size()) {
 
@@ -637,10 +839,8 @@ int main( int argc, char** argv) {
 
                 print_debug("Loading initialization images.\n");
 
-                Metadata metadata = tracker.metadata();
-
                 Region initialize = initialization[frame];
-                ImageList image = load_images(images[frame], metadata.image_formats(), metadata.channels());
+                ImageList image = prefetcher.get(frame);
 
                 // Start timing a frame
                 double timing_elapsed;
@@ -652,16 +852,45 @@ int main( int argc, char** argv) {
 
                 bool initialized = true;
 
+                // Loading and sending of the following frames overlaps with the tracker processing
+                // the current one, the send times of unanswered frames are kept in order
+                size_t depth = (size_t) ((pipeline > 1) ? tracker.pipeline(pipeline) : 1);
+                size_t sent = frame + 1;
+                deque<timer_state> in_flight;
+                timer_state timing_reply = timing_start;
+
+                in_flight.push_back(timing_start);
+
+                if (depth > 1)
+                    print_debug("Frames in flight: %d\n", (int) depth);
+
                 while (true) {
                     // Repeat while tracking the target.
 
+                    while (sent < images.size() && in_flight.size() < depth) {
+
+                        print_debug("Loading frame images.\n");
+                        ImageList image = prefetcher.get(sent);
+
+                        in_flight.push_back(timer_clock());
+
+                        Properties no_properties;
+                        if (!tracker.frame(image, no_properties))
+                            throw std::runtime_error("Unable to send new frame.");
+
+                        sent++;
+                    }
+
                     Region status;
                     Properties additional;
 
                     bool result = tracker.wait(status, additional);
 
-                    // Stop timing a frame
+                    // Stop timing a frame, the tracker starts with a frame once it has answered the previous one
+                    timing_start = MAX(in_flight.front(), timing_reply);
                     timing_elapsed = timer_elapsed(timing_start);
+                    timing_reply = timer_clock();
+                    in_flight.pop_front();
 
                     if (result) {
                         // Default option, the tracker returns a valid status.
@@ -709,16 +938,6 @@ int main( int argc, char** argv) {
 
                     if (frame >= images.size()) break;
 
-                    print_debug("Loading frame images.\n");
-                    ImageList image = load_images(images[frame], metadata.image_formats(), metadata.channels());
-
-                    // Start timing a frame
-                    timing_start = timer_clock();
-
-                    Properties no_properties;
-                    if (!tracker.frame(image, no_properties))
-                        throw std::runtime_error("Unable to send new frame.");
-
                 }
 
                 if (frame < images.size()) {
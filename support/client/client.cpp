@@ -56,7 +56,9 @@ __inline void sleep(long time) {
 //    #include <tcpd.h>
 //#else
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/select.h>
 #include <arpa/inet.h>
 #include <netinet/tcp.h>
@@ -134,6 +136,45 @@ int create_server_socket(int port) {
 
 }
 
+int create_unix_server_socket(const string& path) {
+
+#if defined(__OS2__) || defined(__WINDOWS__) || defined(WIN32) || defined(WIN64) || defined(_MSC_VER)
+	return -1;
+#else
+	int sid;
+	struct sockaddr_un sun;
+
+	if (path.size() >= sizeof(sun.sun_path)) return -1;
+
+	if ((sid = (int) socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+		perror("socket");
+		return -1;
+	}
+
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	strcpy(sun.sun_path, path.c_str());
+
+	unlink(path.c_str());
+
+	if (::bind(sid, (struct sockaddr *)&sun, sizeof(sun)) == -1) {
+		perror("bind");
+		closesocket(sid);
+		return -1;
+	}
+
+	if (listen(sid, 1) == -1) {
+		perror("listen");
+		closesocket(sid);
+		unlink(path.c_str());
+		return -1;
+	}
+
+	return sid;
+#endif
+
+}
+
 void destroy_server_socket(int server) {
 
 	if (server < 0) return;
@@ -190,6 +231,58 @@ bool line_buffer_flush(line_buffer& buffer, ostream* out) {
 	return true;
 }
 
+void line_buffer_append(line_buffer& buffer, const char* data, int length, ostream* out) {
+
+	while (length > 0) {
+
+		int copy = LOGGER_BUFFER_SIZE - 1 - buffer.position;
+
+		if (copy > length) copy = length;
+
+		memcpy(buffer.buffer + buffer.position, data, copy);
+		buffer.position += copy;
+		data += copy;
+		length -= copy;
+
+		if (buffer.position == LOGGER_BUFFER_SIZE - 1)
+			line_buffer_flush(buffer, out);
+
+	}
+
+}
+
+// Span version of line_buffer_push, complete lines are written to the output as they are found
+void line_buffer_write(line_buffer& buffer, const char* data, int length, int truncate, ostream* out) {
+
+	while (length > 0) {
+
+		const char* end = (const char*) memchr(data, '\n', length);
+		int run = end ? (int) (end - data) + 1 : length;
+		int keep = run;
+		bool terminate = false;
+
+		if (truncate > 0 && buffer.length + run >= truncate) {
+			// Only the beginning of a long line is kept and terminated at the limit
+			keep = (buffer.length < truncate - 1) ? truncate - 1 - buffer.length : 0;
+			terminate = buffer.length < truncate;
+		}
+
+		line_buffer_append(buffer, data, keep, out);
+		if (terminate) line_buffer_append(buffer, "\n", 1, out);
+
+		buffer.length += run;
+		data += run;
+		length -= run;
+
+		if (end) {
+			buffer.length = 0;
+			line_buffer_flush(buffer, out);
+		}
+
+	}
+
+}
+
 
 int read_stream(int fd, char* buffer, int len) {
 
@@ -222,6 +315,7 @@ int read_stream(int fd, char* buffer, int len) {
 namespace trax {
 
 int next_available_socket_port = TRAX_DEFAULT_PORT;
+int next_available_socket_path = 0;
 class TrackerProcess::State : public Synchronized {
 public:
 	State(const string& command, const map<std::string, std::string> environment, ConnectionMode connection, VerbosityMode verbosity, int timeout, string directory, ostream *log):
@@ -254,6 +348,27 @@ public:
 
 		}
 
+#if defined(__OS2__) || defined(__WINDOWS__) || defined(WIN32) || defined(WIN64) || defined(_MSC_VER)
+		if (connection == CONNECTION_UNIX || connection == CONNECTION_SOCKETPAIR)
+			throw std::runtime_error("Local socket connection is not supported on this platform.");
+#else
+		if (connection == CONNECTION_UNIX) {
+
+			const char* temporary = getenv("TMPDIR");
+			stringstream path;
+			path << ((temporary && *temporary) ? temporary : "/tmp") << "/trax." << getpid() << "." << next_available_socket_path++ << ".sock";
+
+			socket_path = path.str();
+			socket_id = create_unix_server_socket(socket_path);
+
+			if (socket_id < 0)
+				throw std::runtime_error("Unable to configure Unix domain server socket.");
+
+			print_debug("Socket opened successfully at %s.", socket_path.c_str());
+
+		}
+#endif
+
 		watchdog_active = true;
 		logger_active = true;
 
@@ -287,6 +402,12 @@ public:
 			destroy_server_socket(socket_id);
 		}
 
+		if (connection == CONNECTION_UNIX) {
+			print_debug("Closing server socket.");
+			destroy_server_socket(socket_id);
+			unlink(socket_path.c_str());
+		}
+
 	}
 
 	bool process_running() {
@@ -327,19 +448,41 @@ public:
 			process->set_environment("TRAX_SOCKET", port_buffer);
 		}
 
+		if (connection == CONNECTION_UNIX) {
+			process->set_environment("TRAX_SOCKET", string("unix:") + socket_path);
+		}
+
+		int pair[2] = {-1, -1};
+
+#if !defined(__OS2__) && !defined(__WINDOWS__) && !defined(WIN32) && !defined(WIN64) && !defined(_MSC_VER)
+		if (connection == CONNECTION_SOCKETPAIR) {
+			// The tracker inherits one end of the pair, the other one must not leak into the child process
+			if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == -1)
+				throw std::runtime_error("Unable to create socket pair.");
+			fcntl(pair[0], F_SETFD, FD_CLOEXEC);
+			char fd_buffer[24];
+			sprintf(fd_buffer, "fd:%d", pair[1]);
+			process->set_environment("TRAX_SOCKET", fd_buffer);
+		}
+#endif
+
 		reset_logger();
 
 		bool started = false;
 		print_debug("Starting process");
 		started = process->start();
 
+		if (pair[1] != -1) closesocket(pair[1]);
+
 		if (!started) {
+			if (pair[0] != -1) closesocket(pair[0]);
 			print_debug("Unable to start process");
 			throw std::runtime_error("Unable to start the tracker process");
 		} else {
 
 			sleepf(0.1);
 			if (!process->is_alive()) {
+				if (pair[0] != -1) closesocket(pair[0]);
 				print_debug("Unable to start process");
 				throw std::runtime_error("Unable to start the tracker process");
 			}
@@ -349,11 +492,18 @@ public:
 			Logging logger = trax_no_log;
 
 			if (verbosity != VERBOSITY_SILENT)
-				logger = Logging(client_logger, this, 0);
+				logger = Logging(client_logger, this, TRAX_LOG_TRUNCATE);
 
 			if (connection == CONNECTION_SOCKETS) {
 				print_debug("Setting up TraX with TCP socket connection");
 				client = new Client(socket_id, logger, timeout);
+			} else if (connection == CONNECTION_UNIX) {
+				print_debug("Setting up TraX with Unix domain socket connection");
+				client = new Client(socket_id, logger, timeout);
+			} else if (connection == CONNECTION_SOCKETPAIR) {
+				// The connected socket is owned by the client handle from now on
+				print_debug("Setting up TraX with socket pair connection");
+				client = new Client(pair[0], logger, timeout);
 			} else {
 				print_debug("Setting up TraX with %s streams connection", (connection == CONNECTION_EXPLICIT) ? "dedicated" : "standard");
 				client = new Client(process->get_output(), process->get_input(), logger);
@@ -662,17 +812,9 @@ flush_condition.wait(1000);
 
 		} else {
 
-			for (int i = 0; i < length; i++) {
-
-				if (line_buffer_push(state->stdout_buffer, string[i], state->line_truncate)) {
-
-					MUTEX_SYNCHRONIZE(state->logger_mutex) {
-
-						line_buffer_flush(state->stdout_buffer, state->logger_stream);
-
-					}
+			MUTEX_SYNCHRONIZE(state->logger_mutex) {
 
-				}
+				line_buffer_write(state->stdout_buffer, string, length, state->line_truncate, state->logger_stream);
 
 			}
 
@@ -696,6 +838,7 @@ flush_condition.wait(1000);
 
 	int socket_id;
 	int socket_port;
+	string socket_path;
 
 	bool tracking;
 	ConnectionMode connection;
@@ -926,6 +1069,17 @@ bool TrackerProcess::multiobject() const {
 
 }
 
+int TrackerProcess::pipeline(int frames) {
+
+	if (!ready()) throw std::runtime_error("Tracker process not alive");
+
+	int value = 0;
+	state->client->set_parameter(TRAX_PARAMETER_PIPELINE, frames);
+	state->client->get_parameter(TRAX_PARAMETER_PIPELINE, &value);
+	return (value > 1) ? value : 1;
+
+}
+
 
 Metadata TrackerProcess::metadata() {
 
@@ -36,7 +36,7 @@ using namespace std;
 
 namespace trax {
 
-enum ConnectionMode {CONNECTION_DEFAULT, CONNECTION_EXPLICIT, CONNECTION_SOCKETS};
+enum ConnectionMode {CONNECTION_DEFAULT, CONNECTION_EXPLICIT, CONNECTION_SOCKETS, CONNECTION_UNIX, CONNECTION_SOCKETPAIR};
 
 enum VerbosityMode {VERBOSITY_SILENT, VERBOSITY_DEFAULT, VERBOSITY_DEBUG};
 
@@ -73,6 +73,10 @@ public:
 
 	bool multiobject() const;
 
+	// Allows up to the given number of frames to be sent before their replies are received,
+	// returns the number of frames allowed by the tracker (1 if it does not support pipelining)
+	int pipeline(int frames);
+
 private:
 
 	class State;
@@ -187,7 +187,7 @@ void configure_signals() {
 #define GROUNDTRUTH_COLOR Scalar(100, 255, 100)
 #define TRACKER_COLOR Scalar(100, 100, 255)
 
-#define CMD_OPTIONS "hdV:G:t:p:e:xXg"
+#define CMD_OPTIONS "hdV:G:t:p:e:xXUPg"
 
 #ifndef TRAX_BUILD_DATE
 #define TRAX_BUILD_DATE __DATE__
@@ -202,7 +202,7 @@ void print_help() {
 
     cout << "Usage: traxplayer [-h] [-d]  \n";
     cout << "\t [-e name=value] [-V video_file]\n";
-    cout << "\t [-p name=value] [-t timeout] [-x] [-X]\n";
+    cout << "\t [-p name=value] [-t timeout] [-x] [-X] [-U] [-P]\n";
     cout << "\t [-g] -- <command_part1> <command_part2> ...";
 
     cout << "\n\nProgram arguments: \n";
@@ -215,6 +215,8 @@ void print_help() {
     cout << "\t-t\tSet timeout period\n";
     cout << "\t-x\tUse explicit streams, not standard ones.\n";
     cout << "\t-X\tUse TCP/IP sockets instead of file streams.\n";
+    cout << "\t-U\tUse a Unix domain socket instead of file streams.\n";
+    cout << "\t-P\tUse an inherited socket pair instead of file streams.\n";
     cout << "\n";
 
     cout << "\n";
@@ -252,6 +254,12 @@ int main(int argc, char** argv) {
             case 'X':
                 connection = CONNECTION_SOCKETS;
                 break;
+            case 'U':
+                connection = CONNECTION_UNIX;
+                break;
+            case 'P':
+                connection = CONNECTION_SOCKETPAIR;
+                break;
             case 'V':
                 video_file = string(optarg);
                 break;
@@ -90,7 +90,7 @@ void print_help() {
 
     cout << "Usage: traxtest [-h] [-d] \n";
     cout << "\t [-e name=value] [-p name=value]\n";
-    cout << "\t [-t timeout] [-x] [-X]\n";
+    cout << "\t [-t timeout] [-x] [-X] [-U] [-P]\n";
     cout << "\t -- <command_part1> <command_part2> ...";
 
     cout << "\n\nProgram arguments: \n";
@@ -102,6 +102,8 @@ void print_help() {
     cout << "\t-I\tNumber of attempted initializations\n";
     cout << "\t-x\tUse explicit streams, not standard ones.\n";
     cout << "\t-X\tUse TCP/IP sockets instead of file streams.\n";
+    cout << "\t-U\tUse a Unix domain socket instead of file streams.\n";
+    cout << "\t-P\tUse an inherited socket pair instead of file streams.\n";
     cout << "\n";
 
     cout << "\n";
@@ -168,7 +170,7 @@ void print_debug(const char *format, ...) {
 }
 
 
-#define CMD_OPTIONS "hdt:p:e:xXI"
+#define CMD_OPTIONS "hdt:p:e:xXUPI"
 
 int main(int argc, char** argv) {
 
@@ -201,6 +203,12 @@ int main(int argc, char** argv) {
             case 'X':
                 connection = CONNECTION_SOCKETS;
                 break;
+            case 'U':
+                connection = CONNECTION_UNIX;
+                break;
+            case 'P':
+                connection = CONNECTION_SOCKETPAIR;
+                break;
             case 't':
                 timeout = MAX(0, atoi(optarg));
                 break;
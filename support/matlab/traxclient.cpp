@@ -222,6 +222,14 @@ ConnectionMode get_connection_mode(string str) {
 		return CONNECTION_SOCKETS;
 	}
 
+	if (str == "unix") {
+		return CONNECTION_UNIX;
+	}
+
+	if (str == "socketpair") {
+		return CONNECTION_SOCKETPAIR;
+	}
+
 	MEX_ERROR("Illegal connection type");
 
 	return CONNECTION_DEFAULT; // Avoiding clang warnings
@@ -39,8 +39,18 @@ __TRAX_OPENCV_EXPORT std::vector<cv::Point2f> region_to_points(const Region& reg
 
 __TRAX_OPENCV_EXPORT cv::Mat region_to_mat(const Region& region);
 
+/**
+ * Copies the matrix to a new image, color matrices are converted to RGB.
+**/
 __TRAX_OPENCV_EXPORT Image mat_to_image(const cv::Mat& mat);
 
+/**
+ * Creates an image that shares the pixel data with the matrix, the data is kept alive by a reference held
+ * by the image. Rows of a matrix that is not continuous (e.g. a region of a larger matrix) are sent packed.
+ * Color matrices keep the channel order of OpenCV, the image is in BGR or BGRA format.
+**/
+__TRAX_OPENCV_EXPORT Image mat_to_image_wrap(const cv::Mat& mat);
+
 __TRAX_OPENCV_EXPORT Region rect_to_region(const cv::Rect rect);
 
 __TRAX_OPENCV_EXPORT Region points_to_region(const std::vector<cv::Point2f> points);
@@ -21,14 +21,31 @@ cv::Mat image_to_mat(const Image& image) {
         int width, height, format;
         image.get_memory_header(&width, &height, &format);
         const char* data = image.get_memory_row(0);
-
-        cv::Mat tmp(height, width, format == TRAX_IMAGE_MEMORY_RGB ? CV_8UC3 : 
-            (format == TRAX_IMAGE_MEMORY_GRAY8 ? CV_8UC1 : CV_16U), const_cast<char *>(data));
+        size_t stride = image.get_memory_stride();
 
         cv::Mat result;
 
-        cv::cvtColor(tmp, result, cv::COLOR_BGR2RGB);
-        
+        switch (format) {
+        case TRAX_IMAGE_MEMORY_GRAY8:
+            return cv::Mat(height, width, CV_8UC1, const_cast<char *>(data), stride).clone();
+        case TRAX_IMAGE_MEMORY_GRAY16:
+            return cv::Mat(height, width, CV_16UC1, const_cast<char *>(data), stride).clone();
+        case TRAX_IMAGE_MEMORY_BGR:
+            return cv::Mat(height, width, CV_8UC3, const_cast<char *>(data), stride).clone();
+        case TRAX_IMAGE_MEMORY_RGB:
+            cv::cvtColor(cv::Mat(height, width, CV_8UC3, const_cast<char *>(data), stride), result, cv::COLOR_RGB2BGR);
+            break;
+        case TRAX_IMAGE_MEMORY_RGBA:
+            cv::cvtColor(cv::Mat(height, width, CV_8UC4, const_cast<char *>(data), stride), result, cv::COLOR_RGBA2BGR);
+            break;
+        case TRAX_IMAGE_MEMORY_BGRA:
+            cv::cvtColor(cv::Mat(height, width, CV_8UC4, const_cast<char *>(data), stride), result, cv::COLOR_BGRA2BGR);
+            break;
+        case TRAX_IMAGE_MEMORY_NV12:
+            cv::cvtColor(cv::Mat(height + height / 2, width, CV_8UC1, const_cast<char *>(data), stride), result, cv::COLOR_YUV2BGR_NV12);
+            break;
+        }
+
         return result;
     }
     case TRAX_IMAGE_BUFFER: {
@@ -81,6 +98,24 @@ std::vector<cv::Point2f> region_to_points(const Region& region) {
 
 }
 
+// Wrapped color matrices keep the channel order of OpenCV, the library converts them if the tracker does not accept it
+static int mat_format(const cv::Mat& mat) {
+
+    switch(mat.type()) {
+    case CV_8UC1:
+        return TRAX_IMAGE_MEMORY_GRAY8;
+    case CV_16UC1:
+        return TRAX_IMAGE_MEMORY_GRAY16;
+    case CV_8UC3:
+        return TRAX_IMAGE_MEMORY_BGR;
+    case CV_8UC4:
+        return TRAX_IMAGE_MEMORY_BGRA;
+    default:
+        throw std::runtime_error("Unsupported image depth");
+    }
+
+}
+
 Image mat_to_image(const cv::Mat& mat) {
 	
     int format = 0;
@@ -100,11 +135,28 @@ Image mat_to_image(const cv::Mat& mat) {
     Image image = Image::create_memory(mat.cols, mat.rows, format);
     char* dst = image.write_memory_row(0);
     cv::Mat tmp(mat.size(), mat.type(), dst);
-    cv::cvtColor(mat, tmp, cv::COLOR_BGR2RGB);
+    if (format == TRAX_IMAGE_MEMORY_RGB)
+        cv::cvtColor(mat, tmp, cv::COLOR_BGR2RGB);
+    else
+        mat.copyTo(tmp);
 
     return image;
 }
 
+static void release_mat(trax_image* image) {
+    delete (cv::Mat*) image->owner;
+}
+
+Image mat_to_image_wrap(const cv::Mat& mat) {
+
+    int format = mat_format(mat);
+
+    cv::Mat* reference = new cv::Mat(mat);
+
+    return Image::create_memory_wrap(mat.cols, mat.rows, format, (int) mat.step[0], (char*) reference->data, release_mat, reference);
+
+}
+
 Region rect_to_region(const cv::Rect rect) {
 	
 	return Region::create_rectangle(rect.x, rect.y, rect.width, rect.height);
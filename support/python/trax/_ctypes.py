@@ -547,13 +547,20 @@ struct_trax_image.__slots__ = [
     'height',
     'format',
     'data',
+    'release',
+    'owner',
+    'stride',
 ]
+trax_image_releaser = ctypes.CFUNCTYPE(None, POINTER(struct_trax_image))
 struct_trax_image._fields_ = [
     ('type', c_short),
     ('width', c_int),
     ('height', c_int),
     ('format', c_int),
     ('data', POINTER(ctypes.c_char)),
+    ('release', trax_image_releaser),
+    ('owner', POINTER(None)),
+    ('stride', c_int),
 ]
 
 trax_image = struct_trax_image# /home/lukacu/Checkouts/vot/trax/include/trax.h: 137
@@ -633,6 +640,7 @@ struct_trax_metadata.__slots__ = [
     'tracker_description',
     'tracker_family',
     'custom',
+    'format_memory',
 ]
 struct_trax_metadata._fields_ = [
     ('format_region', c_int),
@@ -643,6 +651,7 @@ struct_trax_metadata._fields_ = [
     ('tracker_description', ctypes.c_char_p),
     ('tracker_family', ctypes.c_char_p),
     ('custom', POINTER(trax_properties)),
+    ('format_memory', c_int),
 ]
 
 trax_metadata = struct_trax_metadata# /home/lukacu/Checkouts/vot/trax/include/trax.h: 195
@@ -661,6 +670,14 @@ struct_trax_handle.__slots__ = [
     'metadata',
     'error',
     'objects',
+    'shared',
+    'pending',
+    'sequence',
+    'inflight',
+    'pipeline',
+    'pool',
+    'roi',
+    'delta',
 ]
 struct_trax_handle._fields_ = [
     ('flags', c_int),
@@ -670,6 +687,14 @@ struct_trax_handle._fields_ = [
     ('metadata', POINTER(trax_metadata)),
     ('error', ctypes.c_char_p),
     ('objects', c_int),
+    ('shared', POINTER(None)),
+    ('pending', POINTER(None)),
+    ('sequence', c_int),
+    ('inflight', c_int),
+    ('pipeline', c_int),
+    ('pool', POINTER(None)),
+    ('roi', POINTER(None)),
+    ('delta', POINTER(None)),
 ]
 
 trax_handle = struct_trax_handle# /home/lukacu/Checkouts/vot/trax/include/trax.h: 210
@@ -790,6 +815,18 @@ if _libs["trax"].has("trax_server_reply_mot", "cdecl"):
     trax_server_reply_mot.argtypes = [POINTER(trax_handle), POINTER(trax_object_list)]
     trax_server_reply_mot.restype = c_int
 
+# /home/lukacu/Checkouts/vot/trax/include/trax.h: 354
+if _libs["trax"].has("trax_server_request_roi", "cdecl"):
+    trax_server_request_roi = _libs["trax"].get("trax_server_request_roi", "cdecl")
+    trax_server_request_roi.argtypes = [POINTER(trax_handle), c_int, c_int, c_int, c_int, c_float]
+    trax_server_request_roi.restype = c_int
+
+# /home/lukacu/Checkouts/vot/trax/include/trax.h: 360
+if _libs["trax"].has("trax_server_get_roi", "cdecl"):
+    trax_server_get_roi = _libs["trax"].get("trax_server_get_roi", "cdecl")
+    trax_server_get_roi.argtypes = [POINTER(trax_handle), POINTER(c_int), POINTER(c_int), POINTER(c_int), POINTER(c_int)]
+    trax_server_get_roi.restype = c_int
+
 # /home/lukacu/Checkouts/vot/trax/include/trax.h: 307
 if _libs["trax"].has("trax_terminate", "cdecl"):
     trax_terminate = _libs["trax"].get("trax_terminate", "cdecl")
@@ -850,6 +887,11 @@ if _libs["trax"].has("trax_image_create_memory", "cdecl"):
     trax_image_create_memory.argtypes = [c_int, c_int, c_int]
     trax_image_create_memory.restype = POINTER(trax_image)
 
+if _libs["trax"].has("trax_image_create_memory_wrap", "cdecl"):
+    trax_image_create_memory_wrap = _libs["trax"].get("trax_image_create_memory_wrap", "cdecl")
+    trax_image_create_memory_wrap.argtypes = [c_int, c_int, c_int, c_int, POINTER(ctypes.c_char), trax_image_releaser, POINTER(None)]
+    trax_image_create_memory_wrap.restype = POINTER(trax_image)
+
 # /home/lukacu/Checkouts/vot/trax/include/trax.h: 359
 if _libs["trax"].has("trax_image_create_buffer", "cdecl"):
     trax_image_create_buffer = _libs["trax"].get("trax_image_create_buffer", "cdecl")
@@ -887,6 +929,11 @@ if _libs["trax"].has("trax_image_write_memory_row", "cdecl"):
     trax_image_write_memory_row.restype = POINTER(ctypes.c_char)
 
 # /home/lukacu/Checkouts/vot/trax/include/trax.h: 391
+if _libs["trax"].has("trax_image_get_memory_stride", "cdecl"):
+    trax_image_get_memory_stride = _libs["trax"].get("trax_image_get_memory_stride", "cdecl")
+    trax_image_get_memory_stride.argtypes = [POINTER(trax_image)]
+    trax_image_get_memory_stride.restype = c_int
+
 if _libs["trax"].has("trax_image_get_memory_row", "cdecl"):
     trax_image_get_memory_row = _libs["trax"].get("trax_image_get_memory_row", "cdecl")
     trax_image_get_memory_row.argtypes = [POINTER(trax_image), c_int]
@@ -1330,6 +1377,26 @@ try:
 except:
     pass
 
+try:
+    TRAX_IMAGE_MEMORY_BGR = 4
+except:
+    pass
+
+try:
+    TRAX_IMAGE_MEMORY_RGBA = 5
+except:
+    pass
+
+try:
+    TRAX_IMAGE_MEMORY_BGRA = 6
+except:
+    pass
+
+try:
+    TRAX_IMAGE_MEMORY_NV12 = 7
+except:
+    pass
+
 # /home/lukacu/Checkouts/vot/trax/include/trax.h: 71
 try:
     TRAX_REGION_EMPTY = 0
@@ -1464,6 +1531,11 @@ try:
 except:
     pass
 
+try:
+    TRAX_METADATA_ROI = 2
+except:
+    pass
+
 # /home/lukacu/Checkouts/vot/trax/include/trax.h: 116
 try:
     trax_server_wait = trax_server_wait_mot
@@ -7,7 +7,7 @@ Image description classes.
 __all__ = ['Image', 'FileImage', 'URLImage', 'MemoryImage', 'BufferImage', 'ImageChannel']
 
 from abc import abstractmethod
-from ctypes import memmove, byref, c_int, string_at
+from ctypes import memmove, byref, c_int, c_char, c_void_p, string_at, cast, POINTER
 
 from ._ctypes import \
         trax_image_create_path, trax_image_create_memory, \
@@ -15,7 +15,8 @@ from ._ctypes import \
         trax_image_get_path, trax_image_get_url, \
         trax_image_create_url, trax_image_get_memory_row, \
         trax_image_write_memory_row, trax_image_get_buffer, \
-        trax_image_create_buffer
+        trax_image_create_buffer, trax_image_create_memory_wrap, \
+        trax_image_releaser, trax_image_get_memory_stride
 
 class ImageChannel(object):
     """ Image channel identifier. """
@@ -231,19 +232,38 @@ class URLImage(Image):
 IMAGE_MEMORY_GRAY8 = 1
 IMAGE_MEMORY_GRAY16 = 2
 IMAGE_MEMORY_RGB = 3
+IMAGE_MEMORY_BGR = 4
+IMAGE_MEMORY_RGBA = 5
+IMAGE_MEMORY_BGRA = 6
+IMAGE_MEMORY_NV12 = 7
 
-_image_memory_map_string = {IMAGE_MEMORY_RGB : "rgb", IMAGE_MEMORY_GRAY8: "gray8", IMAGE_MEMORY_GRAY16: "gray16" }
-_image_memory_map_ch = {IMAGE_MEMORY_RGB : 3, IMAGE_MEMORY_GRAY8: 1, IMAGE_MEMORY_GRAY16: 1}
+_image_memory_map_string = {IMAGE_MEMORY_RGB : "rgb", IMAGE_MEMORY_GRAY8: "gray8", IMAGE_MEMORY_GRAY16: "gray16",
+    IMAGE_MEMORY_BGR: "bgr", IMAGE_MEMORY_RGBA: "rgba", IMAGE_MEMORY_BGRA: "bgra", IMAGE_MEMORY_NV12: "nv12" }
+_image_memory_map_ch = {IMAGE_MEMORY_RGB : 3, IMAGE_MEMORY_GRAY8: 1, IMAGE_MEMORY_GRAY16: 1,
+    IMAGE_MEMORY_BGR: 3, IMAGE_MEMORY_RGBA: 4, IMAGE_MEMORY_BGRA: 4, IMAGE_MEMORY_NV12: 1}
+
+# Arrays shared with wrapped images, they are kept alive until the library releases the image
+_wrapped_arrays = {}
+_wrapped_counter = 0
+
+def _release_wrapped(image):
+    _wrapped_arrays.pop(image.contents.owner, None)
+
+_release_wrapped_callback = trax_image_releaser(_release_wrapped)
 
 class MemoryImage(Image):
     """ Image saved in memory as a numpy array """
 
     @staticmethod
-    def create(image: "numpy.ndarray"):
+    def create(image: "numpy.ndarray", copy: bool = True, format: str = None):
         """ Create a new memory image resource. 
 
         Args:
             image (np.ndarray): Image data.
+            copy (bool): Copy the data to a new buffer, otherwise the image uses the memory of
+                a contiguous array directly and keeps a reference to it until it is released.
+            format (str): Memory format of the data (e.g. "bgr" or "nv12"), by default it is
+                determined from the shape of the array (gray, RGB or RGBA).
         """
 
         from . import TraxException
@@ -261,19 +281,39 @@ class MemoryImage(Image):
 
         width = image.shape[1]
         height = image.shape[0]
-        format = 0
-        if len(image.shape) == 3 and image.shape[2] == 3:
-            if image.itemsize == 1:
+        channels = image.shape[2] if len(image.shape) == 3 else 1
+
+        if format is None:
+            format = 0
+            if channels == 3 and image.itemsize == 1:
                 format = IMAGE_MEMORY_RGB
-        elif len(image.shape) == 2 or image.shape[2] == 1:
-            if image.itemsize == 1:
-                format = IMAGE_MEMORY_GRAY8
-            elif image.itemsize == 2:
-                format = IMAGE_MEMORY_GRAY16
+            elif channels == 4 and image.itemsize == 1:
+                format = IMAGE_MEMORY_RGBA
+            elif channels == 1:
+                if image.itemsize == 1:
+                    format = IMAGE_MEMORY_GRAY8
+                elif image.itemsize == 2:
+                    format = IMAGE_MEMORY_GRAY16
+        else:
+            codes = {v: k for k, v in _image_memory_map_string.items()}
+            format = codes.get(format, 0)
+            if format and (_image_memory_map_ch[format] != channels or image.itemsize != (2 if format == IMAGE_MEMORY_GRAY16 else 1)):
+                format = 0
+            # Chroma rows of NV12 follow the luma rows in the same array
+            if format == IMAGE_MEMORY_NV12:
+                height = (height * 2) // 3
 
         if format == 0:
             raise TraxException("Image format not supported")
 
+        if not copy:
+            global _wrapped_counter
+            _wrapped_counter += 1
+            _wrapped_arrays[_wrapped_counter] = image
+            timage = trax_image_create_memory_wrap(width, height, format, 0, cast(image.ctypes.data, POINTER(c_char)),
+                _release_wrapped_callback, c_void_p(_wrapped_counter))
+            return MemoryImage(timage)
+
         timage = trax_image_create_memory(width, height, format)
 
         data = trax_image_write_memory_row(timage, 0)
@@ -296,17 +336,25 @@ class MemoryImage(Image):
     def array(self):
         try:
             import numpy as np
-            _image_memory_map_dtype = {IMAGE_MEMORY_RGB : np.uint8, IMAGE_MEMORY_GRAY8: np.uint8, IMAGE_MEMORY_GRAY16: np.uint16 }
-            
             width = c_int()
             height = c_int()
             format = c_int()
             trax_image_get_memory_header(self.reference, byref(width), byref(height), byref(format))
-            mat = np.ones((height.value, width.value, _image_memory_map_ch[format.value]), dtype=_image_memory_map_dtype[format.value])
 
-            data = trax_image_get_memory_row(self.reference, 0)
+            dtype = np.uint16 if format.value == IMAGE_MEMORY_GRAY16 else np.uint8
+            channels = _image_memory_map_ch[format.value]
+            rows = height.value + height.value // 2 if format.value == IMAGE_MEMORY_NV12 else height.value
+            mat = np.empty((rows, width.value, channels), dtype=dtype)
 
-            memmove(mat.ctypes.data, data, mat.nbytes)
+            data = trax_image_get_memory_row(self.reference, 0)
+            stride = trax_image_get_memory_stride(self.reference)
+            row = mat.strides[0]
+
+            if stride == row:
+                memmove(mat.ctypes.data, data, mat.nbytes)
+            else:
+                for i in range(rows):
+                    memmove(mat.ctypes.data + i * row, trax_image_get_memory_row(self.reference, i), row)
 
             return mat
         except ImportError:
@@ -5,7 +5,7 @@ Bindings for the TraX sever.
 import traceback
 import collections
 
-from ctypes import byref, cast, py_object
+from ctypes import byref, cast, py_object, c_int
 
 __all__ = \
     ['Server', 'Rquest']
@@ -20,7 +20,8 @@ from ._ctypes import \
         trax_server_wait, trax_server_reply, \
         trax_image_list_release,  \
         trax_logger, trax_terminate, \
-        trax_is_alive, trax_get_error, trax_object_list_release
+        trax_is_alive, trax_get_error, trax_object_list_release, \
+        trax_server_request_roi, trax_server_get_roi
 
 
 class Request(collections.namedtuple('Request', ['type', 'image', 'objects', 'properties'])):
@@ -43,10 +44,10 @@ class Server(object):
 
     """ TraX server."""
 
-    def __init__(self, region_formats, image_formats, image_channels=["color"], tracker_name="", tracker_description="", tracker_family="", metadata=None, log=False, multiobject=False):
+    def __init__(self, region_formats, image_formats, image_channels=["color"], tracker_name="", tracker_description="", tracker_family="", metadata=None, log=False, multiobject=False, memory_formats=None, roi=False):
 
         from . import TraxException, ConsoleLogger, FileLogger, Properties, HandleWrapper
-        from ._ctypes import TRAX_METADATA_MULTI_OBJECT
+        from ._ctypes import TRAX_METADATA_MULTI_OBJECT, TRAX_METADATA_ROI
 
         if isinstance(log, bool) and log:
             self._logger = trax_logger(ConsoleLogger())
@@ -60,10 +61,20 @@ class Server(object):
         if multiobject:
             flags |= TRAX_METADATA_MULTI_OBJECT
 
+        if roi:
+            flags |= TRAX_METADATA_ROI
+
         mdata = trax_metadata_create(Region.encode_list(region_formats),
             Image.encode_list(image_formats), ImageChannel.encode_list(image_channels),
             tracker_name.encode('utf-8'), tracker_description.encode('utf-8'), tracker_family.encode('utf-8'), flags)
 
+        # Memory formats accepted in addition to gray and RGB, e.g. ["bgr", "nv12"]
+        if memory_formats:
+            from .image import _image_memory_map_string
+            codes = {v: k for k, v in _image_memory_map_string.items()}
+            for name in memory_formats:
+                mdata.contents.format_memory |= 1 << codes[name]
+
         if isinstance(metadata, dict):
             custom = Properties(mdata.contents.custom, False)
             for key, value in metadata.items():
@@ -145,6 +156,36 @@ class Server(object):
 
         return True
 
+    def request_roi(self, x, y, width, height, scale=1.0):
+        """ Request that the client only sends a part of the next frame. The request is sent with the next status.
+
+            :param int x: Left edge of the part in full image coordinates
+            :param int y: Top edge of the part in full image coordinates
+            :param int width: Width of the part
+            :param int height: Height of the part
+            :param float scale: Downscaling factor of the part in range (0, 1]
+        """
+        from . import TraxException, TraxStatus
+
+        status = TraxStatus.decode(trax_server_request_roi(self._handle.reference, int(x), int(y), int(width), int(height), float(scale)))
+
+        if status == TraxStatus.ERROR:
+            message = trax_get_error(self._handle.reference)
+            message = message.decode('utf-8') if not message is None else "Unknown"
+            raise TraxException("Exception when requesting region of interest: {}".format(message))
+
+    def roi(self):
+        """ Returns the part of the full image that the images of the last request cover.
+
+            :returns: A tuple (x, y, width, height) or None if the images are not cropped
+        """
+        x, y, width, height = c_int(), c_int(), c_int(), c_int()
+
+        if not trax_server_get_roi(self._handle.reference, byref(x), byref(y), byref(width), byref(height)):
+            return None
+
+        return (x.value, y.value, width.value, height.value)
+
     def __enter__(self):
         """ To support instantiation with 'with' statement. """
         return self
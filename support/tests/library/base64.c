@@ -0,0 +1,91 @@
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+
+#include "base64.h"
+
+// The plain loops are compiled here once more under different names, so that the vector kernels
+// that the library selects can be compared with them
+#define BASE64_DISABLE_SIMD
+#define base64decodelen scalar_base64decodelen
+#define base64decode scalar_base64decode
+#define base64decodelen_n scalar_base64decodelen_n
+#define base64decode_n scalar_base64decode_n
+#define base64encodelen scalar_base64encodelen
+#define base64encode scalar_base64encode
+#include "../../../src/base64.c"
+#undef base64decodelen
+#undef base64decode
+#undef base64decodelen_n
+#undef base64decode_n
+#undef base64encodelen
+#undef base64encode
+
+#define MAX_LENGTH 300
+#define MAX_OFFSET 16
+
+static unsigned char plain[MAX_LENGTH + MAX_OFFSET];
+static char encoded[2][MAX_LENGTH * 2 + MAX_OFFSET];
+static unsigned char decoded[2][MAX_LENGTH + MAX_OFFSET];
+
+int main( int argc, char** argv) {
+
+    int i, length, offset, position, n0, n1;
+
+    for (i = 0; i < (int) sizeof(plain); i++) plain[i] = (unsigned char) ((i * 131 + 7) % 256);
+
+    // Lengths cover the smallest inputs of the kernels and their block boundaries, buffers are misaligned
+    for (length = 0; length <= MAX_LENGTH; length++) {
+        for (offset = 0; offset < MAX_OFFSET; offset += (length < 100 ? 1 : 5)) {
+
+            const unsigned char* source = plain + offset;
+            char* text = encoded[1] + offset;
+
+            n0 = scalar_base64encode(encoded[0], source, length);
+            n1 = base64encode(text, source, length);
+
+            assert(n0 == n1 && n0 == base64encodelen(length) && memcmp(encoded[0], text, n0) == 0);
+
+            n0 = scalar_base64decode_n(decoded[0], encoded[0], n1 - 1);
+            n1 = base64decode_n(decoded[1] + offset, text, n1 - 1);
+
+            assert(n0 == length && n1 == length && memcmp(decoded[1] + offset, source, length) == 0);
+            assert(base64decodelen_n(text, strlen(text)) == length);
+
+        }
+    }
+
+    // Decoding stops at the first character outside of the alphabet, also in the middle of a vector block
+    base64encode(encoded[0], plain, MAX_LENGTH);
+
+    for (position = 0; position < 200; position++) {
+
+        const char invalid[] = {'*', '\n', '-', '_', ' ', (char) 0x80, (char) 0xFF, '.'};
+        char symbol = invalid[position % sizeof(invalid)];
+
+        strcpy(encoded[1], encoded[0]);
+        encoded[1][position] = symbol;
+
+        n0 = scalar_base64decode_n(decoded[0], encoded[1], strlen(encoded[1]));
+        n1 = base64decode_n(decoded[1], encoded[1], strlen(encoded[1]));
+
+        assert(n0 == n1 && n1 == (position / 4) * 3 + ((position % 4) > 1 ? (position % 4) - 1 : 0));
+        assert(memcmp(decoded[0], decoded[1], n1) == 0 && memcmp(decoded[1], plain, n1) == 0);
+
+    }
+
+    // Padding is optional, the length of an incomplete group is known without it
+    assert(base64decodelen_n("QUJD", 4) == 3 && base64decode_n(decoded[0], "QUJD", 4) == 3);
+    assert(base64decodelen_n("QUI=", 4) == 2 && base64decode_n(decoded[0], "QUI=", 4) == 2);
+    assert(base64decodelen_n("QQ==", 4) == 1 && base64decode_n(decoded[0], "QQ==", 4) == 1);
+    assert(base64decodelen_n("QUI", 3) == 2 && base64decode_n(decoded[0], "QUI", 3) == 2);
+    assert(base64decodelen_n("QQ", 2) == 1 && base64decode_n(decoded[0], "QQ", 2) == 1);
+    assert(base64decodelen_n("", 0) == 0 && base64decode_n(decoded[0], "", 0) == 0);
+    assert(base64decodelen("QUI=") == 3 && base64decode(decoded[0], "QUI=") == 2 && strcmp((char*) decoded[0], "AB") == 0);
+
+    printf("Base64 OK\n");
+
+    return 0;
+
+}
@@ -0,0 +1,87 @@
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+
+#include <unistd.h>
+
+#include <trax.h>
+
+#define LENGTH 10000
+
+// Writes a temporary file with the given prefix followed by generated content and returns its path
+static void create_file(char* path, const char* prefix, int length) {
+
+    int i, descriptor;
+    char* content = (char*) malloc(LENGTH);
+
+    strcpy(path, "/tmp/trax_buffer_XXXXXX");
+    descriptor = mkstemp(path);
+    assert(descriptor >= 0);
+
+    for (i = 0; i < length; i++) content[i] = (char) (i * 7);
+    memcpy(content, prefix, 4);
+
+    assert(write(descriptor, content, length) == length);
+    close(descriptor);
+
+    free(content);
+
+}
+
+int main( int argc, char** argv) {
+
+    int i, length, format;
+    char path[64];
+    const char* data;
+    const char jpeg[] = {(char) 255, (char) 216, (char) 255, (char) 224};
+    const char png[] = {(char) 137, 'P', 'N', 'G'};
+    trax_image* image;
+
+    // The content of the file is mapped and is available through the buffer accessor
+    create_file(path, jpeg, LENGTH);
+
+    image = trax_image_create_buffer_file(path);
+    assert(image && trax_image_get_type(image) == TRAX_IMAGE_BUFFER);
+
+    data = trax_image_get_buffer(image, &length, &format);
+    assert(length == LENGTH && format == TRAX_IMAGE_BUFFER_JPEG);
+    assert(memcmp(data, jpeg, 4) == 0);
+
+    for (i = 4; i < LENGTH; i++)
+        assert(data[i] == (char) (i * 7));
+
+    // The mapping does not depend on the file name
+    unlink(path);
+    assert(data[LENGTH - 1] == (char) ((LENGTH - 1) * 7));
+
+    trax_image_release(&image);
+    assert(!image);
+
+    create_file(path, png, 5);
+
+    image = trax_image_create_buffer_file(path);
+    assert(image);
+    data = trax_image_get_buffer(image, &length, &format);
+    assert(length == 5 && format == TRAX_IMAGE_BUFFER_PNG);
+    trax_image_release(&image);
+
+    unlink(path);
+
+    // Files that are missing, too short or not encoded images do not create an image
+    assert(trax_image_create_buffer_file(path) == NULL);
+    assert(trax_image_create_buffer_file("") == NULL);
+
+    create_file(path, png, 4);
+    assert(trax_image_create_buffer_file(path) == NULL);
+    unlink(path);
+
+    create_file(path, "TEXT", 100);
+    assert(trax_image_create_buffer_file(path) == NULL);
+    unlink(path);
+
+    printf("Buffer files OK\n");
+
+    return 0;
+
+}
@@ -0,0 +1,117 @@
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+
+#include "delta.h"
+
+// Frames do not fill whole tiles and the rows of the source are padded
+#define WIDTH 200
+#define HEIGHT 100
+#define PIXEL 3
+#define ROW (WIDTH * PIXEL)
+#define STRIDE (ROW + 10)
+#define RESERVED 5
+
+static void change_pixel(char* frame, int x, int y, char value) {
+
+    frame[y * STRIDE + x * PIXEL] = value;
+
+}
+
+// Returns the source frame without its padding, as it is reconstructed on the other side
+static char* pack_frame(const char* frame) {
+
+    int j;
+    char* packed = (char*) malloc(ROW * HEIGHT);
+
+    for (j = 0; j < HEIGHT; j++)
+        memcpy(packed + j * ROW, frame + j * STRIDE, ROW);
+
+    return packed;
+
+}
+
+static const char* apply_frame(delta_context* context, int tile, const char* data, int length) {
+
+    return delta_apply(context, 0, WIDTH, HEIGHT, TRAX_IMAGE_MEMORY_RGB, HEIGHT, ROW, PIXEL, tile, data, length);
+
+}
+
+int main( int argc, char** argv) {
+
+    int i, length;
+    char *frame, *packed, *payload;
+    const char* result;
+    delta_context* sender = delta_context_create();
+    delta_context* receiver = delta_context_create();
+
+    frame = (char*) malloc(STRIDE * HEIGHT);
+
+    for (i = 0; i < STRIDE * HEIGHT; i++) frame[i] = (char) (i % 251);
+
+    // The first frame has no reference and is sent whole
+    assert(delta_encode(sender, 0, frame, STRIDE, WIDTH, HEIGHT, TRAX_IMAGE_MEMORY_RGB, HEIGHT, ROW, PIXEL, RESERVED, &length) == NULL);
+
+    packed = pack_frame(frame);
+    result = apply_frame(receiver, 0, packed, ROW * HEIGHT);
+    assert(result && memcmp(result, packed, ROW * HEIGHT) == 0);
+    free(packed);
+
+    // Changes in the last column and row of tiles, which are only partially filled
+    change_pixel(frame, 1, 1, 1);
+    change_pixel(frame, WIDTH - 1, 20, 2);
+    change_pixel(frame, 40, HEIGHT - 1, 3);
+
+    payload = delta_encode(sender, 0, frame, STRIDE, WIDTH, HEIGHT, TRAX_IMAGE_MEMORY_RGB, HEIGHT, ROW, PIXEL, RESERVED, &length);
+    assert(payload && length < ROW * HEIGHT);
+
+    packed = pack_frame(frame);
+    result = apply_frame(receiver, DELTA_TILE, payload + RESERVED, length);
+    assert(result && memcmp(result, packed, ROW * HEIGHT) == 0);
+    free(packed);
+    free(payload);
+
+    // A payload that does not match the tile table is rejected and the last frame stays the same
+    packed = pack_frame(frame);
+
+    change_pixel(frame, 2, 2, 4);
+    change_pixel(frame, WIDTH - 2, HEIGHT - 2, 5);
+
+    payload = delta_encode(sender, 0, frame, STRIDE, WIDTH, HEIGHT, TRAX_IMAGE_MEMORY_RGB, HEIGHT, ROW, PIXEL, RESERVED, &length);
+    assert(payload);
+
+    assert(apply_frame(receiver, DELTA_TILE, payload + RESERVED, length - 1) == NULL);
+    assert(memcmp(receiver->frames[0].data, packed, ROW * HEIGHT) == 0);
+
+    payload[RESERVED + length] = 0;
+    assert(apply_frame(receiver, DELTA_TILE, payload + RESERVED, length + 1) == NULL);
+    assert(memcmp(receiver->frames[0].data, packed, ROW * HEIGHT) == 0);
+
+    payload[RESERVED] |= 2;
+    assert(apply_frame(receiver, DELTA_TILE, payload + RESERVED, length) == NULL);
+    assert(memcmp(receiver->frames[0].data, packed, ROW * HEIGHT) == 0);
+    payload[RESERVED] &= ~2;
+
+    assert(delta_apply(receiver, 0, WIDTH, HEIGHT - 1, TRAX_IMAGE_MEMORY_RGB, HEIGHT - 1, ROW, PIXEL, DELTA_TILE, payload + RESERVED, length) == NULL);
+    assert(memcmp(receiver->frames[0].data, packed, ROW * HEIGHT) == 0);
+
+    free(packed);
+
+    // The intact payload still applies to the unchanged frame
+    packed = pack_frame(frame);
+    result = apply_frame(receiver, DELTA_TILE, payload + RESERVED, length);
+    assert(result && memcmp(result, packed, ROW * HEIGHT) == 0);
+    free(packed);
+    free(payload);
+
+    free(frame);
+
+    delta_context_destroy(&sender);
+    delta_context_destroy(&receiver);
+
+    printf("Delta frames OK\n");
+
+    return 0;
+
+}
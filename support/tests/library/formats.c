@@ -0,0 +1,101 @@
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+
+#include "tracker.h"
+
+#define WIDTH 10
+#define HEIGHT 6
+#define PADDING 8
+
+// Memory formats of the frames in order and the number of bytes of their pixels
+static const int formats[] = {TRAX_IMAGE_MEMORY_RGB, TRAX_IMAGE_MEMORY_BGR, TRAX_IMAGE_MEMORY_RGBA,
+    TRAX_IMAGE_MEMORY_BGRA, TRAX_IMAGE_MEMORY_NV12, TRAX_IMAGE_MEMORY_GRAY16};
+static const int depths[] = {3, 3, 4, 4, 1, 2};
+
+#define FRAMES ((int) (sizeof(formats) / sizeof(int)))
+
+// Wrapped buffers have to outlive the images, they are released at the end
+static char* buffers[FRAMES];
+
+static int image_rows(int frame) {
+
+    return formats[frame] == TRAX_IMAGE_MEMORY_NV12 ? HEIGHT + HEIGHT / 2 : HEIGHT;
+
+}
+
+static unsigned char image_value(int frame, int i, int j) {
+
+    return (unsigned char) (i * 3 + j * 11 + frame);
+
+}
+
+// Images are wrapped around buffers with padded rows, the first one is allocated by the library
+static trax_image* create_image(trax_handle* client, int frame) {
+
+    int i, j, row = WIDTH * depths[frame], stride = frame ? row + PADDING : row;
+    trax_image* image;
+
+    buffers[frame] = (char*) malloc(stride * image_rows(frame));
+    memset(buffers[frame], 0xEE, stride * image_rows(frame));
+
+    for (j = 0; j < image_rows(frame); j++)
+        for (i = 0; i < row; i++)
+            buffers[frame][j * stride + i] = (char) image_value(frame, i, j);
+
+    if (!frame) {
+        image = trax_image_create_memory(WIDTH, HEIGHT, formats[frame]);
+        for (j = 0; j < image_rows(frame); j++)
+            memcpy(trax_image_write_memory_row(image, j), buffers[frame] + j * stride, row);
+        return image;
+    }
+
+    return trax_image_create_memory_wrap(WIDTH, HEIGHT, formats[frame], stride, buffers[frame], NULL, NULL);
+
+}
+
+static int check_image(trax_handle* server, int frame, const trax_image* image) {
+
+    int i, j, width, height, format, errors = 0;
+
+    trax_image_get_memory_header(image, &width, &height, &format);
+
+    if (width != WIDTH || height != HEIGHT || format != formats[frame]) return 1;
+
+    for (j = 0; j < image_rows(frame); j++) {
+        const unsigned char* row = (const unsigned char*) trax_image_get_memory_row(image, j);
+        for (i = 0; i < WIDTH * depths[frame]; i++)
+            if (row[i] != image_value(frame, i, j)) errors++;
+    }
+
+    return errors;
+
+}
+
+int main( int argc, char** argv) {
+
+    int frame;
+    tracker_test test;
+
+    test.metadata = trax_metadata_create(TRAX_REGION_RECTANGLE, TRAX_IMAGE_MEMORY,
+        TRAX_CHANNEL_COLOR, "formats", NULL, NULL, 0);
+    test.region = trax_region_create_rectangle(1, 1, 5, 3);
+    test.frames = FRAMES;
+    test.create_image = create_image;
+    test.check_image = check_image;
+
+    for (frame = 0; frame < FRAMES; frame++)
+        test.metadata->format_memory |= TRAX_IMAGE_MEMORY_FLAG(formats[frame]);
+
+    assert(tracker_test_run(&test) == 0);
+
+    for (frame = 0; frame < FRAMES; frame++)
+        free(buffers[frame]);
+
+    trax_region_release(&test.region);
+    trax_metadata_release(&test.metadata);
+
+    return 0;
+
+}
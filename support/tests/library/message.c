@@ -0,0 +1,201 @@
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "message.h"
+#include "base64.h"
+
+#define LARGE_LENGTH 300000
+
+// Writes a binary frame header with the declared length of the first field, which is a key if there
+// are no arguments, and returns the result of reading it on the other side of a pipe
+static int read_declared(int type, int arguments, int properties, int length) {
+
+    int result, channel[2];
+    char header[7 + 1 + 8 + 4];
+    message_stream* stream;
+
+    assert(pipe(channel) == 0);
+
+    memcpy(header, TRAX_BINARY_PREFIX, 7);
+    header[7] = (char) type;
+    message_encode_length(header + 8, arguments);
+    message_encode_length(header + 12, properties);
+    message_encode_length(header + 16, length);
+
+    assert(write(channel[1], header, sizeof(header)) == sizeof(header));
+    close(channel[1]);
+
+    stream = create_message_stream_file(channel[0], -1);
+
+    result = read_message(stream, NULL);
+
+    destroy_message_stream(&stream);
+    close(channel[0]);
+
+    return result;
+
+}
+
+// Returns an argument with a header and the base64 encoded content
+static char* encode_argument(const char* header, const char* data, int length) {
+
+    char* argument = (char*) malloc(strlen(header) + base64encodelen(length) + 1);
+
+    strcpy(argument, header);
+    base64encode(argument + strlen(header), (const unsigned char*) data, length);
+
+    return argument;
+
+}
+
+// Image content of text messages is decoded while it is parsed, raw images go to pooled buffers
+static void test_payloads() {
+
+    int i, length, pooled, channel[2];
+    char raw[6 * 6];
+    char *data, *image, *buffer;
+    image_pool* pool = image_pool_create(2);
+    message_stream *writer, *reader;
+    string_list* values = list_create(3);
+
+    for (i = 0; i < (int) sizeof(raw); i++) raw[i] = (char) (i * 37);
+
+    image = encode_argument("image:6;4;nv12;", raw, sizeof(raw));
+    buffer = encode_argument("data:image/png;", raw, 20);
+
+    list_append(values, image);
+    list_append(values, "path/to/image.jpg");
+    list_append(values, buffer);
+
+    assert(pipe(channel) == 0);
+
+    writer = create_message_stream_file(-1, channel[1]);
+    reader = create_message_stream_file(channel[0], -1);
+    message_stream_set_pool(reader, pool);
+
+    write_message(writer, NULL, TRAX_FRAME, values, NULL);
+
+    assert(read_message(reader, NULL) == TRAX_FRAME);
+    assert(list_size(message_arguments(reader)) == 3);
+    assert(strcmp(list_get(message_arguments(reader), 0), "image:6;4;nv12;") == 0);
+    assert(strcmp(list_get(message_arguments(reader), 1), "path/to/image.jpg") == 0);
+
+    data = message_take_payload(reader, 0, &length, &pooled);
+    assert(data && pooled && length == sizeof(raw) && memcmp(data, raw, length) == 0);
+    assert(pool->allocated == 1);
+    image_pool_recycle(pool, data, length);
+
+    assert(message_take_payload(reader, 1, &length, &pooled) == NULL);
+
+    data = message_take_payload(reader, 2, &length, &pooled);
+    assert(data && !pooled && length == 20 && memcmp(data, raw, length) == 0);
+    free(data);
+
+    // Raw content that does not match the size in the header is not accepted
+    free(image);
+    image = encode_argument("image:6;4;nv12;", raw, 30);
+    list_reset(values);
+    list_append(values, image);
+
+    write_message(writer, NULL, TRAX_FRAME, values, NULL);
+
+    assert(read_message(reader, NULL) == TRAX_FRAME);
+    assert(message_take_payload(reader, 0, &length, &pooled) == NULL);
+
+    destroy_message_stream(&writer);
+    destroy_message_stream(&reader);
+    close(channel[0]);
+    close(channel[1]);
+
+    list_destroy(&values);
+    free(image);
+    free(buffer);
+    image_pool_retire(pool);
+
+}
+
+int main( int argc, char** argv) {
+
+    int i, status, channel[2];
+    pid_t writer;
+    char* large = (char*) malloc(LARGE_LENGTH);
+    message_stream* stream;
+    string_list* arguments;
+
+    // Payloads contain every byte value, including new lines and quotes
+    for (i = 0; i < LARGE_LENGTH; i++) large[i] = (char) ((i * 7) % 256);
+
+    assert(pipe(channel) == 0);
+
+    writer = fork();
+
+    if (writer == 0) {
+
+        trax_properties* properties = trax_properties_create();
+        string_list* values = list_create(2);
+
+        close(channel[0]);
+
+        stream = create_message_stream_file(-1, channel[1]);
+        stream->flags |= TRAX_STREAM_BINARY;
+
+        list_append_n(values, large, LARGE_LENGTH);
+        list_append(values, "");
+        trax_properties_set(properties, "trax.sequence", "3");
+
+        write_message(stream, NULL, TRAX_FRAME, values, properties);
+        write_message(stream, NULL, TRAX_QUIT, NULL, NULL);
+
+        destroy_message_stream(&stream);
+        close(channel[1]);
+        list_destroy(&values);
+        trax_properties_release(&properties);
+
+        exit(0);
+
+    }
+
+    close(channel[1]);
+
+    stream = create_message_stream_file(channel[0], -1);
+
+    assert(read_message(stream, NULL) == TRAX_FRAME);
+
+    arguments = message_arguments(stream);
+
+    assert(list_size(arguments) == 2);
+    assert(list_length(arguments, 0) == LARGE_LENGTH && memcmp(list_get(arguments, 0), large, LARGE_LENGTH) == 0);
+    assert(list_length(arguments, 1) == 0);
+    assert(strcmp(message_property(stream, "trax.sequence"), "3") == 0);
+
+    assert(read_message(stream, NULL) == TRAX_QUIT);
+    assert(list_size(message_arguments(stream)) == 0);
+
+    destroy_message_stream(&stream);
+    close(channel[0]);
+
+    waitpid(writer, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    // Declared lengths are checked before anything is allocated, a truncated frame is an error
+    assert(read_declared(TRAX_FRAME, 1, 0, 0x40000001) == TRAX_ERROR);
+    assert(read_declared(TRAX_FRAME, 65537, 0, 4) == TRAX_ERROR);
+    assert(read_declared(TRAX_FRAME, 0, 65537, 4) == TRAX_ERROR);
+    assert(read_declared(TRAX_STATE + 1, 1, 0, 4) == TRAX_ERROR);
+    assert(read_declared(TRAX_FRAME, 1, 0, 0x3FFFFFFF) == TRAX_ERROR);
+    assert(read_declared(TRAX_FRAME, 0, 1, 0x100000) == TRAX_ERROR);
+
+    free(large);
+
+    test_payloads();
+
+    printf("Message framing OK\n");
+
+    return 0;
+
+}
@@ -0,0 +1,57 @@
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+
+#include "pool.h"
+
+int main( int argc, char** argv) {
+
+    char *a, *b, *c, *d;
+    image_pool* pool = image_pool_create(2);
+
+    a = image_pool_acquire(pool, 100);
+    b = image_pool_acquire(pool, 100);
+
+    assert(pool->allocated == 2 && pool->reused == 0 && pool->references == 2);
+
+    image_pool_recycle(pool, a, 100);
+    image_pool_recycle(pool, b, 100);
+
+    assert(pool->count == 2 && pool->references == 0);
+
+    // The most recently returned buffer of a matching size is handed out first
+    c = image_pool_acquire(pool, 100);
+    d = image_pool_acquire(pool, 200);
+
+    assert(c == b && pool->reused == 1 && pool->allocated == 3);
+
+    // Only the newest idle buffers are kept when the pool is full
+    image_pool_recycle(pool, c, 100);
+    image_pool_recycle(pool, d, 200);
+
+    assert(pool->count == 2 && pool->sizes[0] == 100 && pool->sizes[1] == 200);
+
+    a = image_pool_acquire(pool, 100);
+    b = image_pool_acquire(pool, 100);
+
+    assert(a == c && pool->reused == 2 && pool->allocated == 4);
+
+    // Without capacity returned buffers are freed
+    image_pool_set_capacity(pool, 0);
+
+    assert(pool->count == 0);
+
+    image_pool_recycle(pool, a, 100);
+
+    assert(pool->count == 0 && pool->references == 1);
+
+    // A retired pool lives until its last buffer is returned
+    image_pool_retire(pool);
+    image_pool_recycle(pool, b, 100);
+
+    printf("Image pool OK\n");
+
+    return 0;
+
+}
@@ -1,7 +1,9 @@
 
 #include <string.h>
+#include <stdlib.h>
 #include <stdio.h>
 #include <assert.h>
+#include <math.h>
 
 #include "region.h"
 
@@ -23,6 +25,165 @@ const char* test_strings[] = {
     (char*) 0
 };
 
+// Pairs of regions and their exact overlap
+const char* overlap_strings[][2] = {
+    {"0,0,10,10", "5,5,10,10"},
+    {"0,0,10,0,10,10,0,10", "0,10,10,10,10,0,0,0"},
+    {"0,0,100,0,100,30,30,30,30,100,0,100", "10,10,90,10,90,90,10,90"},
+    {"0,0,10,10", "100,100,10,10"},
+    {(char*) 0, (char*) 0}
+};
+
+const float overlap_values[] = {25.0f / 175.0f, 1.0f, 2800.0f / 8700.0f, 0.0f};
+
+// Pairs of regions whose overlap is computed without rasterizing them whole, every pair is also
+// compared within a canvas that cuts off some of the regions
+const char* fast_strings[][2] = {
+    {"0,0,10,10", "5,5,10,10"},
+    {"0.5,0.5,10.2,10.7", "3.3,2.8,4.1,20"},
+    {"0,0,10,10", "20,20,5,5"},
+    {"-20,-10,30,25", "5,5,50,50"},
+    {"10,10,5,5", "12,-30,3,100"},
+    {"0,0,10,0", "0,0,10,10"},
+    {"-30,-30,10,10", "50,50,10,10"},
+    {"mask:0,0,7,5,3,4,2,6,1,9", "mask:2,1,9,3,0,5,4,3,8"},
+    {"mask:-3,-2,13,9,4,20,3,30", "0,0,10,10"},
+    {"mask:10,5,65,3,10,50,20,60", "mask:0,0,63,40,100,900,200"},
+    {"mask:0,0,5,5,0,25", "mask:50,50,3,3,0,9"},
+    {"mask:5,5,3,40,1,2,4,60,3,40", "2,2,20,20"},
+    {"mask:-70,-5,129,9,0,700,200,100", "mask:1,1,3,3,0,9"},
+    {"0,0,10,10", "2,2,20,2,11,15"},
+    {"-10,-10,30,-5,20,25,-5,15", "0,0,20,20"},
+    {"0,0,30,0,30,30,15,10,0,30", "5,5,25,5,15,35"},
+    {"0,0,10,0,5,8", "30,30,40,30,35,38"},
+    {"-20,50,60,-20,70,10,10,70", "35.5,35.5,45.2,20.1,60,60"},
+    {"mask:0,0,7,5,3,4,2,6,1,9", "1,-1,8,2,3,7"},
+    {"mask:-3,-2,13,9,4,20,3,30", "-10,-10,30,-5,20,25,-5,15"},
+    {"mask:10,5,65,3,10,50,20,60", "0,0,80,2,40,12"},
+    {(char*) 0, (char*) 0}
+};
+
+static region_bounds reference_bounds(const region_container* r, region_bounds bounds, int legacy) {
+
+    region_bounds b = region_compute_bounds(r);
+
+    if (!legacy) {
+        b.left = floor(b.left); b.top = floor(b.top);
+        b.right = ceil(b.right); b.bottom = ceil(b.bottom);
+    }
+
+    b.left = b.left > bounds.left ? b.left : bounds.left;
+    b.top = b.top > bounds.top ? b.top : bounds.top;
+    b.right = b.right < bounds.right ? b.right : bounds.right;
+    b.bottom = b.bottom < bounds.bottom ? b.bottom : bounds.bottom;
+
+    return b;
+
+}
+
+static float reference_bounds_overlap(region_bounds a, region_bounds b) {
+
+    float intersection = ((a.right < b.right ? a.right : b.right) - (a.left > b.left ? a.left : b.left)) *
+                         ((a.bottom < b.bottom ? a.bottom : b.bottom) - (a.top > b.top ? a.top : b.top));
+    float overlap = intersection / (((a.right - a.left) * (a.bottom - a.top)) + ((b.right - b.left) * (b.bottom - b.top)) - intersection);
+
+    return overlap > 0 ? overlap : 0;
+
+}
+
+static int reference_count(const region_container* r, int x, int y, int width, int height) {
+
+    int i, count = 0;
+    char* mask;
+
+    if (width < 1 || height < 1) return 0;
+
+    mask = (char*) malloc(width * height);
+
+    region_get_mask_offset(r, mask, x, y, width, height);
+
+    for (i = 0; i < width * height; i++) if (mask[i]) count++;
+
+    free(mask);
+
+    return count;
+
+}
+
+// Overlap of two regions that are both rasterized in a common window, as it was computed originally
+static region_overlap reference_overlap(const region_container* ra, const region_container* rb, region_bounds bounds, int legacy) {
+
+    int i, x, y, width, height;
+    int only1 = 0, only2 = 0, both = 0;
+    double a1, a2;
+    region_bounds b1, b2;
+    region_overlap overlap;
+
+    overlap.overlap = 0;
+    overlap.only1 = 0;
+    overlap.only2 = 0;
+
+    b1 = reference_bounds(ra, bounds, legacy);
+    b2 = reference_bounds(rb, bounds, legacy);
+
+    x = (int) (b1.left < b2.left ? b1.left : b2.left);
+    y = (int) (b1.top < b2.top ? b1.top : b2.top);
+
+    width = (int) ((b1.right > b2.right ? b1.right : b2.right) - x) + 1;
+    height = (int) ((b1.bottom > b2.bottom ? b1.bottom : b2.bottom) - y) + 1;
+
+    a1 = (b1.right - b1.left) * (b1.bottom - b1.top);
+    a2 = (b2.right - b2.left) * (b2.bottom - b2.top);
+
+    if (a1 / a2 < 1e-10 || a2 / a1 < 1e-10 || width < 1 || height < 1)
+        return overlap;
+
+    if (reference_bounds_overlap(b1, b2) == 0) {
+
+        only1 = reference_count(ra, (int) b1.left, (int) b1.top, (int) (b1.right - b1.left + 1), (int) (b1.bottom - b1.top + 1));
+        only2 = reference_count(rb, (int) b2.left, (int) b2.top, (int) (b2.right - b2.left + 1), (int) (b2.bottom - b2.top + 1));
+
+        overlap.only1 = (float) only1 / (float) (only1 + only2);
+        overlap.only2 = (float) only2 / (float) (only1 + only2);
+
+        return overlap;
+
+    }
+
+    {
+        char* mask1 = (char*) malloc(width * height);
+        char* mask2 = (char*) malloc(width * height);
+
+        region_get_mask_offset(ra, mask1, x, y, width, height);
+        region_get_mask_offset(rb, mask2, x, y, width, height);
+
+        for (i = 0; i < width * height; i++) {
+            if (mask1[i] && mask2[i]) both++;
+            else if (mask1[i]) only1++;
+            else if (mask2[i]) only2++;
+        }
+
+        free(mask1);
+        free(mask2);
+    }
+
+    overlap.only1 = (float) only1 / (float) (only1 + only2 + both);
+    overlap.only2 = (float) only2 / (float) (only1 + only2 + both);
+    overlap.overlap = both / (float) (only1 + only2 + both);
+
+    return overlap;
+
+}
+
+// Overlaps are equal when all their parts are equal, undefined parts of both have to be undefined
+static int same_overlap(region_overlap o1, region_overlap o2) {
+
+    return (o1.overlap == o2.overlap || (isnan(o1.overlap) && isnan(o2.overlap))) &&
+           (o1.only1 == o2.only1 || (isnan(o1.only1) && isnan(o2.only1))) &&
+           (o1.only2 == o2.only2 || (isnan(o1.only2) && isnan(o2.only2)));
+
+}
+
 int main( int argc, char** argv) {
 
     int t = 0;
@@ -54,6 +215,94 @@ int main( int argc, char** argv) {
 
     }
 
+    region_set_flags(REGION_EXACT_OVERLAP);
+
+    for (t = 0; overlap_strings[t][0]; t++) {
+
+        region_container *r1, *r2;
+        float overlap;
+
+        region_parse(overlap_strings[t][0], &r1);
+        region_parse(overlap_strings[t][1], &r2);
+
+        overlap = region_compute_overlap(r1, r2, region_no_bounds).overlap;
+
+        printf("%s ** %s ** %f \n", overlap_strings[t][0], overlap_strings[t][1], overlap);
+
+        assert(fabs(overlap - overlap_values[t]) < 1e-5);
+
+        region_release(&r1);
+        region_release(&r2);
+
+    }
+
+    region_clear_flags(REGION_EXACT_OVERLAP);
+
+    // Shortcuts that avoid rasterizing regions have to count the same pixels as rasterized masks
+    for (t = 0; fast_strings[t][0]; t++) {
+
+        int legacy;
+        region_container *r1, *r2;
+        region_bounds canvas = region_create_bounds(0, 0, 39, 39);
+
+        region_parse(fast_strings[t][0], &r1);
+        region_parse(fast_strings[t][1], &r2);
+
+        for (legacy = 0; legacy < 2; legacy++) {
+
+            if (legacy) region_set_flags(REGION_LEGACY_RASTERIZATION);
+
+            printf("%s ** %s ** %f \n", fast_strings[t][0], fast_strings[t][1], region_compute_overlap(r1, r2, region_no_bounds).overlap);
+
+            assert(same_overlap(region_compute_overlap(r1, r2, region_no_bounds), reference_overlap(r1, r2, region_no_bounds, legacy)));
+            assert(same_overlap(region_compute_overlap(r2, r1, region_no_bounds), reference_overlap(r2, r1, region_no_bounds, legacy)));
+            assert(same_overlap(region_compute_overlap(r1, r2, canvas), reference_overlap(r1, r2, canvas, legacy)));
+
+            region_clear_flags(REGION_LEGACY_RASTERIZATION);
+
+        }
+
+        region_release(&r1);
+        region_release(&r2);
+
+    }
+
+    // Vectorized mask kernels have to count the same pixels as the plain loops
+    srand(1);
+
+    for (t = 0; t < 20; t++) {
+
+        int i;
+        region_container *m1, *m2, *p;
+        region_overlap o1, o2;
+
+        m1 = region_create_mask(rand() % 50, rand() % 50, 100 + rand() % 200, 1 + rand() % 50);
+        m2 = region_create_mask(rand() % 50, rand() % 50, 100 + rand() % 200, 1 + rand() % 50);
+        region_parse("20,10,250,30,200,90,10,70", &p);
+
+        for (i = 0; i < m1->data.mask.width * m1->data.mask.height; i++) m1->data.mask.data[i] = rand() % 3 == 0;
+        for (i = 0; i < m2->data.mask.width * m2->data.mask.height; i++) m2->data.mask.data[i] = rand() % 2 == 0;
+
+        o1 = region_compute_overlap(m1, m2, region_no_bounds);
+        region_set_flags(REGION_SCALAR_KERNELS);
+        o2 = region_compute_overlap(m1, m2, region_no_bounds);
+        region_clear_flags(REGION_SCALAR_KERNELS);
+
+        assert(o1.overlap == o2.overlap && o1.only1 == o2.only1 && o1.only2 == o2.only2);
+
+        o1 = region_compute_overlap(m1, p, region_no_bounds);
+        region_set_flags(REGION_SCALAR_KERNELS);
+        o2 = region_compute_overlap(m1, p, region_no_bounds);
+        region_clear_flags(REGION_SCALAR_KERNELS);
+
+        assert(o1.overlap == o2.overlap && o1.only1 == o2.only1 && o1.only2 == o2.only2);
+
+        region_release(&m1);
+        region_release(&m2);
+        region_release(&p);
+
+    }
+
 }
 
 
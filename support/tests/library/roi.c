@@ -0,0 +1,103 @@
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+
+#include "tracker.h"
+
+#define WIDTH 64
+#define HEIGHT 48
+#define FRAMES 4
+
+// Every pixel holds its own coordinates, so the part of the image that was received can be verified
+static trax_image* create_image(trax_handle* client, int frame) {
+
+    int i, j, roi = 0;
+    trax_image* image = trax_image_create_memory(WIDTH, HEIGHT, TRAX_IMAGE_MEMORY_RGB);
+
+    for (j = 0; j < HEIGHT; j++) {
+        unsigned char* row = (unsigned char*) trax_image_write_memory_row(image, j);
+        for (i = 0; i < WIDTH; i++) {
+            row[i * 3] = (unsigned char) i;
+            row[i * 3 + 1] = (unsigned char) j;
+            row[i * 3 + 2] = 7;
+        }
+    }
+
+    trax_get_parameter(client, TRAX_PARAMETER_ROI, &roi);
+    assert(roi == 1);
+
+    return image;
+
+}
+
+// Counts the pixels that do not come from the expected position of the full image
+static int check_image(const trax_image* image, int x, int y, int step) {
+
+    int i, j, errors = 0;
+
+    for (j = 0; j < image->height; j++) {
+        const unsigned char* row = (const unsigned char*) trax_image_get_memory_row(image, j);
+        for (i = 0; i < image->width; i++) {
+            if (row[i * 3] != x + i * step || row[i * 3 + 1] != y + j * step || row[i * 3 + 2] != 7)
+                errors++;
+        }
+    }
+
+    return errors;
+
+}
+
+static int check_frame(trax_handle* server, int frame, const trax_image* image) {
+
+    int x, y, width, height, errors = 0;
+
+    switch (frame) {
+    case 0:
+        // The first frame is always whole, the next one is a part with the original resolution
+        errors += !trax_get_parameter(server, TRAX_PARAMETER_ROI, &x) || x != 1;
+        errors += trax_server_get_roi(server, NULL, NULL, NULL, NULL) != 0;
+        errors += image->width != WIDTH || image->height != HEIGHT || check_image(image, 0, 0, 1);
+        trax_server_request_roi(server, 10, 8, 20, 16, 1);
+        break;
+    case 1:
+        // A part that reaches over the border is clipped and then downscaled
+        errors += !trax_server_get_roi(server, &x, &y, &width, &height);
+        errors += x != 10 || y != 8 || width != 20 || height != 16;
+        errors += image->width != 20 || image->height != 16 || check_image(image, 10, 8, 1);
+        trax_server_request_roi(server, 50, 40, 30, 30, 0.5f);
+        break;
+    case 2:
+        errors += !trax_server_get_roi(server, &x, &y, &width, &height);
+        errors += x != 50 || y != 40 || width != 14 || height != 8;
+        errors += image->width != 7 || image->height != 4 || check_image(image, 50, 40, 2);
+        break;
+    default:
+        // A request applies to a single frame only
+        errors += trax_server_get_roi(server, NULL, NULL, NULL, NULL) != 0;
+        errors += image->width != WIDTH || image->height != HEIGHT;
+    }
+
+    return errors;
+
+}
+
+int main( int argc, char** argv) {
+
+    tracker_test test;
+
+    test.metadata = trax_metadata_create(TRAX_REGION_RECTANGLE, TRAX_IMAGE_MEMORY,
+        TRAX_CHANNEL_COLOR, "roi", NULL, NULL, TRAX_METADATA_ROI);
+    test.region = trax_region_create_rectangle(10, 10, 20, 20);
+    test.frames = FRAMES;
+    test.create_image = create_image;
+    test.check_image = check_frame;
+
+    assert(tracker_test_run(&test) == 0);
+
+    trax_region_release(&test.region);
+    trax_metadata_release(&test.metadata);
+
+    return 0;
+
+}
@@ -0,0 +1,108 @@
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "shared.h"
+
+// Checks if a segment can still be opened by its name
+static int segment_exists(const char* name) {
+
+    int fd = shm_open(name, O_RDONLY, 0);
+
+    if (fd < 0) return 0;
+
+    close(fd);
+
+    return 1;
+
+}
+
+int main( int argc, char** argv) {
+
+    int i, offset;
+    char name[SHARED_NAME_LENGTH];
+    shared_context *client, *server;
+    shared_segment *segment, *grown, *mapped, *remapped;
+
+    if (!shared_supported()) {
+        printf("Shared memory not supported\n");
+        return 0;
+    }
+
+    client = shared_context_create();
+    server = shared_context_create();
+
+    // Every frame gets its own slot until all of them wait for a reply
+    for (i = 0; i < SHARED_SLOTS; i++) {
+        segment = shared_ring_acquire(client, 0, 1000, &offset);
+        assert(segment && offset == i * 4096);
+        segment->data[offset] = (char) (i + 1);
+        shared_context_sent(client);
+    }
+
+    assert(shared_ring_acquire(client, 0, 1000, &offset) == NULL);
+
+    mapped = shared_context_map(server, 0, segment->name);
+    assert(mapped && shared_context_map(server, 0, segment->name) == mapped);
+
+    for (i = 0; i < SHARED_SLOTS; i++)
+        assert(mapped->data[i * 4096] == (char) (i + 1));
+
+    // The slot of the oldest frame is reused only after its reply
+    shared_context_acknowledge(client);
+
+    assert(shared_ring_acquire(client, 0, 1000, &offset) == segment && offset == 0);
+    shared_context_sent(client);
+
+    // A larger frame replaces the segment, the old one is kept until its frames are answered
+    strcpy(name, segment->name);
+
+    shared_context_acknowledge(client);
+
+    grown = shared_ring_acquire(client, 0, 10000, &offset);
+    assert(grown && grown != segment && offset == 0);
+    grown->data[offset] = 42;
+    shared_context_sent(client);
+
+    assert(segment_exists(name));
+
+    for (i = 0; i < SHARED_SLOTS - 2; i++)
+        shared_context_acknowledge(client);
+
+    assert(segment_exists(name));
+
+    shared_context_acknowledge(client);
+
+    assert(!segment_exists(name));
+
+    shared_context_acknowledge(client);
+    assert(shared_ring_acquire(client, 0, 10000, &offset) == grown && offset == grown->size / SHARED_SLOTS);
+    shared_context_sent(client);
+
+    // The server releases the previous segment of a channel once no image is using it
+    shared_segment_reference(mapped);
+
+    remapped = shared_context_map(server, 0, grown->name);
+    assert(remapped && remapped != mapped && remapped->data[0] == 42);
+    assert(server->mapped == remapped && !remapped->next);
+
+    assert(mapped->data[2 * 4096] == 3);
+    shared_segment_dereference(mapped);
+
+    strcpy(name, grown->name);
+
+    shared_context_destroy(&client);
+    shared_context_destroy(&server);
+
+    assert(!segment_exists(name));
+
+    printf("Shared memory OK\n");
+
+    return 0;
+
+}
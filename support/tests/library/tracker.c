@@ -0,0 +1,106 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "tracker.h"
+
+static int run_server(const tracker_test* test, int input, int output) {
+
+    int frame, errors = 0;
+    trax_handle* server = trax_server_setup_file(test->metadata, input, output, trax_no_log);
+    trax_image_list* images = NULL;
+    trax_object_list* objects = NULL;
+    trax_object_list* received = NULL;
+
+    for (frame = 0; frame < test->frames; frame++) {
+
+        int tr = trax_server_wait(server, &images, &received, NULL);
+
+        if (tr != (frame ? TRAX_FRAME : TRAX_INITIALIZE)) return 100;
+
+        if (received) {
+            if (objects) trax_object_list_release(&objects);
+            objects = received;
+        }
+
+        errors += test->check_image(server, frame, trax_image_list_get(images, TRAX_CHANNEL_COLOR));
+
+        trax_server_reply(server, objects);
+
+        trax_image_list_clear(images);
+        trax_image_list_release(&images);
+
+    }
+
+    // The client ends the session, the tracker must not leave before that
+    errors += trax_server_wait(server, &images, &received, NULL) != TRAX_QUIT;
+
+    trax_object_list_release(&objects);
+    trax_cleanup(&server);
+
+    return errors;
+
+}
+
+int tracker_test_run(const tracker_test* test) {
+
+    int frame, status;
+    int request[2], response[2];
+    pid_t tracker;
+    trax_handle* client;
+    trax_object_list* objects;
+
+    assert(pipe(request) == 0 && pipe(response) == 0);
+
+    tracker = fork();
+
+    if (tracker == 0) {
+        close(request[1]);
+        close(response[0]);
+        exit(run_server(test, request[0], response[1]));
+    }
+
+    close(request[0]);
+    close(response[1]);
+
+    client = trax_client_setup_file(response[0], request[1], trax_no_log);
+    assert(client);
+
+    objects = trax_object_list_create(1);
+    trax_object_list_set(objects, 0, test->region);
+
+    for (frame = 0; frame < test->frames; frame++) {
+
+        trax_object_list* state = NULL;
+        trax_image_list* images = trax_image_list_create();
+
+        trax_image_list_set(images, test->create_image(client, frame), TRAX_CHANNEL_COLOR);
+
+        if (frame == 0)
+            assert(trax_client_initialize(client, images, objects, NULL) == TRAX_OK);
+        else
+            assert(trax_client_frame(client, images, NULL, NULL) == TRAX_OK);
+
+        assert(trax_client_wait(client, &state, NULL) == TRAX_STATE);
+
+        trax_object_list_release(&state);
+        trax_image_list_clear(images);
+        trax_image_list_release(&images);
+
+    }
+
+    trax_cleanup(&client);
+    trax_object_list_release(&objects);
+
+    waitpid(tracker, &status, 0);
+
+    status = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+
+    printf("Tracker finished with %d errors\n", status);
+
+    return status;
+
+}
@@ -0,0 +1,26 @@
+#ifndef _TEST_TRACKER_H_
+#define _TEST_TRACKER_H_
+
+#include <trax.h>
+
+/**
+ * A session between a client and a tracker that runs in a child process and is connected to it
+ * with pipes. The client initializes the tracker with the region and sends the given number of frames,
+ * the tracker checks every received image and reports the number of errors with its exit status.
+**/
+typedef struct tracker_test {
+    trax_metadata* metadata;
+    trax_region* region;
+    int frames;
+    // Returns the image of a frame on the client side, the client is passed to check its parameters
+    trax_image* (*create_image)(trax_handle* client, int frame);
+    // Returns the number of errors in a frame that was received by the tracker
+    int (*check_image)(trax_handle* server, int frame, const trax_image* image);
+} tracker_test;
+
+/**
+ * Runs the session and returns the number of errors reported by the tracker.
+**/
+int tracker_test_run(const tracker_test* test);
+
+#endif